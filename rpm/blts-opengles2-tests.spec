@@ -9,6 +9,7 @@ Source0: %{name}-%{version}.tar.gz
 BuildRequires: libbltscommon-devel
 BuildRequires: pkgconfig(wayland-client)
 BuildRequires: pkgconfig(wayland-egl)
+BuildRequires: pkgconfig(wayland-protocols)
 BuildRequires: pkgconfig(egl)
 BuildRequires: pkgconfig(glesv2)
 Requires: mce-tools
@@ -0,0 +1,516 @@
+/* ogles2_baseline.c -- Comparison against stored results
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ogles2_helper.h"
+#include "ogles2_baseline.h"
+#include "ogles2_stats.h"
+
+#define MAX_CASE_NAME_LEN 256
+
+/* Baseline and current samples of one metric of one case */
+typedef struct
+{
+	char* case_name;
+	char tag[RESULTS_MAX_TAG_LEN];
+	char unit[RESULTS_MAX_UNIT_LEN];
+	/* As reported by the current run, result files do not store it */
+	enum glesh_result_direction direction;
+	stats_acc baseline;
+	stats_acc current;
+} baseline_metric;
+
+static baseline_metric* metrics;
+static int num_metrics;
+static int max_metrics;
+static int loaded;
+
+static baseline_metric* find_metric(const char* case_name, const char* tag,
+	int create)
+{
+	baseline_metric* metric;
+	int t;
+
+	for(t = 0; t < num_metrics; t++)
+	{
+		if(!strcmp(metrics[t].tag, tag) &&
+			!strcmp(metrics[t].case_name, case_name))
+		{
+			return &metrics[t];
+		}
+	}
+
+	if(!create)
+	{
+		return NULL;
+	}
+
+	if(num_metrics == max_metrics)
+	{
+		max_metrics = max_metrics ? max_metrics * 2 : 64;
+		metric = realloc(metrics, sizeof(baseline_metric) * max_metrics);
+		if(!metric)
+		{
+			BLTS_LOGGED_PERROR("realloc");
+			return NULL;
+		}
+		metrics = metric;
+	}
+
+	metric = &metrics[num_metrics];
+	memset(metric, 0, sizeof(baseline_metric));
+	metric->case_name = strdup(case_name);
+	if(!metric->case_name)
+	{
+		BLTS_LOGGED_PERROR("strdup");
+		return NULL;
+	}
+	strncpy(metric->tag, tag, RESULTS_MAX_TAG_LEN - 1);
+	num_metrics++;
+
+	return metric;
+}
+
+static void add_baseline_sample(const char* case_name, const char* tag,
+	double value, const char* unit)
+{
+	baseline_metric* metric = find_metric(case_name, tag, 1);
+
+	if(metric)
+	{
+		snprintf(metric->unit, RESULTS_MAX_UNIT_LEN, "%s", unit);
+		stats_add(&metric->baseline, value);
+	}
+}
+
+/* Just enough JSON to read back what ogles2_results.c writes */
+
+static const char* skip_ws(const char* p)
+{
+	while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+	{
+		p++;
+	}
+
+	return p;
+}
+
+static const char* json_token(const char* p, const char* token)
+{
+	p = skip_ws(p);
+	if(strncmp(p, token, strlen(token)))
+	{
+		return NULL;
+	}
+
+	return p + strlen(token);
+}
+
+static const char* json_string(const char* p, char* out, int size)
+{
+	int len = 0;
+
+	p = json_token(p, "\"");
+	if(!p)
+	{
+		return NULL;
+	}
+
+	for(; *p && *p != '"'; p++)
+	{
+		if(*p == '\\')
+		{
+			if(!*++p)
+			{
+				return NULL;
+			}
+			/* Control characters are not expected in names */
+			if(*p == 'u')
+			{
+				p += 4;
+				continue;
+			}
+		}
+		if(len < size - 1)
+		{
+			out[len++] = *p;
+		}
+	}
+	out[len] = 0;
+
+	return *p ? p + 1 : NULL;
+}
+
+/* Sets *valid to 0 for null */
+static const char* json_number(const char* p, double* value, int* valid)
+{
+	char* end;
+
+	p = skip_ws(p);
+	if(!strncmp(p, "null", 4))
+	{
+		*valid = 0;
+		return p + 4;
+	}
+
+	*value = strtod(p, &end);
+	*valid = 1;
+
+	return end != p ? end : NULL;
+}
+
+static int parse_json_line(const char* line)
+{
+	char case_name[MAX_CASE_NAME_LEN];
+	char tag[RESULTS_MAX_TAG_LEN];
+	char unit[RESULTS_MAX_UNIT_LEN];
+	const char* p;
+	double value = 0.0;
+	int valid = 0;
+
+	p = strstr(line, "\"test\":");
+	if(!p || !json_string(p + 7, case_name, sizeof(case_name)))
+	{
+		return 0;
+	}
+
+	/* Failed runs and the summaries of -r are not a baseline */
+	p = strstr(line, "\"ret\":");
+	if(!p || atoi(p + 6))
+	{
+		return 1;
+	}
+
+	p = strstr(line, "\"metrics\":{");
+	if(!p)
+	{
+		return 0;
+	}
+	p += 11;
+
+	while(!json_token(p, "}"))
+	{
+		if(!(p = json_string(p, tag, sizeof(tag))) ||
+			!(p = json_token(p, ":")) ||
+			!(p = json_token(p, "{")) ||
+			!(p = json_token(p, "\"value\":")) ||
+			!(p = json_number(p, &value, &valid)) ||
+			!(p = json_token(p, ",")) ||
+			!(p = json_token(p, "\"unit\":")) ||
+			!(p = json_string(p, unit, sizeof(unit))) ||
+			!(p = json_token(p, "}")))
+		{
+			return 0;
+		}
+
+		if(valid)
+		{
+			add_baseline_sample(case_name, tag, value, unit);
+		}
+
+		if(json_token(p, ","))
+		{
+			p = json_token(p, ",");
+		}
+	}
+
+	return 1;
+}
+
+/* test,case,metric,value,unit. Each run starts with its ret row. */
+static int parse_csv_line(const char* line, int* run_ok)
+{
+	char case_name[MAX_CASE_NAME_LEN];
+	char metric[RESULTS_MAX_TAG_LEN + 32];
+	char unit[RESULTS_MAX_UNIT_LEN];
+	const char* p = line;
+	double value;
+	int case_num;
+	int len = 0;
+
+	if(*p++ != '"')
+	{
+		return 0;
+	}
+
+	for(; *p; p++)
+	{
+		if(*p == '"')
+		{
+			if(p[1] != '"')
+			{
+				break;
+			}
+			p++;
+		}
+		if(len < MAX_CASE_NAME_LEN - 1)
+		{
+			case_name[len++] = *p;
+		}
+	}
+	case_name[len] = 0;
+
+	if(*p != '"')
+	{
+		return 0;
+	}
+
+	unit[0] = 0;
+	if(sscanf(p + 1, ",%d,%95[^,],%lf,%31[^\r\n]", &case_num, metric,
+		&value, unit) < 3)
+	{
+		return 0;
+	}
+
+	if(!strcmp(metric, "ret"))
+	{
+		*run_ok = value == 0.0;
+	}
+	else if(*run_ok && !strncmp(metric, "metric.", 7))
+	{
+		add_baseline_sample(case_name, metric + 7, value, unit);
+	}
+
+	return 1;
+}
+
+/* Reads a results file written with -rf, either format. Several runs of
+ * the same case are pooled. */
+int baseline_load(const char* filename)
+{
+	FILE* fp;
+	char* line = NULL;
+	size_t size = 0;
+	int csv = 0;
+	int run_ok = 0;
+	int line_num = 0;
+
+	fp = fopen(filename, "r");
+	if(!fp)
+	{
+		BLTS_LOGGED_PERROR("fopen");
+		return 0;
+	}
+
+	while(getline(&line, &size, fp) > 0)
+	{
+		line_num++;
+
+		if(line_num == 1 && !strncmp(line, "test,case,metric", 16))
+		{
+			csv = 1;
+			continue;
+		}
+
+		if(!*skip_ws(line))
+		{
+			continue;
+		}
+
+		if(csv ? !parse_csv_line(line, &run_ok) : !parse_json_line(line))
+		{
+			BLTS_ERROR("%s:%d: Invalid result line\n", filename, line_num);
+			free(line);
+			fclose(fp);
+			return 0;
+		}
+	}
+
+	free(line);
+	fclose(fp);
+
+	BLTS_DEBUG("Loaded %d baseline metrics from %s\n", num_metrics,
+		filename);
+	loaded = 1;
+
+	return 1;
+}
+
+void baseline_free()
+{
+	int t;
+
+	for(t = 0; t < num_metrics; t++)
+	{
+		free(metrics[t].case_name);
+	}
+
+	free(metrics);
+	metrics = NULL;
+	num_metrics = 0;
+	max_metrics = 0;
+	loaded = 0;
+}
+
+void baseline_add_run(const char* case_name, const results_metric* results,
+	int count)
+{
+	baseline_metric* metric;
+	int t;
+
+	if(!loaded)
+	{
+		return;
+	}
+
+	for(t = 0; t < count; t++)
+	{
+		metric = find_metric(case_name, results[t].tag, 1);
+		if(metric)
+		{
+			if(!metric->baseline.n)
+			{
+				strcpy(metric->unit, results[t].unit);
+			}
+			metric->direction = results[t].direction;
+			stats_add(&metric->current, results[t].value);
+		}
+	}
+}
+
+/* These depend on the environment more than on the driver and are
+ * reported without gating */
+static int metric_gated(const char* tag)
+{
+	static const char* ignored[] =
+	{
+		"cpu_use_", "warmup_", "image_load_time", "peak_rss",
+		"program_", NULL
+	};
+	int t;
+
+	for(t = 0; ignored[t]; t++)
+	{
+		if(!strncmp(tag, ignored[t], strlen(ignored[t])))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Prints the change of each metric of the case and returns the number of
+ * metrics that regressed by more than tolerance percent with statistical
+ * significance. With a single run on both sides significance cannot be
+ * estimated and the tolerance alone decides. Negative tolerance reports
+ * without gating. */
+int baseline_compare_case(const char* case_name, double tolerance)
+{
+	baseline_metric* metric;
+	const char* status;
+	double delta;
+	double worse;
+	int differ;
+	int regressions = 0;
+	int found = 0;
+	int t;
+
+	if(!loaded)
+	{
+		return 0;
+	}
+
+	for(t = 0; t < num_metrics; t++)
+	{
+		if(!strcmp(metrics[t].case_name, case_name) && metrics[t].baseline.n)
+		{
+			found = 1;
+			break;
+		}
+	}
+
+	if(!found)
+	{
+		BLTS_DEBUG("No baseline for '%s', not compared\n", case_name);
+		return 0;
+	}
+
+	if(tolerance < 0.0)
+	{
+		BLTS_DEBUG("Baseline comparison (not gated):\n");
+	}
+	else
+	{
+		BLTS_DEBUG("Baseline comparison (tolerance %.1f%%):\n", tolerance);
+	}
+	BLTS_DEBUG("%-24s %24s %24s %9s\n", "metric", "baseline (95% CI)",
+		"current (95% CI)", "change");
+
+	for(t = 0; t < num_metrics; t++)
+	{
+		metric = &metrics[t];
+		if(strcmp(metric->case_name, case_name) || !metric->current.n)
+		{
+			continue;
+		}
+
+		if(!metric->baseline.n)
+		{
+			BLTS_DEBUG("%-24s %24s %14.6g +-%-7.3g %9s no baseline\n",
+				metric->tag, "", metric->current.mean,
+				stats_ci95(&metric->current), "");
+			continue;
+		}
+
+		differ = stats_differ(&metric->baseline, &metric->current);
+
+		if(metric->baseline.mean != 0.0)
+		{
+			delta = (metric->current.mean - metric->baseline.mean) /
+				fabs(metric->baseline.mean) * 100.0;
+		}
+		else
+		{
+			delta = metric->current.mean == 0.0 ? 0.0 : NAN;
+		}
+		worse = metric->direction == GLESH_HIGHER_IS_BETTER ? -delta : delta;
+
+		if(!metric_gated(metric->tag) || tolerance < 0.0 || isnan(delta))
+		{
+			status = "";
+		}
+		else if(!differ)
+		{
+			status = "not significant";
+		}
+		else if(worse > tolerance)
+		{
+			status = differ < 0 ? "REGRESSION (single run)" : "REGRESSION";
+			regressions++;
+		}
+		else if(worse < -tolerance)
+		{
+			status = "improvement";
+		}
+		else
+		{
+			status = "within tolerance";
+		}
+
+		BLTS_DEBUG("%-24s %14.6g +-%-7.3g %14.6g +-%-7.3g %+8.2f%% %s\n",
+			metric->tag, metric->baseline.mean,
+			stats_ci95(&metric->baseline), metric->current.mean,
+			stats_ci95(&metric->current), delta, status);
+	}
+
+	return regressions;
+}
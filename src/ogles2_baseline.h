@@ -0,0 +1,30 @@
+/* ogles2_baseline.h -- Comparison against stored results
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef OGLES2_BASELINE_H
+#define OGLES2_BASELINE_H
+
+#include "ogles2_results.h"
+
+int baseline_load(const char* filename);
+void baseline_free();
+void baseline_add_run(const char* case_name, const results_metric* metrics,
+	int count);
+int baseline_compare_case(const char* case_name, double tolerance);
+
+#endif // OGLES2_BASELINE_H
@@ -19,18 +19,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <limits.h>
 #include <math.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <time.h>
 #include <errno.h>
 #include <blts_reporting.h>
 
 #include "ogles2_helper.h"
+#include <GLES2/gl2ext.h>
+
+#ifndef GL_HALF_FLOAT_OES
+#define GL_HALF_FLOAT_OES 0x8D61
+#endif
 
 
 /* Window system-specific context functions */
 extern struct glesh_ws_context_functions glesh_wayland;
 extern struct glesh_ws_context_functions glesh_fbdev;
+extern struct glesh_ws_context_functions glesh_headless;
 
 /* Currently active window system */
 static struct glesh_ws_context_functions *ws = NULL;
@@ -49,6 +57,10 @@ void glesh_set_ws_context_type(enum glesh_ws_context_type type)
 			ws = &glesh_fbdev;
 			name = "fbdev";
 			break;
+		case GLESH_WS_CONTEXT_HEADLESS:
+			ws = &glesh_headless;
+			name = "surfaceless";
+			break;
 		default:
 			ws = NULL;
 			break;
@@ -60,6 +72,86 @@ void glesh_set_ws_context_type(enum glesh_ws_context_type type)
 	}
 }
 
+/* For glesh_swap_buffers() */
+int glesh_ws_before_swap(glesh_context* context)
+{
+	if(ws && ws->before_swap)
+	{
+		return ws->before_swap(context);
+	}
+
+	return 1;
+}
+
+#ifdef EGL_KHR_swap_buffers_with_damage
+static PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_buffers_with_damage;
+#endif
+
+/* For glesh_swap_buffers_with_damage(), which times the swap. The damage
+ * is passed on if glesh_swap_with_damage_init() found the extension. */
+EGLBoolean glesh_ws_swap(glesh_context* context, const EGLint* rects,
+	EGLint n_rects)
+{
+#ifdef EGL_KHR_swap_buffers_with_damage
+	if(rects && swap_buffers_with_damage)
+	{
+		return swap_buffers_with_damage(context->egl_display,
+			context->egl_surface, (EGLint*)rects, n_rects);
+	}
+#else
+	UNUSED_PARAM(rects);
+	UNUSED_PARAM(n_rects);
+#endif
+
+	return eglSwapBuffers(context->egl_display, context->egl_surface);
+}
+
+/* EGL_EXT_buffer_age. 0 if the contents of the back buffer are unknown
+ * or the extension is not supported. */
+int glesh_buffer_age(glesh_context* context)
+{
+	EGLint age = 0;
+
+#ifdef EGL_EXT_buffer_age
+	if(!eglQuerySurface(context->egl_display, context->egl_surface,
+		EGL_BUFFER_AGE_EXT, &age))
+	{
+		age = 0;
+	}
+#else
+	UNUSED_PARAM(context);
+#endif
+
+	return age;
+}
+
+/* Returns 1 if glesh_swap_buffers_with_damage() passes the damage on to
+ * EGL, 0 if it falls back to eglSwapBuffers() */
+int glesh_swap_with_damage_init(glesh_context* context)
+{
+#ifdef EGL_KHR_swap_buffers_with_damage
+	swap_buffers_with_damage = NULL;
+
+	if(glesh_egl_extension_supported(context,
+		"EGL_KHR_swap_buffers_with_damage"))
+	{
+		swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+			eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+	}
+	else if(glesh_egl_extension_supported(context,
+		"EGL_EXT_swap_buffers_with_damage"))
+	{
+		swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+			eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+	}
+
+	return swap_buffers_with_damage != NULL;
+#else
+	UNUSED_PARAM(context);
+	return 0;
+#endif
+}
+
 
 static const EGLint default_config_attr[] =
 {
@@ -77,6 +169,22 @@ unsigned short RGBA8888toRGB565(unsigned int val)
 
 static double time_step;
 
+/* Frame time budgets (in seconds) counted by glesh_execute_main_loop */
+static double frame_budgets[GLESH_MAX_FRAME_BUDGETS] = { 0.0166, 0.0333 };
+static int num_frame_budgets = 2;
+
+/* Optional structured output of the reported results */
+static const struct glesh_result_sink* result_sink = NULL;
+
+/* Warm-up done by glesh_execute_main_loop before measuring */
+static int warmup_frames = 0;
+static double warmup_time = 0.0;
+static int warmup_steady_state = 0;
+
+/* eglSwapInterval() after context creation, -1 to keep the default */
+static int swap_interval = -1;
+
+
 static int generate_cos_sin_tables(glesh_context* context)
 {
 	float angle;
@@ -143,6 +251,41 @@ const char* glesh_egl_error_to_string(EGLint err)
 	}
 }
 
+static int extension_in_list(const char* extensions, const char* name)
+{
+	int len = strlen(name);
+	int n;
+
+	if(!extensions)
+	{
+		return 0;
+	}
+
+	while(*extensions)
+	{
+		n = strcspn(extensions, " ");
+		if(n == len && !strncmp(extensions, name, n))
+		{
+			return 1;
+		}
+		extensions += n;
+		extensions += strspn(extensions, " ");
+	}
+
+	return 0;
+}
+
+int glesh_gl_extension_supported(const char* name)
+{
+	return extension_in_list((const char*)glGetString(GL_EXTENSIONS), name);
+}
+
+int glesh_egl_extension_supported(glesh_context* context, const char* name)
+{
+	return extension_in_list(eglQueryString(context->egl_display,
+		EGL_EXTENSIONS), name);
+}
+
 void glesh_report_eglerror(const char* location)
 {
 	EGLint err = eglGetError();
@@ -197,7 +340,8 @@ int glesh_load_shader(GLenum type, const char *source)
 	return shader;
 }
 
-int glesh_load_program(const char *vertex_shader_src,
+/* Always compiles and links from source, see glesh_load_program() */
+int glesh_compile_program(const char *vertex_shader_src,
 		const char *fragment_shader_src)
 {
 	GLuint vertex_shader;
@@ -284,6 +428,11 @@ int glesh_create_context(glesh_context* context,
 	int t;
 
 	memset(context, 0, sizeof(glesh_context));
+	glesh_pool_init(&context->textures, sizeof(glesh_texture));
+	glesh_pool_init(&context->objects, sizeof(glesh_object));
+	glesh_arena_init(&context->arena, GLESH_ARENA_BLOCK_SIZE);
+	glesh_reset_bitmap_load_time();
+	glesh_reset_program_timing();
 
 	generate_cos_sin_tables(context);
 
@@ -298,7 +447,14 @@ int glesh_create_context(glesh_context* context,
 		return 0;
 	}
 
-	context->egl_display = eglGetDisplay(context->egl_native_display);
+	if (ws->get_display)
+	{
+		context->egl_display = ws->get_display(context);
+	}
+	else
+	{
+		context->egl_display = eglGetDisplay(context->egl_native_display);
+	}
 	if(context->egl_display == EGL_NO_DISPLAY)
 	{
 		glesh_report_eglerror("eglGetDisplay");
@@ -324,7 +480,7 @@ int glesh_create_context(glesh_context* context,
 	}
 
 	if (!attribList) {
-	    attribList = default_config_attr;
+	    attribList = ws->config_attr ? ws->config_attr : default_config_attr;
 	}
 
 	if(!eglChooseConfig(context->egl_display, attribList,
@@ -338,14 +494,23 @@ int glesh_create_context(glesh_context* context,
 
 	for(t = 0; t  < num_configs; t++)
 	{
-		context->egl_surface = eglCreateWindowSurface(context->egl_display,
-			configs[t], context->egl_native_window, NULL);
+		if (ws->create_surface)
+		{
+			context->egl_surface = ws->create_surface(context, configs[t]);
+		}
+		else
+		{
+			context->egl_surface = eglCreateWindowSurface(
+				context->egl_display, configs[t],
+				context->egl_native_window, NULL);
+		}
 		if(context->egl_surface != EGL_NO_SURFACE)
 		{
 			context->egl_context = eglCreateContext(context->egl_display,
 				configs[t], EGL_NO_CONTEXT, contextAttribs);
 			if(context->egl_context != EGL_NO_CONTEXT)
 			{
+				context->egl_config = configs[t];
 				break;
 			}
 			else
@@ -371,6 +536,14 @@ int glesh_create_context(glesh_context* context,
 		return 0;
 	}
 
+	if(swap_interval >= 0 &&
+		!eglSwapInterval(context->egl_display, swap_interval))
+	{
+		glesh_report_eglerror("eglSwapInterval");
+		glesh_destroy_context(context);
+		return 0;
+	}
+
 	if(!eglQuerySurface(context->egl_display, context->egl_surface, EGL_WIDTH,
 		&context->width))
 	{
@@ -387,8 +560,6 @@ int glesh_create_context(glesh_context* context,
 		return 0;
 	}
 
-	glGenTextures(GLESH_MAX_TEXTURES, context->texture_pool);
-
 	BLTS_DEBUG("Surface: %d x %d x %d\n",
 		context->width, context->height, context->depth);
 
@@ -399,12 +570,21 @@ int glesh_destroy_context(glesh_context* context)
 {
 	unsigned int t;
 
-	for(t = 0; t < context->num_objects; t++)
+	for(t = 0; t < context->objects.count; t++)
 	{
-		glesh_destroy_object(&context->objects[t]);
+		glesh_destroy_object(glesh_pool_get(&context->objects, t));
 	}
+	glesh_pool_destroy(&context->objects);
+	glesh_pool_destroy(&context->textures);
+	free(context->texture_buckets);
+	glesh_arena_destroy(&context->arena);
+	glesh_staging_destroy(&context->staging);
 
-	glDeleteTextures(GLESH_MAX_TEXTURES, context->texture_pool);
+	if(context->texture_pool)
+	{
+		glDeleteTextures(context->texture_pool_size, context->texture_pool);
+		free(context->texture_pool);
+	}
 
 	if(context->egl_display)
 	{
@@ -434,9 +614,95 @@ int glesh_destroy_context(glesh_context* context)
 	return 1;
 }
 
+static const EGLint shared_context_attribs[] =
+{
+	EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE
+};
+
+static const EGLint shared_surface_attribs[] =
+{
+	EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE
+};
+
+/* Shared contexts need no surface with EGL_KHR_surfaceless_context,
+ * otherwise a pbuffer of the context config */
+int glesh_shared_context_supported(glesh_context* context)
+{
+	EGLint surface_type = 0;
+
+	if(glesh_egl_extension_supported(context, "EGL_KHR_surfaceless_context"))
+	{
+		return 1;
+	}
+	eglGetConfigAttrib(context->egl_display, context->egl_config,
+		EGL_SURFACE_TYPE, &surface_type);
+
+	return !!(surface_type & EGL_PBUFFER_BIT);
+}
+
+/* A context sharing objects with the render context, for another thread.
+ * The surface is EGL_NO_SURFACE when the context can be surfaceless. */
+int glesh_create_shared_context(glesh_context* context,
+	EGLContext* egl_context, EGLSurface* egl_surface)
+{
+	*egl_surface = EGL_NO_SURFACE;
+	*egl_context = eglCreateContext(context->egl_display, context->egl_config,
+		context->egl_context, shared_context_attribs);
+	if(*egl_context == EGL_NO_CONTEXT)
+	{
+		glesh_report_eglerror("eglCreateContext");
+		return 0;
+	}
+
+	if(!glesh_egl_extension_supported(context, "EGL_KHR_surfaceless_context"))
+	{
+		*egl_surface = eglCreatePbufferSurface(context->egl_display,
+			context->egl_config, shared_surface_attribs);
+		if(*egl_surface == EGL_NO_SURFACE)
+		{
+			glesh_report_eglerror("eglCreatePbufferSurface");
+			eglDestroyContext(context->egl_display, *egl_context);
+			*egl_context = EGL_NO_CONTEXT;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Must not be current in any thread */
+void glesh_destroy_shared_context(glesh_context* context,
+	EGLContext egl_context, EGLSurface egl_surface)
+{
+	if(egl_surface != EGL_NO_SURFACE)
+	{
+		eglDestroySurface(context->egl_display, egl_surface);
+	}
+	if(egl_context != EGL_NO_CONTEXT)
+	{
+		eglDestroyContext(context->egl_display, egl_context);
+	}
+}
+
 GLuint glesh_get_texture_from_pool(glesh_context* context)
 {
-	if(context->next_texture >= GLESH_MAX_TEXTURES) return 0;
+	GLuint* pool;
+
+	if(context->next_texture == context->texture_pool_size)
+	{
+		pool = realloc(context->texture_pool, sizeof(GLuint) *
+			(context->texture_pool_size + GLESH_TEXTURE_NAME_BATCH));
+		if(!pool)
+		{
+			BLTS_LOGGED_PERROR("realloc");
+			return 0;
+		}
+		glGenTextures(GLESH_TEXTURE_NAME_BATCH,
+			&pool[context->texture_pool_size]);
+		context->texture_pool = pool;
+		context->texture_pool_size += GLESH_TEXTURE_NAME_BATCH;
+	}
+
 	return context->texture_pool[context->next_texture++];
 }
 
@@ -444,9 +710,10 @@ GLuint glesh_context_triangle_count(glesh_context* context)
 {
 	unsigned int t;
 	GLuint triangle_count = 0;
-	for(t = 0; t < context->num_objects; t++)
+	for(t = 0; t < context->objects.count; t++)
 	{
-		triangle_count += context->objects[t].num_triangles;
+		triangle_count += ((glesh_object*)glesh_pool_get(&context->objects,
+			t))->num_triangles;
 	}
 
 	return triangle_count;
@@ -457,45 +724,114 @@ double glesh_time_step()
 	return time_step;
 }
 
-int glesh_execute_main_loop(glesh_context* context,
-		DRAW_FUNCTION,
-		void* user_ptr,
-		double runtime)
+/* Monotonic time in seconds. timing_elapsed() is only valid within
+ * glesh_execute_main_loop(), this works anywhere and in any thread. */
+double glesh_time(void)
 {
-	int running = 1;
-	struct rusage usage_start;
-	struct rusage usage_end;
-	double used_time = 0.0;
-	FILE* fp;
-	long unsigned int start_user_load, start_nice_load, start_sys_load, start_idle;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+void glesh_set_frame_budgets(const double* budgets_ms, int count)
+{
+	int t;
+
+	num_frame_budgets = GLESH_MIN(count, GLESH_MAX_FRAME_BUDGETS);
+	for(t = 0; t < num_frame_budgets; t++)
+	{
+		frame_budgets[t] = budgets_ms[t] / 1000.0;
+	}
+}
+
+void glesh_set_swap_interval(int interval)
+{
+	swap_interval = interval;
+}
+
+void glesh_set_result_sink(const struct glesh_result_sink* sink)
+{
+	result_sink = sink;
+}
+
+/* Reports to the BLTS log and the result sink, if any. Rates, units
+ * ending in "/s", are better when higher, everything else when lower. */
+int glesh_report_result(const char* tag, double value, const char* unit)
+{
+	size_t len = unit ? strlen(unit) : 0;
+
+	return glesh_report_directed_result(tag, value, unit,
+		len >= 2 && !strcmp(unit + len - 2, "/s") ?
+		GLESH_HIGHER_IS_BETTER : GLESH_LOWER_IS_BETTER);
+}
+
+/* For metrics whose unit does not tell, e.g. counts of frames shown */
+int glesh_report_directed_result(const char* tag, double value,
+	const char* unit, enum glesh_result_direction direction)
+{
+	if(result_sink && result_sink->result)
+	{
+		result_sink->result(tag, value, unit, direction);
+	}
+
+	return blts_report_extended_result((char*)tag, value, (char*)unit, 0);
+}
+
+void glesh_set_warmup(int frames, double seconds, int wait_steady_state)
+{
+	warmup_frames = frames;
+	warmup_time = seconds;
+	warmup_steady_state = wait_steady_state;
+}
+
+/* Renders frames until the configured warm-up frame count and time have
+ * passed and, if requested, frame times have settled. Nothing rendered
+ * here is included in the measurement. */
+static int warm_up(glesh_context* context, DRAW_FUNCTION, void* user_ptr)
+{
+	double window[GLESH_STEADY_STATE_WINDOW];
+	unsigned int frames = 0;
+	int settled = !warmup_steady_state;
 	double prev_time = 0;
-	double cur_time;
+	double cur_time = 0;
+	double mean, var;
+	int t;
 
-	fp = fopen("/proc/stat", "r");
-	if(fp)
+	context->perf_data.warmup_frames = 0;
+	context->perf_data.warmup_time = 0.0;
+	context->perf_data.steady_state = 0;
+
+	if(!warmup_frames && warmup_time <= 0.0 && !warmup_steady_state)
 	{
-		char tmp[128];
-		if(fscanf(fp, "%s %lu %lu %lu %lu", tmp, &start_user_load,
-			&start_nice_load, &start_sys_load, &start_idle) != 5)
-		{
-			BLTS_ERROR("Failed to read /proc/stat\n");
-		}
-		fclose(fp);
+		return 1;
 	}
 
-	context->perf_data.frames_rendered = 0;
-	getrusage(RUSAGE_SELF,&usage_start);
 	timing_start();
 
-	while(running)
+	while(1)
 	{
 		cur_time = timing_elapsed();
+		if(frames >= (unsigned int)warmup_frames && cur_time >= warmup_time)
+		{
+			if(settled)
+			{
+				break;
+			}
+			if(cur_time >= GLESH_MAX_WARMUP_TIME)
+			{
+				BLTS_DEBUG("Frame times did not settle in %.1lf s\n",
+					GLESH_MAX_WARMUP_TIME);
+				break;
+			}
+		}
+
 		time_step = cur_time - prev_time;
 		prev_time = cur_time;
 		if(!drawFunc(context, user_ptr))
 		{
-			BLTS_ERROR("Failed to draw frame %d\n",
-				context->perf_data.frames_rendered);
+			BLTS_ERROR("Failed to draw warm-up frame %d\n", frames);
+			timing_stop();
 			return 0;
 		}
 
@@ -503,270 +839,1177 @@ int glesh_execute_main_loop(glesh_context* context,
 		{
 			ws->main_loop_step(context);
 		}
-		context->perf_data.frames_rendered++;
 
-		if(runtime == 0.0f)
-		{
-			// XXX: set running = 0; when button pressed
-		}
-		else
+		window[frames % GLESH_STEADY_STATE_WINDOW] = timing_elapsed() - cur_time;
+		frames++;
+
+		if(!settled && frames >= GLESH_STEADY_STATE_WINDOW)
 		{
-			if(cur_time >= runtime)
+			mean = 0.0;
+			var = 0.0;
+			for(t = 0; t < GLESH_STEADY_STATE_WINDOW; t++)
 			{
-				running = 0;
+				mean += window[t];
+			}
+			mean /= GLESH_STEADY_STATE_WINDOW;
+			for(t = 0; t < GLESH_STEADY_STATE_WINDOW; t++)
+			{
+				var += (window[t] - mean) * (window[t] - mean);
 			}
+			var /= GLESH_STEADY_STATE_WINDOW;
+			settled = sqrt(var) <= GLESH_STEADY_STATE_MAX_CV * mean;
 		}
 	}
 
 	timing_stop();
 
-	context->perf_data.total_time_elapsed = timing_elapsed();
+	context->perf_data.warmup_frames = frames;
+	context->perf_data.warmup_time = cur_time;
+	context->perf_data.steady_state = warmup_steady_state && settled;
 
-	getrusage(RUSAGE_SELF,&usage_end);
-	used_time = usage_end.ru_utime.tv_sec;
-	used_time += usage_end.ru_utime.tv_usec * 1E-6;
-	used_time += usage_end.ru_stime.tv_sec;
-	used_time += usage_end.ru_stime.tv_usec * 1E-6;
-	used_time -= usage_start.ru_utime.tv_sec;
-	used_time -= usage_start.ru_utime.tv_usec * 1E-6;
-	used_time -= usage_start.ru_stime.tv_sec;
-	used_time -= usage_start.ru_stime.tv_usec * 1E-6;
+	BLTS_DEBUG("Warm-up frames: %u\n", frames);
+	BLTS_DEBUG("Warm-up time: %lf\n", cur_time);
+	if(warmup_steady_state)
+	{
+		BLTS_DEBUG("Steady state reached: %s\n", settled ? "yes" : "no");
+	}
 
-	context->perf_data.total_load = 0.0f;
+	return 1;
+}
 
-	fp = fopen("/proc/stat", "r");
-	if(fp)
-	{
-		char tmp[128];
-		long unsigned int user_load, nice_load, sys_load, idle;
-		if(fscanf(fp, "%s %lu %lu %lu %lu", tmp, &user_load, &nice_load,
-			 &sys_load, &idle) == 5)
-		{
-			user_load -= start_user_load;
-			nice_load -= start_nice_load;
-			sys_load -= start_sys_load;
-			idle -= start_idle;
-			context->perf_data.total_load = (double)(user_load + nice_load +
-				sys_load);
-			context->perf_data.total_load =  context->perf_data.total_load *
-				100.0f / (context->perf_data.total_load + idle);
-		}
-		else
-		{
-			BLTS_ERROR("Failed to read /proc/stat\n");
-		}
+static void frame_stats_init(glesh_frame_stats* stats)
+{
+	int t;
 
-		fclose(fp);
+	memset(stats, 0, sizeof(glesh_frame_stats));
+	stats->num_budgets = num_frame_budgets;
+	for(t = 0; t < num_frame_budgets; t++)
+	{
+		stats->budgets[t] = frame_budgets[t];
 	}
+}
 
-	context->perf_data.fps = 1.0f / (context->perf_data.total_time_elapsed /
-		context->perf_data.frames_rendered);
-	context->perf_data.cpu_usage = 100.0 * used_time /
-		context->perf_data.total_time_elapsed;
+/* Called once per frame; must not allocate or log */
+void glesh_frame_stats_add(glesh_frame_stats* stats, double frame_time)
+{
+	unsigned int bin = (unsigned int)(frame_time / GLESH_FRAME_HIST_BIN_WIDTH);
+	int t;
 
-	BLTS_DEBUG("Frames rendered: %d\n", context->perf_data.frames_rendered);
-	BLTS_DEBUG("Total render time: %lf\n", context->perf_data.total_time_elapsed);
-	BLTS_DEBUG("Frames per second: %lf\n", context->perf_data.fps);
-	BLTS_DEBUG("Polygons in scene: %d\n", glesh_context_triangle_count(context));
-	BLTS_DEBUG("CPU usage (this process): %lf %%\n", context->perf_data.cpu_usage);
-	if(context->perf_data.total_load > 0.0f)
+	if(bin < GLESH_FRAME_HIST_BINS)
 	{
-		BLTS_DEBUG("CPU usage (all processes, all CPUs): %lf %%\n",
-			context->perf_data.total_load);
+		stats->bins[bin]++;
 	}
 	else
 	{
-		BLTS_DEBUG("CPU usage (all processes, all CPUs): N/A\n");
+		stats->overflow++;
 	}
 
-	blts_report_extended_result("framerate", context->perf_data.fps, "1/s", 0);
-	blts_report_extended_result("cpu_use_test_process", context->perf_data.cpu_usage, "%", 0);
-	blts_report_extended_result("cpu_use_all_processes", context->perf_data.total_load, "%", 0);
-
-	return 1;
-}
-
-glesh_object* glesh_add_object(glesh_context* context, glesh_object* object)
-{
-	if(context->num_objects >= GLESH_MAX_OBJECTS)
+	if(!stats->count || frame_time < stats->min)
 	{
-		BLTS_ERROR("glesh_add_object: Maximum number of objects reached\n");
-		return NULL;
+		stats->min = frame_time;
+	}
+	if(frame_time > stats->max)
+	{
+		stats->max = frame_time;
+	}
+
+	for(t = 0; t < stats->num_budgets; t++)
+	{
+		if(frame_time > stats->budgets[t])
+		{
+			stats->over_budget[t]++;
+		}
+	}
+
+	stats->count++;
+}
+
+/* Returns the frame time (in seconds) below which 'percentile' % of frames
+ * fall. Resolution is one histogram bin; frames beyond the histogram range
+ * are reported as the longest frame seen. */
+double glesh_frame_stats_percentile(const glesh_frame_stats* stats,
+	double percentile)
+{
+	unsigned int rank;
+	unsigned int sum = 0;
+	unsigned int t;
+
+	if(!stats->count)
+	{
+		return 0.0;
+	}
+
+	rank = (unsigned int)ceil(percentile / 100.0 * stats->count);
+	if(rank < 1)
+	{
+		rank = 1;
+	}
+
+	for(t = 0; t < GLESH_FRAME_HIST_BINS; t++)
+	{
+		sum += stats->bins[t];
+		if(sum >= rank)
+		{
+			return GLESH_MIN((t + 1) * GLESH_FRAME_HIST_BIN_WIDTH, stats->max);
+		}
+	}
+
+	return stats->max;
+}
+
+static void frame_stats_report(const glesh_frame_stats* stats)
+{
+	static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+	static char* tags[] = { "frame_time_p50", "frame_time_p90",
+		"frame_time_p99", "frame_time_p99_9" };
+	char tag[64];
+	double val;
+	unsigned int t;
+
+	for(t = 0; t < ARRAY_SIZE(percentiles); t++)
+	{
+		val = glesh_frame_stats_percentile(stats, percentiles[t]) * 1000.0;
+		BLTS_DEBUG("Frame time %.1fth percentile: %lf ms\n", percentiles[t],
+			val);
+		glesh_report_result(tags[t], val, "ms");
+	}
+
+	BLTS_DEBUG("Frame time max: %lf ms\n", stats->max * 1000.0);
+	glesh_report_result("frame_time_max", stats->max * 1000.0, "ms");
+
+	for(t = 0; t < (unsigned int)stats->num_budgets; t++)
+	{
+		BLTS_DEBUG("Frames over %.1f ms: %u\n", stats->budgets[t] * 1000.0,
+			stats->over_budget[t]);
+		sprintf(tag, "frames_over_%.1fms", stats->budgets[t] * 1000.0);
+		glesh_report_result(tag, stats->over_budget[t], "frames");
+	}
+}
+
+int glesh_execute_main_loop(glesh_context* context,
+		DRAW_FUNCTION,
+		void* user_ptr,
+		double runtime)
+{
+	int running = 1;
+	struct rusage usage_start;
+	struct rusage usage_end;
+	double used_time = 0.0;
+	FILE* fp;
+	const glesh_program_timing* program_timing;
+	long unsigned int start_user_load, start_nice_load, start_sys_load, start_idle;
+	double prev_time = 0;
+	double cur_time;
+	double frame_end;
+
+	if(!warm_up(context, drawFunc, user_ptr))
+	{
+		return 0;
+	}
+
+	fp = fopen("/proc/stat", "r");
+	if(fp)
+	{
+		char tmp[128];
+		if(fscanf(fp, "%s %lu %lu %lu %lu", tmp, &start_user_load,
+			&start_nice_load, &start_sys_load, &start_idle) != 5)
+		{
+			BLTS_ERROR("Failed to read /proc/stat\n");
+		}
+		fclose(fp);
+	}
+
+	if(!glesh_frame_timing_begin(context))
+	{
+		return 0;
+	}
+
+	if(ws && ws->measure_begin)
+	{
+		ws->measure_begin(context);
+	}
+
+	context->perf_data.frames_rendered = 0;
+	frame_stats_init(&context->perf_data.frame_stats);
+	getrusage(RUSAGE_SELF,&usage_start);
+	timing_start();
+
+	while(running)
+	{
+		cur_time = timing_elapsed();
+		time_step = cur_time - prev_time;
+		prev_time = cur_time;
+		glesh_frame_timing_frame_begin();
+		if(!drawFunc(context, user_ptr))
+		{
+			BLTS_ERROR("Failed to draw frame %d\n",
+				context->perf_data.frames_rendered);
+			glesh_frame_timing_end();
+			if(ws && ws->measure_end)
+			{
+				ws->measure_end(context);
+			}
+			return 0;
+		}
+		glesh_frame_timing_frame_end();
+
+		if (ws)
+		{
+			ws->main_loop_step(context);
+		}
+		context->perf_data.frames_rendered++;
+
+		frame_end = timing_elapsed();
+		glesh_frame_stats_add(&context->perf_data.frame_stats,
+			frame_end - cur_time);
+
+		if(runtime == 0.0f)
+		{
+			// XXX: set running = 0; when button pressed
+		}
+		else
+		{
+			if(cur_time >= runtime)
+			{
+				running = 0;
+			}
+		}
+	}
+
+	timing_stop();
+
+	context->perf_data.total_time_elapsed = timing_elapsed();
+
+	getrusage(RUSAGE_SELF,&usage_end);
+	used_time = usage_end.ru_utime.tv_sec;
+	used_time += usage_end.ru_utime.tv_usec * 1E-6;
+	used_time += usage_end.ru_stime.tv_sec;
+	used_time += usage_end.ru_stime.tv_usec * 1E-6;
+	used_time -= usage_start.ru_utime.tv_sec;
+	used_time -= usage_start.ru_utime.tv_usec * 1E-6;
+	used_time -= usage_start.ru_stime.tv_sec;
+	used_time -= usage_start.ru_stime.tv_usec * 1E-6;
+
+	context->perf_data.total_load = 0.0f;
+
+	fp = fopen("/proc/stat", "r");
+	if(fp)
+	{
+		char tmp[128];
+		long unsigned int user_load, nice_load, sys_load, idle;
+		if(fscanf(fp, "%s %lu %lu %lu %lu", tmp, &user_load, &nice_load,
+			 &sys_load, &idle) == 5)
+		{
+			user_load -= start_user_load;
+			nice_load -= start_nice_load;
+			sys_load -= start_sys_load;
+			idle -= start_idle;
+			context->perf_data.total_load = (double)(user_load + nice_load +
+				sys_load);
+			context->perf_data.total_load =  context->perf_data.total_load *
+				100.0f / (context->perf_data.total_load + idle);
+		}
+		else
+		{
+			BLTS_ERROR("Failed to read /proc/stat\n");
+		}
+
+		fclose(fp);
+	}
+
+	context->perf_data.fps = 1.0f / (context->perf_data.total_time_elapsed /
+		context->perf_data.frames_rendered);
+	context->perf_data.cpu_usage = 100.0 * used_time /
+		context->perf_data.total_time_elapsed;
+
+	BLTS_DEBUG("Frames rendered: %d\n", context->perf_data.frames_rendered);
+	BLTS_DEBUG("Total render time: %lf\n", context->perf_data.total_time_elapsed);
+	BLTS_DEBUG("Frames per second: %lf\n", context->perf_data.fps);
+	BLTS_DEBUG("Polygons in scene: %d\n", glesh_context_triangle_count(context));
+	BLTS_DEBUG("CPU usage (this process): %lf %%\n", context->perf_data.cpu_usage);
+	if(context->perf_data.total_load > 0.0f)
+	{
+		BLTS_DEBUG("CPU usage (all processes, all CPUs): %lf %%\n",
+			context->perf_data.total_load);
+	}
+	else
+	{
+		BLTS_DEBUG("CPU usage (all processes, all CPUs): N/A\n");
+	}
+
+	glesh_report_result("framerate", context->perf_data.fps, "1/s");
+	glesh_report_result("cpu_use_test_process", context->perf_data.cpu_usage, "%");
+	glesh_report_result("cpu_use_all_processes", context->perf_data.total_load, "%");
+
+	if(context->perf_data.warmup_frames)
+	{
+		glesh_report_result("warmup_time",
+			context->perf_data.warmup_time, "s");
+		glesh_report_result("warmup_frames",
+			context->perf_data.warmup_frames, "frames");
+	}
+
+	glesh_report_bitmap_load_time();
+
+	program_timing = glesh_get_program_timing();
+	if(program_timing->compiled)
+	{
+		BLTS_DEBUG("Programs compiled: %d\n", program_timing->compiled);
+		glesh_report_result("program_compile_time",
+			program_timing->compile_time * 1000.0, "ms");
+	}
+	if(program_timing->cached)
+	{
+		BLTS_DEBUG("Programs loaded from cache: %d\n",
+			program_timing->cached);
+		glesh_report_result("program_cache_load_time",
+			program_timing->cache_time * 1000.0, "ms");
+	}
+
+	BLTS_DEBUG("Setup memory: %zu bytes in %u allocations, %zu reserved\n",
+		context->arena.used, context->arena.allocations,
+		context->arena.reserved);
+	BLTS_DEBUG("Staging memory: %zu bytes, %u uses, %u allocations\n",
+		context->staging.size, context->staging.uses,
+		context->staging.allocations);
+	glesh_report_result("setup_memory", context->arena.used / 1024.0,
+		"KiB");
+	glesh_report_result("staging_memory", context->staging.size / 1024.0,
+		"KiB");
+	glesh_report_result("peak_rss", usage_end.ru_maxrss, "KiB");
+
+	frame_stats_report(&context->perf_data.frame_stats);
+	glesh_frame_timing_end();
+
+	if(ws && ws->measure_end)
+	{
+		ws->measure_end(context);
+	}
+
+	if(result_sink && result_sink->main_loop_done)
+	{
+		result_sink->main_loop_done(context);
+	}
+
+	return 1;
+}
+
+void glesh_pool_init(glesh_pool* pool, size_t element_size)
+{
+	memset(pool, 0, sizeof(glesh_pool));
+	pool->element_size = element_size;
+}
+
+/* Returns a zeroed element at index count - 1 */
+void* glesh_pool_add(glesh_pool* pool)
+{
+	void** chunks;
+	void* element;
+
+	if(pool->count == pool->num_chunks * GLESH_POOL_CHUNK_SIZE)
+	{
+		chunks = realloc(pool->chunks, sizeof(void*) *
+			(pool->num_chunks + 1));
+		if(!chunks)
+		{
+			BLTS_LOGGED_PERROR("realloc");
+			return NULL;
+		}
+		pool->chunks = chunks;
+
+		chunks[pool->num_chunks] = malloc(pool->element_size *
+			GLESH_POOL_CHUNK_SIZE);
+		if(!chunks[pool->num_chunks])
+		{
+			BLTS_LOGGED_PERROR("malloc");
+			return NULL;
+		}
+		pool->num_chunks++;
+	}
+
+	element = glesh_pool_get(pool, pool->count++);
+	memset(element, 0, pool->element_size);
+
+	return element;
+}
+
+void* glesh_pool_get(const glesh_pool* pool, GLuint index)
+{
+	if(index >= pool->count)
+	{
+		return NULL;
+	}
+
+	return (char*)pool->chunks[index / GLESH_POOL_CHUNK_SIZE] +
+		(index % GLESH_POOL_CHUNK_SIZE) * pool->element_size;
+}
+
+void glesh_pool_destroy(glesh_pool* pool)
+{
+	GLuint t;
+
+	for(t = 0; t < pool->num_chunks; t++)
+	{
+		free(pool->chunks[t]);
+	}
+	free(pool->chunks);
+
+	glesh_pool_init(pool, pool->element_size);
+}
+
+/* The returned pointer stays valid until the context is destroyed */
+glesh_object* glesh_add_object(glesh_context* context, glesh_object* object)
+{
+	glesh_object* added = glesh_pool_add(&context->objects);
+
+	if(!added)
+	{
+		BLTS_ERROR("glesh_add_object: Out of memory\n");
+		return NULL;
+	}
+
+	*added = *object;
+
+	return added;
+}
+
+/* In the order added, NULL past the last object */
+glesh_object* glesh_get_object(glesh_context* context, GLuint index)
+{
+	return glesh_pool_get(&context->objects, index);
+}
+
+/* Arrays of objects initialised with a context come from its arena, so
+ * that generating a scene does not fragment the heap */
+void* glesh_object_alloc(glesh_object* object, size_t size)
+{
+	void* ptr;
+
+	if(object->arena)
+	{
+		return glesh_arena_alloc(object->arena, size);
+	}
+
+	ptr = malloc(size);
+	if(!ptr)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+	}
+
+	return ptr;
+}
+
+void glesh_object_free(glesh_object* object, void* ptr)
+{
+	/* Arena memory goes away with the context */
+	if(object->arena && glesh_arena_owns(object->arena, ptr))
+	{
+		return;
+	}
+
+	free(ptr);
+}
+
+/* FNV-1a */
+static unsigned int texture_name_hash(const char* name)
+{
+	unsigned int hash = 2166136261u;
+
+	while(*name)
+	{
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static int grow_texture_buckets(glesh_context* context)
+{
+	unsigned int num_buckets = GLESH_MAX(GLESH_TEXTURE_BUCKETS,
+		context->num_texture_buckets * 2);
+	glesh_texture** buckets;
+	glesh_texture* tex;
+	glesh_texture* next;
+	unsigned int bucket;
+	unsigned int t;
+
+	buckets = calloc(num_buckets, sizeof(glesh_texture*));
+	if(!buckets)
+	{
+		BLTS_LOGGED_PERROR("calloc");
+		return 0;
+	}
+
+	for(t = 0; t < context->num_texture_buckets; t++)
+	{
+		for(tex = context->texture_buckets[t]; tex; tex = next)
+		{
+			next = tex->next;
+			/* Bucket counts are powers of two */
+			bucket = texture_name_hash(tex->name) & (num_buckets - 1);
+			tex->next = buckets[bucket];
+			buckets[bucket] = tex;
+		}
+	}
+
+	free(context->texture_buckets);
+	context->texture_buckets = buckets;
+	context->num_texture_buckets = num_buckets;
+
+	return 1;
+}
+
+static glesh_texture** texture_bucket(glesh_context* context,
+	const char* texture_name)
+{
+	return &context->texture_buckets[texture_name_hash(texture_name) &
+		(context->num_texture_buckets - 1)];
+}
+
+/* Exact match, the reference count is not changed */
+glesh_texture* glesh_texture_by_name(glesh_context* context,
+	const char* texture_name)
+{
+	glesh_texture* tex;
+
+	if(!texture_name || !context->num_named_textures)
+	{
+		return NULL;
+	}
+
+	for(tex = *texture_bucket(context, texture_name); tex; tex = tex->next)
+	{
+		if(!strcmp(tex->name, texture_name))
+		{
+			return tex;
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns the texture with a new reference if it is already loaded */
+static glesh_texture* acquire_texture(glesh_context* context,
+	const char* texture_name)
+{
+	glesh_texture* tex = glesh_texture_by_name(context, texture_name);
+
+	if(tex)
+	{
+		tex->refs++;
+	}
+
+	return tex;
+}
+
+/* A released texture is reused with its GL name before the pool grows */
+static glesh_texture* add_texture(glesh_context* context,
+	const char* texture_name)
+{
+	glesh_texture** bucket;
+	glesh_texture* tex;
+	GLuint tex_id = 0;
+
+	if(texture_name && strlen(texture_name) >= GLESH_TEXTURE_NAME_MAX)
+	{
+		BLTS_ERROR("Texture name too long: %s\n", texture_name);
+		return NULL;
+	}
+
+	if(texture_name && context->num_named_textures + 1 >
+		context->num_texture_buckets * 3 / 4)
+	{
+		if(!grow_texture_buckets(context))
+		{
+			return NULL;
+		}
+	}
+
+	if(context->free_textures)
+	{
+		tex = context->free_textures;
+		context->free_textures = tex->next;
+		tex_id = tex->tex_id;
+		memset(tex, 0, sizeof(glesh_texture));
+	}
+	else
+	{
+		tex = glesh_pool_add(&context->textures);
+		if(!tex)
+		{
+			BLTS_ERROR("Out of memory for textures\n");
+			return NULL;
+		}
+	}
+
+	tex->tex_id = tex_id ? tex_id : glesh_get_texture_from_pool(context);
+	tex->refs = 1;
+
+	if(texture_name)
+	{
+		strcpy(tex->name, texture_name);
+		bucket = texture_bucket(context, texture_name);
+		tex->next = *bucket;
+		*bucket = tex;
+		context->num_named_textures++;
+	}
+
+	return tex;
+}
+
+/* Drops a reference taken by loading or generating the texture. The
+ * last one frees the texture storage and makes the name available for a
+ * new texture. */
+int glesh_release_texture(glesh_context* context, glesh_texture* tex)
+{
+	glesh_texture** prev;
+
+	if(!tex || tex->refs <= 0)
+	{
+		BLTS_ERROR("glesh_release_texture: Texture not in use\n");
+		return 0;
+	}
+
+	if(--tex->refs)
+	{
+		return 1;
 	}
 
-	context->objects[context->num_objects++] = *object;
+	if(tex->name[0])
+	{
+		for(prev = texture_bucket(context, tex->name); *prev;
+			prev = &(*prev)->next)
+		{
+			if(*prev == tex)
+			{
+				*prev = tex->next;
+				context->num_named_textures--;
+				break;
+			}
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, tex->tex_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 0, 0, 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, NULL);
 
-	return &context->objects[context->num_objects - 1];
+	tex->name[0] = 0;
+	tex->next = context->free_textures;
+	context->free_textures = tex;
+
+	return 1;
 }
 
-glesh_texture* glest_texture_by_name(glesh_context* context,
-	const char* texture_name)
+static glesh_texture* texture_from_texels(glesh_context* context,
+	const GLenum format, const char* texture_name, const void* texels,
+	int width, int height)
 {
-	unsigned int t;
-	for(t = 0; t < context->num_textures; t++)
+	glesh_texture* tex;
+
+	tex = add_texture(context, texture_name);
+	if(!tex)
 	{
-		if(strstr(context->textures[t].name, texture_name))
-		{
-			return &context->textures[t];
-		}
+		return NULL;
 	}
+	tex->width = width;
+	tex->height = height;
 
-	return NULL;
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture (GL_TEXTURE_2D, tex->tex_id);
+	if(format == GL_RGBA)
+	{
+		glTexImage2D ( GL_TEXTURE_2D, 0, format, width, height, 0, format,
+			GL_UNSIGNED_BYTE, texels );
+	}
+	else if(format == GL_RGB)
+	{
+		/* Rows of odd width are not 4-byte aligned */
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTexImage2D ( GL_TEXTURE_2D, 0, format, width, height, 0, format,
+			GL_UNSIGNED_SHORT_5_6_5, texels );
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+	glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+	glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+
+	return tex;
 }
 
 glesh_texture* glesh_bitmap_to_texture(glesh_context* context,
 	const GLenum format, const char* texture_name, unsigned char* data,
 	glesh_bitmap_header* header)
 {
-	int element_size;
-	unsigned char* buffer;
-	unsigned int* ptr2 = (unsigned int*)data;
-	int x, y;
+	unsigned short* buffer;
+	unsigned int* src = (unsigned int*)data;
+	int t;
 
-	glesh_texture* tex = glest_texture_by_name(context, texture_name);
+	glesh_texture* tex = acquire_texture(context, texture_name);
 	if(tex)
 	{
 		/* texture already exists, return it */
 		return tex;
 	}
 
-	if(context->num_textures >= GLESH_MAX_TEXTURES)
+	if(format == GL_RGBA)
+	{
+		/* Already in the right layout */
+		return texture_from_texels(context, format, texture_name, data,
+			header->biWidth, header->biHeight);
+	}
+	else if(format != GL_RGB)
 	{
-		BLTS_ERROR("glesh_bitmap_to_texture: Maximum number of textures reached\n");
+		BLTS_ERROR("Unsupported pixel format (%d).\n", format);
 		return NULL;
 	}
 
-	if(format == GL_RGBA)
+	buffer = glesh_staging_buffer(&context->staging,
+		sizeof(unsigned short) * header->biWidth * header->biHeight);
+	if(!buffer)
 	{
-		element_size = 4;
+		BLTS_ERROR("Error allocating buffer for texture.\n");
+		return NULL;
 	}
-	else if(format == GL_RGB)
+
+	for(t = 0; t < header->biWidth * header->biHeight; t++)
 	{
-		element_size = 2;
+		buffer[t] = RGBA8888toRGB565(src[t]);
 	}
-	else
+
+	return texture_from_texels(context, format, texture_name, buffer,
+		header->biWidth, header->biHeight);
+}
+
+glesh_texture* glesh_texture_from_bmp_file(glesh_context* context,
+	const GLenum format, const char* texture_name, const char* filename,
+	int scale_w, int scale_h)
+{
+	glesh_bitmap_header header;
+	glesh_texture* tex;
+	unsigned char* texels;
+
+	tex = acquire_texture(context, texture_name);
+	if(tex)
 	{
-		BLTS_ERROR("Unsupported pixel format (%d).\n", format);
+		/* texture already exists, skip loading the file */
+		return tex;
+	}
+
+	if(format != GL_RGBA && format != GL_RGB)
+	{
+		BLTS_ERROR("Unsupported pixel format\n");
 		return NULL;
 	}
 
-	buffer = (unsigned char*)malloc(header->biWidth * header->biHeight *
-		element_size);
-	if(!buffer)
+	/* Texels come out ready for upload, no second conversion pass */
+	texels = glesh_read_bitmap_texels(filename, &header, format, scale_w,
+		scale_h);
+	if(!texels)
+	{
+		BLTS_ERROR("Failed to read file %s\n", filename);
+		return NULL;
+	}
+
+	tex = texture_from_texels(context, format, texture_name, texels,
+		header.biWidth, header.biHeight);
+	free(texels);
+
+	return tex;
+}
+
+int glesh_atlas_init(glesh_context* context, glesh_atlas* atlas,
+	const GLenum format, int page_size)
+{
+	GLint max_size = 0;
+
+	memset(atlas, 0, sizeof(glesh_atlas));
+	atlas->staging = &context->staging;
+
+	if(format != GL_RGBA && format != GL_RGB)
+	{
+		BLTS_ERROR("Unsupported pixel format (%d).\n", format);
+		return 0;
+	}
+
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	atlas->page_size = 64;
+	while(atlas->page_size < page_size && atlas->page_size < max_size)
+	{
+		atlas->page_size <<= 1;
+	}
+	atlas->format = format;
+
+	BLTS_DEBUG("Texture atlas page size %d x %d\n", atlas->page_size,
+		atlas->page_size);
+
+	return 1;
+}
+
+void glesh_atlas_destroy(glesh_atlas* atlas)
+{
+	int t;
+
+	for(t = 0; t < atlas->num_pages; t++)
+	{
+		glDeleteTextures(1, &atlas->pages[t].tex_id);
+		free(atlas->pages[t].skyline);
+	}
+
+	for(t = 0; t < atlas->num_textures; t++)
+	{
+		free(atlas->textures[t]);
+	}
+
+	free(atlas->pages);
+	free(atlas->textures);
+	memset(atlas, 0, sizeof(glesh_atlas));
+}
+
+glesh_texture* glesh_atlas_texture_by_name(glesh_atlas* atlas,
+	const char* texture_name)
+{
+	int t;
+
+	if(!texture_name)
 	{
-		BLTS_ERROR("Error allocating buffer for texture.\n");
 		return NULL;
 	}
 
-	for(y = 0; y < header->biHeight; y++)
+	for(t = 0; t < atlas->num_textures; t++)
 	{
-		for(x = 0; x < header->biWidth; x++)
+		if(!strcmp(atlas->textures[t]->name, texture_name))
 		{
-			unsigned int col = *ptr2++;
-			unsigned char* ptr = (unsigned char*)&buffer[(x + y *
-				header->biWidth) * element_size];
-
-			if(format == GL_RGBA)
-			{
-				*((unsigned int*)ptr) = col;
-			}
-			else if(format == GL_RGB)
-			{
-				*((unsigned short*)ptr) = RGBA8888toRGB565(col);
-			}
+			return atlas->textures[t];
 		}
 	}
 
-	if(texture_name)
+	return NULL;
+}
+
+static glesh_atlas_page* atlas_add_page(glesh_atlas* atlas)
+{
+	glesh_atlas_page* pages;
+	glesh_atlas_page* page;
+
+	pages = realloc(atlas->pages, sizeof(glesh_atlas_page) *
+		(atlas->num_pages + 1));
+	if(!pages)
+	{
+		BLTS_LOGGED_PERROR("realloc");
+		return NULL;
+	}
+	atlas->pages = pages;
+
+	page = &atlas->pages[atlas->num_pages];
+	memset(page, 0, sizeof(glesh_atlas_page));
+
+	/* The skyline never has more nodes than the page has columns, plus the
+	 * one being inserted */
+	page->skyline = malloc(sizeof(glesh_skyline_node) *
+		(atlas->page_size + 1));
+	if(!page->skyline)
 	{
-		strcpy(context->textures[context->num_textures].name, texture_name);
+		BLTS_LOGGED_PERROR("malloc");
+		return NULL;
 	}
-	context->textures[context->num_textures].width = header->biWidth;
-	context->textures[context->num_textures].height = header->biHeight;
+	page->skyline[0].x = 0;
+	page->skyline[0].y = 0;
+	page->skyline[0].width = atlas->page_size;
+	page->num_nodes = 1;
 
-	context->textures[context->num_textures].tex_id =
-		glesh_get_texture_from_pool(context);
+	glGenTextures(1, &page->tex_id);
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture (GL_TEXTURE_2D,
-		context->textures[context->num_textures].tex_id);
-	if(format == GL_RGBA)
+	glBindTexture(GL_TEXTURE_2D, page->tex_id);
+	if(atlas->format == GL_RGBA)
 	{
-		glTexImage2D ( GL_TEXTURE_2D, 0, format, header->biWidth,
-			header->biHeight, 0, format, GL_UNSIGNED_BYTE, buffer );
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlas->page_size,
+			atlas->page_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	}
-	else if(format == GL_RGB)
+	else
 	{
-		glTexImage2D ( GL_TEXTURE_2D, 0, format, header->biWidth,
-			header->biHeight, 0, format, GL_UNSIGNED_SHORT_5_6_5, buffer );
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, atlas->page_size,
+			atlas->page_size, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, NULL);
 	}
-	glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-	glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-	glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-	glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
-	free(buffer);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-	return &context->textures[context->num_textures++];
+	atlas->num_pages++;
+
+	return page;
 }
 
-glesh_texture* glesh_texture_from_bmp_file(glesh_context* context,
-	const GLenum format, const char* texture_name, const char* filename,
-	int scale_w, int scale_h)
+/* Returns the top of a width wide rectangle placed at skyline node index,
+ * or -1 if it does not fit */
+static int skyline_fit(glesh_atlas* atlas, glesh_atlas_page* page,
+	int index, int width, int height)
 {
-	glesh_bitmap_header header;
-	unsigned char* data = NULL;
+	int x = page->skyline[index].x;
+	int y = 0;
+	int remaining = width;
 
-	if(format == GL_RGBA)
+	if(x + width > atlas->page_size)
 	{
-		data = glesh_read_bitmap(filename, &header, 1, scale_w, scale_h);
+		return -1;
 	}
-	else if(format == GL_RGB)
+
+	while(remaining > 0)
 	{
-		data = glesh_read_bitmap(filename, &header, 0, scale_w, scale_h);
+		y = GLESH_MAX(y, page->skyline[index].y);
+		if(y + height > atlas->page_size)
+		{
+			return -1;
+		}
+		remaining -= page->skyline[index].width;
+		index++;
 	}
-	else
+
+	return y;
+}
+
+/* Bottom-left skyline packing: the position with the lowest resulting top
+ * edge wins, ties broken by the narrowest node. */
+static int skyline_insert(glesh_atlas* atlas, glesh_atlas_page* page,
+	int width, int height, int* out_x, int* out_y)
+{
+	int best_index = -1;
+	int best_top = INT_MAX;
+	int best_width = INT_MAX;
+	int i, y, shrink;
+
+	for(i = 0; i < page->num_nodes; i++)
 	{
-		BLTS_ERROR("Unsupported pixel format\n");
-		return NULL;
+		y = skyline_fit(atlas, page, i, width, height);
+		if(y >= 0 && (y + height < best_top || (y + height == best_top &&
+			page->skyline[i].width < best_width)))
+		{
+			best_index = i;
+			best_top = y + height;
+			best_width = page->skyline[i].width;
+			*out_x = page->skyline[i].x;
+			*out_y = y;
+		}
 	}
 
-	if(!data)
+	if(best_index < 0)
 	{
-		BLTS_ERROR("Failed to read file %s\n", filename);
-		return NULL;
+		return 0;
+	}
+
+	/* New node for the top of the rectangle */
+	memmove(&page->skyline[best_index + 1], &page->skyline[best_index],
+		sizeof(glesh_skyline_node) * (page->num_nodes - best_index));
+	page->skyline[best_index].x = *out_x;
+	page->skyline[best_index].y = best_top;
+	page->skyline[best_index].width = width;
+	page->num_nodes++;
+
+	/* Trim or drop the nodes now covered by it */
+	for(i = best_index + 1; i < page->num_nodes; i++)
+	{
+		shrink = page->skyline[i - 1].x + page->skyline[i - 1].width -
+			page->skyline[i].x;
+		if(shrink <= 0)
+		{
+			break;
+		}
+
+		if(page->skyline[i].width > shrink)
+		{
+			page->skyline[i].x += shrink;
+			page->skyline[i].width -= shrink;
+			break;
+		}
+
+		memmove(&page->skyline[i], &page->skyline[i + 1],
+			sizeof(glesh_skyline_node) * (page->num_nodes - i - 1));
+		page->num_nodes--;
+		i--;
+	}
+
+	/* Merge neighbours at the same height */
+	for(i = 0; i < page->num_nodes - 1; i++)
+	{
+		if(page->skyline[i].y == page->skyline[i + 1].y)
+		{
+			page->skyline[i].width += page->skyline[i + 1].width;
+			memmove(&page->skyline[i + 1], &page->skyline[i + 2],
+				sizeof(glesh_skyline_node) * (page->num_nodes - i - 2));
+			page->num_nodes--;
+			i--;
+		}
 	}
 
-	return glesh_bitmap_to_texture(context, format,
-		texture_name, data, &header);
+	return 1;
 }
 
-unsigned char* glesh_generate_pattern(const int width, const int height,
-	const int offset, const GLenum format)
+glesh_texture* glesh_atlas_add_bitmap(glesh_atlas* atlas,
+	const char* texture_name, unsigned char* data,
+	glesh_bitmap_header* header)
 {
-	int element_size;
-	unsigned char* buffer;
-	int x, y;
+	glesh_atlas_page* page = NULL;
+	glesh_texture* tex;
+	unsigned short* buffer = NULL;
+	unsigned int* src = (unsigned int*)data;
+	int width = header->biWidth + GLESH_ATLAS_PADDING;
+	int height = header->biHeight + GLESH_ATLAS_PADDING;
+	int x = 0, y = 0;
+	int t;
 
-	if(format == GL_RGBA)
+	tex = glesh_atlas_texture_by_name(atlas, texture_name);
+	if(tex)
 	{
-		element_size = 4;
+		/* texture already exists, return it */
+		return tex;
 	}
-	else if(format == GL_RGB)
+
+	if(width > atlas->page_size || height > atlas->page_size)
 	{
-		element_size = 2;
+		BLTS_ERROR("glesh_atlas_add_bitmap: %d x %d image does not fit in "
+			"%d x %d pages\n", header->biWidth, header->biHeight,
+			atlas->page_size, atlas->page_size);
+		return NULL;
 	}
-	else
+
+	for(t = 0; t < atlas->num_pages; t++)
 	{
-		BLTS_ERROR("Unsupported pixel format (%d).\n", format);
+		if(skyline_insert(atlas, &atlas->pages[t], width, height, &x, &y))
+		{
+			page = &atlas->pages[t];
+			break;
+		}
+	}
+
+	if(!page)
+	{
+		page = atlas_add_page(atlas);
+		if(!page || !skyline_insert(atlas, page, width, height, &x, &y))
+		{
+			BLTS_ERROR("glesh_atlas_add_bitmap: Failed to place image\n");
+			return NULL;
+		}
+	}
+
+	if(atlas->num_textures >= atlas->max_textures)
+	{
+		glesh_texture** textures;
+		int max_textures = atlas->max_textures ? atlas->max_textures * 2 :
+			GLESH_POOL_CHUNK_SIZE;
+
+		textures = realloc(atlas->textures,
+			sizeof(glesh_texture*) * max_textures);
+		if(!textures)
+		{
+			BLTS_LOGGED_PERROR("realloc");
+			return NULL;
+		}
+		atlas->textures = textures;
+		atlas->max_textures = max_textures;
+	}
+
+	tex = calloc(1, sizeof(glesh_texture));
+	if(!tex)
+	{
+		BLTS_LOGGED_PERROR("calloc");
 		return NULL;
 	}
 
-	buffer = (unsigned char*)malloc(width * height * element_size);
-	if(!buffer)
+	if(texture_name)
 	{
-		BLTS_ERROR("Error allocating buffer for texture.\n");
+		strncpy(tex->name, texture_name, sizeof(tex->name) - 1);
+	}
+	tex->tex_id = page->tex_id;
+	tex->width = header->biWidth;
+	tex->height = header->biHeight;
+	tex->in_atlas = 1;
+	tex->uv_rect[0] = (GLfloat)x / atlas->page_size;
+	tex->uv_rect[1] = (GLfloat)y / atlas->page_size;
+	tex->uv_rect[2] = (GLfloat)(x + header->biWidth) / atlas->page_size;
+	tex->uv_rect[3] = (GLfloat)(y + header->biHeight) / atlas->page_size;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, page->tex_id);
+	if(atlas->format == GL_RGBA)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, header->biWidth,
+			header->biHeight, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+	else
+	{
+		buffer = glesh_staging_buffer(atlas->staging,
+			sizeof(unsigned short) * header->biWidth * header->biHeight);
+		if(!buffer)
+		{
+			free(tex);
+			return NULL;
+		}
+		for(t = 0; t < header->biWidth * header->biHeight; t++)
+		{
+			buffer[t] = RGBA8888toRGB565(src[t]);
+		}
+
+		/* Rows of odd width are not 4-byte aligned */
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, header->biWidth,
+			header->biHeight, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, buffer);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	atlas->textures[atlas->num_textures++] = tex;
+
+	return tex;
+}
+
+glesh_texture* glesh_atlas_add_bmp_file(glesh_atlas* atlas,
+	const char* texture_name, const char* filename)
+{
+	glesh_bitmap_header header;
+	glesh_texture* tex;
+	unsigned char* data;
+
+	tex = glesh_atlas_texture_by_name(atlas, texture_name);
+	if(tex)
+	{
+		return tex;
+	}
+
+	data = glesh_read_bitmap(filename, &header, 1, 0, 0);
+	if(!data)
+	{
+		BLTS_ERROR("Failed to read file %s\n", filename);
 		return NULL;
 	}
 
+	tex = glesh_atlas_add_bitmap(atlas, texture_name, data, &header);
+	free(data);
+
+	return tex;
+}
+
+static int pattern_element_size(const GLenum format)
+{
+	if(format == GL_RGBA)
+	{
+		return 4;
+	}
+	else if(format == GL_RGB)
+	{
+		return 2;
+	}
+
+	BLTS_ERROR("Unsupported pixel format (%d).\n", format);
+	return 0;
+}
+
+static void fill_pattern(unsigned char* buffer, const int width,
+	const int height, const int offset, const GLenum format)
+{
+	int element_size = pattern_element_size(format);
+	int x, y;
+
 	for(y = 0; y < height; y++)
 	{
 		for(x = 0; x < width; x++)
@@ -775,7 +2018,7 @@ unsigned char* glesh_generate_pattern(const int width, const int height,
 								(unsigned char)(y) << 8 |
 								(unsigned char)(0xFF - (unsigned char)x +
 								offset) << 16 | 0xFF << 24;
-			unsigned char* ptr = (unsigned char*)&col;
+			unsigned char* ptr;
 			ptr = (unsigned char*)&buffer[(x + y * width) * element_size];
 
 			if(format == GL_RGBA)
@@ -788,6 +2031,27 @@ unsigned char* glesh_generate_pattern(const int width, const int height,
 			}
 		}
 	}
+}
+
+unsigned char* glesh_generate_pattern(const int width, const int height,
+	const int offset, const GLenum format)
+{
+	int element_size = pattern_element_size(format);
+	unsigned char* buffer;
+
+	if(!element_size)
+	{
+		return NULL;
+	}
+
+	buffer = (unsigned char*)malloc(width * height * element_size);
+	if(!buffer)
+	{
+		BLTS_ERROR("Error allocating buffer for texture.\n");
+		return NULL;
+	}
+
+	fill_pattern(buffer, width, height, offset, format);
 
 	return buffer;
 }
@@ -796,57 +2060,32 @@ glesh_texture* glesh_generate_texture(glesh_context* context,
 	const GLenum format, const int width, const int height,
 	const char* texture_name)
 {
+	int element_size = pattern_element_size(format);
 	unsigned char* buffer;
 
-	glesh_texture* tex = glest_texture_by_name(context, texture_name);
+	glesh_texture* tex = acquire_texture(context, texture_name);
 	if(tex)
 	{
 		/* texture already exists, return it */
 		return tex;
 	}
 
-	if(context->num_textures >= GLESH_MAX_TEXTURES)
+	if(!element_size)
 	{
-		BLTS_ERROR("glesh_generate_texture: Maximum number of textures reached\n");
 		return NULL;
 	}
 
-	buffer = glesh_generate_pattern(width, height, 0, format);
+	buffer = glesh_staging_buffer(&context->staging,
+		width * height * element_size);
 	if(!buffer)
 	{
 		BLTS_ERROR("Error allocating buffer for texture.\n");
 		return NULL;
 	}
+	fill_pattern(buffer, width, height, 0, format);
 
-	if(texture_name)
-	{
-		strcpy(context->textures[context->num_textures].name, texture_name);
-	}
-	context->textures[context->num_textures].width = width;
-	context->textures[context->num_textures].height = height;
-
-	context->textures[context->num_textures].tex_id =
-		glesh_get_texture_from_pool(context);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture (GL_TEXTURE_2D,
-		context->textures[context->num_textures].tex_id);
-	if(format == GL_RGBA)
-	{
-		glTexImage2D ( GL_TEXTURE_2D, 0, format, width, height, 0,
-			format, GL_UNSIGNED_BYTE, buffer );
-	}
-	else if(format == GL_RGB)
-	{
-		glTexImage2D ( GL_TEXTURE_2D, 0, format, width, height, 0,
-			format, GL_UNSIGNED_SHORT_5_6_5, buffer );
-	}
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
-	free(buffer);
-
-	return &context->textures[context->num_textures++];
+	return texture_from_texels(context, format, texture_name, buffer, width,
+		height);
 }
 
 int glesh_generate_sphere(int numSlices, float radius, glesh_object* object)
@@ -857,25 +2096,28 @@ int glesh_generate_sphere(int numSlices, float radius, glesh_object* object)
 	int num_indices = num_parallels * numSlices * 6;
 	float angleStep = (2.0f * GLESH_PI) / ((float) numSlices);
 
-	object->vertices = malloc ( sizeof(GLfloat) * 3 * num_vertices );
+	object->vertices = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->vertices)
 	{
 		BLTS_ERROR("Failed to allocate vertices\n");
 		return 0;
 	}
-	object->normals = malloc ( sizeof(GLfloat) * 3 * num_vertices );
+	object->normals = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->normals)
 	{
 		BLTS_ERROR("Failed to allocate normals\n");
 		return 0;
 	}
-	object->texcoords = malloc ( sizeof(GLfloat) * 2 * num_vertices );
+	object->texcoords = glesh_object_alloc(object,
+		sizeof(GLfloat) * 2 * num_vertices);
 	if(!object->texcoords)
 	{
 		BLTS_ERROR("Failed to allocate texture coordinates\n");
 		return 0;
 	}
-	object->indices = malloc ( sizeof(GLuint) * num_indices );
+	object->indices = glesh_object_alloc(object, sizeof(GLuint) * num_indices);
 	if(!object->indices)
 	{
 		BLTS_ERROR("Failed to allocate indices\n");
@@ -923,6 +2165,11 @@ int glesh_generate_sphere(int numSlices, float radius, glesh_object* object)
 	object->num_triangles = num_indices / 3;
 	object->num_vertices = num_vertices;
 
+	if(object->flags & GLESH_OBJECT_OPTIMIZE_VERTEX_CACHE)
+	{
+		return glesh_optimize_vertex_cache(object);
+	}
+
 	return 1;
 }
 
@@ -1016,7 +2263,8 @@ int glesh_generate_cube(float scale, glesh_object* object)
 	1.0f, 0.0f,
 	};
 
-	object->vertices = malloc ( sizeof(GLfloat) * 3 * num_vertices );
+	object->vertices = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->vertices)
 	{
 		BLTS_ERROR("Failed to allocate vertices\n");
@@ -1028,7 +2276,8 @@ int glesh_generate_cube(float scale, glesh_object* object)
 		object->vertices[i] *= scale;
 	}
 
-	object->normals = malloc ( sizeof(GLfloat) * 3 * num_vertices );
+	object->normals = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->normals)
 	{
 		BLTS_ERROR("Failed to allocate normals\n");
@@ -1036,7 +2285,8 @@ int glesh_generate_cube(float scale, glesh_object* object)
 	}
 	memcpy( object->normals, cubeNormals, sizeof( cubeNormals ) );
 
-	object->texcoords = malloc ( sizeof(GLfloat) * 2 * num_vertices );
+	object->texcoords = glesh_object_alloc(object,
+		sizeof(GLfloat) * 2 * num_vertices);
 	if(!object->texcoords)
 	{
 		BLTS_ERROR("Failed to allocate texture coordinates\n");
@@ -1060,7 +2310,7 @@ int glesh_generate_cube(float scale, glesh_object* object)
 	20, 22, 21
 	};
 
-	object->indices = malloc ( sizeof(GLuint) * num_indices );
+	object->indices = glesh_object_alloc(object, sizeof(GLuint) * num_indices);
 	if(!object->indices)
 	{
 		BLTS_ERROR("Failed to allocate indices\n");
@@ -1072,6 +2322,11 @@ int glesh_generate_cube(float scale, glesh_object* object)
 	object->num_triangles = num_indices / 3;
 	object->num_vertices = num_vertices;
 
+	if(object->flags & GLESH_OBJECT_OPTIMIZE_VERTEX_CACHE)
+	{
+		return glesh_optimize_vertex_cache(object);
+	}
+
 	return 1;
 }
 
@@ -1100,7 +2355,8 @@ int glesh_generate_triangle_strip(float scale, glesh_object* object)
 	0.0f, 0.0f,
 	};
 
-	object->vertices = malloc(sizeof(GLfloat) * 3 * num_vertices);
+	object->vertices = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->vertices)
 	{
 		BLTS_ERROR("Failed to allocate vertices\n");
@@ -1112,7 +2368,8 @@ int glesh_generate_triangle_strip(float scale, glesh_object* object)
 		object->vertices[i] *= scale;
 	}
 
-	object->normals = malloc(sizeof(GLfloat) * 3 * num_vertices);
+	object->normals = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->normals)
 	{
 		BLTS_ERROR("Failed to allocate normals\n");
@@ -1120,7 +2377,8 @@ int glesh_generate_triangle_strip(float scale, glesh_object* object)
 	}
 	memcpy(object->normals, triNormals, sizeof(triNormals));
 
-	object->texcoords = malloc(sizeof(GLfloat) * 2 * num_vertices);
+	object->texcoords = glesh_object_alloc(object,
+		sizeof(GLfloat) * 2 * num_vertices);
 	if(!object->texcoords)
 	{
 		BLTS_ERROR("Failed to allocate texture coordinates\n");
@@ -1133,7 +2391,7 @@ int glesh_generate_triangle_strip(float scale, glesh_object* object)
 	0, 2, 1
 	};
 
-	object->indices = malloc ( sizeof(GLuint) * num_indices );
+	object->indices = glesh_object_alloc(object, sizeof(GLuint) * num_indices);
 	if(!object->indices)
 	{
 		BLTS_ERROR("Failed to allocate indices\n");
@@ -1177,7 +2435,8 @@ int glesh_generate_rectangle_strip(float scalex, float scaley,
 	0.0f, 0.0f,
 	};
 
-	object->vertices = malloc(sizeof(GLfloat) * 3 * num_vertices);
+	object->vertices = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->vertices)
 	{
 		BLTS_ERROR("Failed to allocate vertices\n");
@@ -1191,7 +2450,8 @@ int glesh_generate_rectangle_strip(float scalex, float scaley,
 		vp[i].v[1] *= scaley;
 	}
 
-	object->normals = malloc(sizeof(GLfloat) * 3 * num_vertices);
+	object->normals = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->normals)
 	{
 		BLTS_ERROR("Failed to allocate normals\n");
@@ -1199,7 +2459,8 @@ int glesh_generate_rectangle_strip(float scalex, float scaley,
 	}
 	memcpy(object->normals, quadNormals, sizeof(quadNormals));
 
-	object->texcoords = malloc(sizeof(GLfloat) * 2 * num_vertices);
+	object->texcoords = glesh_object_alloc(object,
+		sizeof(GLfloat) * 2 * num_vertices);
 	if(!object->texcoords)
 	{
 		BLTS_ERROR("Failed to allocate texture coordinates\n");
@@ -1212,7 +2473,7 @@ int glesh_generate_rectangle_strip(float scalex, float scaley,
 	0, 2, 1, 3,
 	};
 
-	object->indices = malloc ( sizeof(GLuint) * num_indices );
+	object->indices = glesh_object_alloc(object, sizeof(GLuint) * num_indices);
 	if(!object->indices)
 	{
 		BLTS_ERROR("Failed to allocate indices\n");
@@ -1233,25 +2494,28 @@ int glesh_generate_plane(float scale, int numSlices, glesh_object* object)
 	int num_vertices = ( numSlices + 1 ) * ( numSlices + 1 );
 	int num_indices = numSlices * numSlices * 6;
 
-	object->vertices = malloc ( sizeof(GLfloat) * 3 * num_vertices );
+	object->vertices = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->vertices)
 	{
 		BLTS_ERROR("Failed to allocate vertices\n");
 		return 0;
 	}
-	object->normals = malloc ( sizeof(GLfloat) * 3 * num_vertices );
+	object->normals = glesh_object_alloc(object,
+		sizeof(GLfloat) * 3 * num_vertices);
 	if(!object->normals)
 	{
 		BLTS_ERROR("Failed to allocate normals\n");
 		return 0;
 	}
-	object->texcoords = malloc ( sizeof(GLfloat) * 2 * num_vertices );
+	object->texcoords = glesh_object_alloc(object,
+		sizeof(GLfloat) * 2 * num_vertices);
 	if(!object->texcoords)
 	{
 		BLTS_ERROR("Failed to allocate texture coordinates\n");
 		return 0;
 	}
-	object->indices = malloc ( sizeof(GLuint) * num_indices );
+	object->indices = glesh_object_alloc(object, sizeof(GLuint) * num_indices);
 	if(!object->indices)
 	{
 		BLTS_ERROR("Failed to allocate indices\n");
@@ -1299,24 +2563,393 @@ int glesh_generate_plane(float scale, int numSlices, glesh_object* object)
 	object->num_triangles = num_indices / 3;
 	object->num_vertices = num_vertices;
 
+	if(object->flags & GLESH_OBJECT_OPTIMIZE_VERTEX_CACHE)
+	{
+		return glesh_optimize_vertex_cache(object);
+	}
+
 	return 1;
 }
 
+/* Vertices added this way live on the heap even for objects with an
+ * arena, which could not give back the memory of each growth step */
 GLfloat* glesh_add_vertices(glesh_object* object, int count)
 {
+	GLfloat* vertices;
+	int max_vertices;
+
 	object->num_vertices += count;
 
+	if(object->num_vertices > object->max_vertices)
+	{
+		max_vertices = GLESH_MAX(object->num_vertices,
+			object->max_vertices * 2);
+		if(object->vertices && object->arena &&
+			glesh_arena_owns(object->arena, object->vertices))
+		{
+			/* Generated into the arena, copied once */
+			vertices = malloc(sizeof(GLfloat) * 3 * max_vertices);
+			if(vertices)
+			{
+				memcpy(vertices, object->vertices, sizeof(GLfloat) * 3 *
+					(object->num_vertices - count));
+			}
+		}
+		else
+		{
+			vertices = realloc(object->vertices,
+				sizeof(GLfloat) * 3 * max_vertices);
+		}
+		if(!vertices)
+		{
+			BLTS_LOGGED_PERROR("realloc");
+			object->num_vertices -= count;
+			return NULL;
+		}
+		object->vertices = vertices;
+		object->max_vertices = max_vertices;
+	}
+
+	return object->vertices;
+}
+
+static GLushort float_to_half(GLfloat val)
+{
+	union { GLfloat f; unsigned int u; } in;
+	unsigned int sign, mantissa;
+	int exponent;
+
+	in.f = val;
+	sign = (in.u >> 16) & 0x8000;
+	exponent = ((in.u >> 23) & 0xFF) - 127 + 15;
+	mantissa = in.u & 0x7FFFFF;
+
+	if(exponent <= 0)
+	{
+		/* Flush denormals to zero */
+		return sign;
+	}
+	if(exponent >= 31)
+	{
+		/* Clamp to the largest finite value */
+		return sign | 0x7BFF;
+	}
+
+	/* Round to nearest */
+	mantissa += 0x1000;
+	if(mantissa & 0x800000)
+	{
+		mantissa = 0;
+		if(++exponent >= 31)
+		{
+			return sign | 0x7BFF;
+		}
+	}
+
+	return sign | (exponent << 10) | (mantissa >> 13);
+}
+
+static int attrib_format_size(enum glesh_attrib_format format)
+{
+	switch(format)
+	{
+		case GLESH_FORMAT_HALF_FLOAT:
+		case GLESH_FORMAT_SHORT:
+			return 2;
+		case GLESH_FORMAT_BYTE:
+			return 1;
+		case GLESH_FORMAT_FLOAT:
+		default:
+			return 4;
+	}
+}
+
+static GLenum attrib_format_type(enum glesh_attrib_format format)
+{
+	switch(format)
+	{
+		case GLESH_FORMAT_HALF_FLOAT:
+			return GL_HALF_FLOAT_OES;
+		case GLESH_FORMAT_SHORT:
+			return GL_SHORT;
+		case GLESH_FORMAT_BYTE:
+			return GL_BYTE;
+		case GLESH_FORMAT_FLOAT:
+		default:
+			return GL_FLOAT;
+	}
+}
+
+static int write_attrib(GLubyte* dst, const GLfloat* src, int count,
+	enum glesh_attrib_format format)
+{
+	int t;
+
+	for(t = 0; t < count; t++)
+	{
+		if((format == GLESH_FORMAT_SHORT || format == GLESH_FORMAT_BYTE) &&
+			fabsf(src[t]) > 1.0001f)
+		{
+			return 0;
+		}
+
+		switch(format)
+		{
+			case GLESH_FORMAT_HALF_FLOAT:
+				((GLushort*)dst)[t] = float_to_half(src[t]);
+				break;
+			case GLESH_FORMAT_SHORT:
+				((GLshort*)dst)[t] = (GLshort)lrintf(
+					GLESH_MAX(-1.0f, GLESH_MIN(1.0f, src[t])) * 32767.0f);
+				break;
+			case GLESH_FORMAT_BYTE:
+				((GLbyte*)dst)[t] = (GLbyte)lrintf(
+					GLESH_MAX(-1.0f, GLESH_MIN(1.0f, src[t])) * 127.0f);
+				break;
+			case GLESH_FORMAT_FLOAT:
+			default:
+				((GLfloat*)dst)[t] = src[t];
+				break;
+		}
+	}
+
+	return 1;
+}
+
+static GLuint create_buffer(GLenum target, GLsizeiptr size,
+	const GLvoid* data, GLenum usage)
+{
+	GLuint buffer = 0;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+	glBufferData(target, size, data, usage);
+	glBindBuffer(target, 0);
+
+	return buffer;
+}
+
+/* Copies the object's client-side arrays into buffer objects. The arrays
+ * are kept, so the object can still be drawn either way. */
+int glesh_create_object_buffers(glesh_object* object, GLenum usage)
+{
 	if(!object->vertices)
 	{
-		object->vertices = malloc(sizeof(GLfloat) * 3 * object->num_vertices);
+		BLTS_ERROR("glesh_create_object_buffers: Object has no vertices\n");
+		return 0;
+	}
+
+	if(object->interleaved)
+	{
+		object->vertex_buffer = create_buffer(GL_ARRAY_BUFFER,
+			object->stride * object->num_vertices, object->interleaved, usage);
 	}
 	else
 	{
-		object->vertices = realloc(object->vertices,
-			sizeof(GLfloat) * 3 * object->num_vertices);
+		object->vertex_buffer = create_buffer(GL_ARRAY_BUFFER,
+			sizeof(GLfloat) * 3 * object->num_vertices, object->vertices,
+			usage);
 	}
 
-	return object->vertices;
+	if(object->normals && !object->interleaved)
+	{
+		object->normal_buffer = create_buffer(GL_ARRAY_BUFFER,
+			sizeof(GLfloat) * 3 * object->num_vertices, object->normals,
+			usage);
+	}
+
+	if(object->texcoords && !object->interleaved)
+	{
+		object->texcoord_buffer = create_buffer(GL_ARRAY_BUFFER,
+			sizeof(GLfloat) * 2 * object->num_vertices, object->texcoords,
+			usage);
+	}
+
+	if(object->indices16)
+	{
+		object->index_buffer = create_buffer(GL_ELEMENT_ARRAY_BUFFER,
+			sizeof(GLushort) * object->num_indices, object->indices16, usage);
+	}
+	else if(object->indices)
+	{
+		object->index_buffer = create_buffer(GL_ELEMENT_ARRAY_BUFFER,
+			sizeof(GLuint) * object->num_indices, object->indices, usage);
+	}
+
+	if(glGetError() != GL_NO_ERROR)
+	{
+		BLTS_ERROR("glesh_create_object_buffers: Failed to create buffers\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Sets up vertex attribute 'loc' from the object's buffer object, or from
+ * the client-side array if the object has no buffers. */
+void glesh_object_attrib_pointer(glesh_object* object, GLint loc,
+	enum glesh_attrib attrib)
+{
+	GLuint buffer;
+	const GLvoid* data;
+	GLint size;
+	enum glesh_attrib_format format;
+
+	if(object->interleaved)
+	{
+		size = (attrib == GLESH_ATTRIB_TEXCOORD) ? 2 : 3;
+		switch(attrib)
+		{
+			case GLESH_ATTRIB_NORMAL:
+				format = object->format.normal;
+				break;
+			case GLESH_ATTRIB_TEXCOORD:
+				format = object->format.texcoord;
+				break;
+			case GLESH_ATTRIB_POSITION:
+			default:
+				format = object->format.position;
+				break;
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, object->vertex_buffer);
+		glVertexAttribPointer(loc, size, attrib_format_type(format),
+			format == GLESH_FORMAT_SHORT || format == GLESH_FORMAT_BYTE,
+			object->stride, (const char*)(object->vertex_buffer ? NULL :
+			object->interleaved) + object->attrib_offset[attrib]);
+		return;
+	}
+
+	switch(attrib)
+	{
+		case GLESH_ATTRIB_NORMAL:
+			buffer = object->normal_buffer;
+			data = object->normals;
+			size = 3;
+			break;
+		case GLESH_ATTRIB_TEXCOORD:
+			buffer = object->texcoord_buffer;
+			data = object->texcoords;
+			size = 2;
+			break;
+		case GLESH_ATTRIB_POSITION:
+		default:
+			buffer = object->vertex_buffer;
+			data = object->vertices;
+			size = 3;
+			break;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(loc, size, GL_FLOAT, GL_FALSE, 0,
+		buffer ? NULL : data);
+}
+
+/* Binds the object's index buffer and returns the 'indices' argument for
+ * glDrawElements */
+const GLvoid* glesh_object_bind_indices(glesh_object* object)
+{
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, object->index_buffer);
+
+	if(object->index_buffer)
+	{
+		return NULL;
+	}
+
+	return object->indices16 ? (const GLvoid*)object->indices16 :
+		(const GLvoid*)object->indices;
+}
+
+GLenum glesh_object_index_type(glesh_object* object)
+{
+	return object->indices16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+/* Builds an interleaved vertex array of the object's positions, normals
+ * and texture coordinates in the given formats, plus 16-bit indices when
+ * there are few enough vertices. Each attribute is padded to 4 bytes. */
+int glesh_interleave_object(glesh_object* object,
+	const glesh_vertex_format* format)
+{
+	const GLfloat* arrays[3];
+	enum glesh_attrib_format formats[3];
+	const int components[3] = { 3, 3, 2 };
+	int attrib_size[3];
+	int i, t;
+
+	arrays[GLESH_ATTRIB_POSITION] = object->vertices;
+	arrays[GLESH_ATTRIB_NORMAL] = object->normals;
+	arrays[GLESH_ATTRIB_TEXCOORD] = object->texcoords;
+	formats[GLESH_ATTRIB_POSITION] = format->position;
+	formats[GLESH_ATTRIB_NORMAL] = format->normal;
+	formats[GLESH_ATTRIB_TEXCOORD] = format->texcoord;
+
+	if(!object->vertices)
+	{
+		BLTS_ERROR("glesh_interleave_object: Object has no vertices\n");
+		return 0;
+	}
+
+	object->stride = 0;
+	for(t = 0; t < 3; t++)
+	{
+		if(!arrays[t])
+		{
+			object->attrib_offset[t] = -1;
+			continue;
+		}
+		attrib_size[t] = (components[t] * attrib_format_size(formats[t]) +
+			3) & ~3;
+		object->attrib_offset[t] = object->stride;
+		object->stride += attrib_size[t];
+	}
+
+	object->interleaved = glesh_object_alloc(object, object->stride *
+		object->num_vertices);
+	if(!object->interleaved)
+	{
+		return 0;
+	}
+	memset(object->interleaved, 0, object->stride * object->num_vertices);
+
+	for(i = 0; i < object->num_vertices; i++)
+	{
+		for(t = 0; t < 3; t++)
+		{
+			if(object->attrib_offset[t] < 0)
+			{
+				continue;
+			}
+			if(!write_attrib(&object->interleaved[i * object->stride +
+				object->attrib_offset[t]], &arrays[t][i * components[t]],
+				components[t], formats[t]))
+			{
+				BLTS_ERROR("glesh_interleave_object: Values out of range "
+					"for normalized format\n");
+				glesh_object_free(object, object->interleaved);
+				object->interleaved = NULL;
+				return 0;
+			}
+		}
+	}
+
+	object->format = *format;
+
+	if(object->indices && object->num_vertices <= 0x10000)
+	{
+		object->indices16 = glesh_object_alloc(object, sizeof(GLushort) *
+			object->num_indices);
+		if(!object->indices16)
+		{
+			return 0;
+		}
+		for(i = 0; i < object->num_indices; i++)
+		{
+			object->indices16[i] = (GLushort)object->indices[i];
+		}
+	}
+
+	return 1;
 }
 
 void glesh_generate_rotation_matrix(glesh_matrix* mat,
@@ -1488,191 +3121,135 @@ void glesh_translate(glesh_matrix* result, GLfloat tx, GLfloat ty, GLfloat tz)
 		result->m[2][3] * tz);
 }
 
-int glesh_init_object(glesh_object* object)
+/* With a context the object arrays come from its arena, with NULL from
+ * the heap */
+int glesh_init_object(glesh_context* context, glesh_object* object)
 {
 	memset(object, 0, sizeof(glesh_object));
+	object->arena = context ? &context->arena : NULL;
 	glesh_set_to_identity(&object->modelview);
+	object->texcoord_rect[2] = 1.0f;
+	object->texcoord_rect[3] = 1.0f;
 
 	return 1;
 }
 
 int glesh_destroy_object(glesh_object* object)
 {
+	GLuint buffers[] = { object->vertex_buffer, object->normal_buffer,
+		object->texcoord_buffer, object->index_buffer };
+	unsigned int t;
+
+	for(t = 0; t < ARRAY_SIZE(buffers); t++)
+	{
+		if(buffers[t])
+		{
+			glDeleteBuffers(1, &buffers[t]);
+		}
+	}
+	object->vertex_buffer = 0;
+	object->normal_buffer = 0;
+	object->texcoord_buffer = 0;
+	object->index_buffer = 0;
+
 	if(object->vertices)
 	{
-		free(object->vertices);
+		glesh_object_free(object, object->vertices);
 		object->vertices = NULL;
+		object->max_vertices = 0;
 	}
 
 	if(object->normals)
 	{
-		free(object->normals);
+		glesh_object_free(object, object->normals);
 		object->normals = NULL;
 	}
 
 	if(object->texcoords)
 	{
-		free(object->texcoords);
+		glesh_object_free(object, object->texcoords);
 		object->texcoords = NULL;
 	}
 
 	if(object->indices)
 	{
-		free(object->indices);
+		glesh_object_free(object, object->indices);
 		object->indices = NULL;
 	}
 
-	return 1;
-}
-
-int glesh_attach_texture(glesh_object* object, glesh_texture* tex)
-{
-	object->tex = tex;
-	return 1;
-}
-
-/* Loads 24-bit RGB/BGR and 32-bit ARGB/ABGR bitmaps */
-unsigned char* glesh_read_bitmap(const char* filename,
-	glesh_bitmap_header* header, int bgr, int scale_w, int scale_h)
-{
-	unsigned int filedatalen;
-	int x, y, ys, sxinc, syinc, k = 0;
-	int image_width, image_height;
-	unsigned char* sourcedata;
-
-	FILE* fp = fopen(filename, "rb");
-	if(!fp)
+	if(object->interleaved)
 	{
-		BLTS_LOGGED_PERROR("fopen");
-		return NULL;
+		glesh_object_free(object, object->interleaved);
+		object->interleaved = NULL;
 	}
 
-	fseek(fp, 10, SEEK_SET);
-	int offset = 0;
-	if(fread(&offset, 1, 4, fp) != 4)
+	if(object->indices16)
 	{
-		BLTS_ERROR("Failed to read bitmap header offset from file %s\n", filename);
-		fclose(fp);
-		return NULL;
+		glesh_object_free(object, object->indices16);
+		object->indices16 = NULL;
 	}
 
-	if(fread(header, 1, sizeof(glesh_bitmap_header), fp) !=
-		sizeof(glesh_bitmap_header))
-	{
-		BLTS_ERROR("Failed to read bitmap header from file %s\n", filename);
-		fclose(fp);
-		return NULL;
-	}
+	return 1;
+}
 
-	fseek(fp, offset, SEEK_SET);
+/* Texture coordinates are remapped from the current atlas rectangle to the
+ * new one, so attaching atlas and plain textures can be mixed freely. */
+int glesh_attach_texture(glesh_object* object, glesh_texture* tex)
+{
+	static const GLfloat full_rect[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+	const GLfloat* rect = (tex && tex->in_atlas) ? tex->uv_rect : full_rect;
+	const GLfloat* cur = object->texcoord_rect;
+	int i;
 
-	if(scale_w)
-	{
-		image_width = scale_w;
-	}
-	else
-	{
-		image_width = header->biWidth;
-	}
+	object->tex = tex;
 
-	if(scale_h)
-	{
-		image_height = scale_h;
-	}
-	else
+	if(!object->texcoords || !memcmp(rect, cur, sizeof(full_rect)))
 	{
-		image_height = header->biHeight;
+		return 1;
 	}
 
-	unsigned char* p_data = (unsigned char *) malloc(image_width *
-		image_height * 4);
-	if(!p_data)
+	for(i = 0; i < object->num_vertices; i++)
 	{
-		BLTS_LOGGED_PERROR("malloc");
-		fclose(fp);
-		return NULL;
-	}
+		GLfloat* tc = &object->texcoords[i * 2];
 
-	if(header->biBitCount == 32)
-	{
-		filedatalen = header->biWidth * header->biHeight * 4;
-	}
-	else
-	{
-		filedatalen = header->biWidth * header->biHeight * 3;
-	}
-	unsigned char* p_temp = (unsigned char *) malloc( filedatalen );
-	if(!p_temp)
-	{
-		BLTS_LOGGED_PERROR("malloc");
-		fclose(fp);
-		return NULL;
+		tc[0] = rect[0] + (tc[0] - cur[0]) / (cur[2] - cur[0]) *
+			(rect[2] - rect[0]);
+		tc[1] = rect[1] + (tc[1] - cur[1]) / (cur[3] - cur[1]) *
+			(rect[3] - rect[1]);
 	}
+	memcpy(object->texcoord_rect, rect, sizeof(full_rect));
 
-	if(fread(p_temp, 1, filedatalen, fp) != filedatalen)
+	if(object->texcoord_buffer)
 	{
-		BLTS_ERROR("Failed to read bitmap data from file %s\n", filename);
-		fclose(fp);
-		free(p_data);
-		return NULL;
+		glBindBuffer(GL_ARRAY_BUFFER, object->texcoord_buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, 0,
+			sizeof(GLfloat) * 2 * object->num_vertices, object->texcoords);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
-	fclose(fp);
-
-	sxinc = (header->biWidth << 16) / image_width;
-	syinc = (header->biHeight << 16) / image_height;
 
-	k = 0;
-	for(y = image_height - 1; y >= 0; y--)
+	/* The interleaved copy is drawn instead of the arrays when present */
+	if(object->interleaved && object->attrib_offset[GLESH_ATTRIB_TEXCOORD] >= 0)
 	{
-		ys = (y * syinc >> 16) * header->biWidth;
-		for(x = 0; x < image_width; x++)
+		for(i = 0; i < object->num_vertices; i++)
 		{
-			if(header->biBitCount == 32)
-			{
-				sourcedata = &p_temp[4 * ((x * sxinc >> 16) + ys)];
-
-				if(bgr)
-				{
-					p_data[k] = sourcedata[2];
-					p_data[k+1] = sourcedata[1];
-					p_data[k+2] = sourcedata[0];
-					p_data[k+3] = sourcedata[3];
-				}
-				else
-				{
-					p_data[k] = sourcedata[0];
-					p_data[k+1] = sourcedata[1];
-					p_data[k+2] = sourcedata[2];
-					p_data[k+3] = sourcedata[3];
-				}
-			}
-			else
+			if(!write_attrib(&object->interleaved[i * object->stride +
+				object->attrib_offset[GLESH_ATTRIB_TEXCOORD]],
+				&object->texcoords[i * 2], 2, object->format.texcoord))
 			{
-				sourcedata = &p_temp[3 * ((x * sxinc >> 16) + ys)];
-
-				if(bgr)
-				{
-					p_data[k] = sourcedata[2];
-					p_data[k+1] = sourcedata[1];
-					p_data[k+2] = sourcedata[0];
-				}
-				else
-				{
-					p_data[k] = sourcedata[0];
-					p_data[k+1] = sourcedata[1];
-					p_data[k+2] = sourcedata[2];
-				}
-				p_data[k+3] = 0;
+				BLTS_ERROR("glesh_attach_texture: Values out of range "
+					"for normalized format\n");
+				return 0;
 			}
-			k += 4;
 		}
-	}
 
-	header->biWidth = image_width;
-	header->biHeight = image_height;
-
-	free(p_temp);
+		if(object->vertex_buffer)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, object->vertex_buffer);
+			glBufferSubData(GL_ARRAY_BUFFER, 0,
+				object->stride * object->num_vertices, object->interleaved);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+	}
 
-	return p_data;
+	return 1;
 }
-
@@ -22,17 +22,50 @@
 #include <wayland-egl.h>
 #include <GLES2/gl2.h>
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <blts_log.h>
 #include <blts_timing.h>
 #include <errno.h>
 #include <math.h>
-
-#define GLESH_MAX_OBJECTS 2000
-#define GLESH_MAX_TEXTURES 64
+#include <pthread.h>
+
+#define GLESH_POOL_CHUNK_SIZE 64 /* elements allocated at a time */
+#define GLESH_TEXTURE_NAME_BATCH 64 /* texture names generated at a time */
+#define GLESH_TEXTURE_NAME_MAX 256 /* including the terminating zero */
+#define GLESH_TEXTURE_BUCKETS 64 /* initial size of the texture name hash */
+#define GLESH_ARENA_BLOCK_SIZE (1<<18) /* bytes allocated at a time */
+#define GLESH_ATLAS_PADDING 1 /* pixels between atlas images */
 #define GLESH_PI (3.14159265f)
 #define GLESH_COS_SIN_TABLE_SIZE (1<<12)
 #define GLESH_COS_SIN_TABLE_MASK (GLESH_COS_SIN_TABLE_SIZE-1)
 
+/* Frame time histogram: 2000 bins of 50us, i.e. 0...100ms */
+#define GLESH_FRAME_HIST_BINS 2000
+#define GLESH_FRAME_HIST_BIN_WIDTH 0.00005
+#define GLESH_MAX_FRAME_BUDGETS 4
+#define GLESH_MAX_COMPILER_THREADS 16
+
+/* Streaming texture uploads: textures per stream (2 = double, 3 = triple
+ * buffering), streams per uploader and staging buffers between threads */
+#define GLESH_MAX_UPLOAD_BUFFERS 3
+#define GLESH_MAX_UPLOAD_STREAMS 256
+#define GLESH_UPLOAD_RING_SIZE 8
+
+/* Warm-up: frame times are steady when the coefficient of variation over
+ * the last GLESH_STEADY_STATE_WINDOW frames drops below the given limit */
+#define GLESH_STEADY_STATE_WINDOW 30
+#define GLESH_STEADY_STATE_MAX_CV 0.1
+#define GLESH_MAX_WARMUP_TIME 10.0
+#define GLESH_MAX_WARMUP_FRAMES 1000
+/* Allowance per warm-up frame in the CLI timeout, i.e. 10 fps at worst */
+#define GLESH_WARMUP_FRAME_TIMEOUT 0.1
+
+/* FIFO size used by glesh_object_acmr(), a typical post-transform cache */
+#define GLESH_ACMR_CACHE_SIZE 16
+
+/* glesh_object flags, set before calling a generator */
+#define GLESH_OBJECT_OPTIMIZE_VERTEX_CACHE (1<<0)
+
 #define DRAW_FUNCTION int (*drawFunc)(glesh_context* c, void* u)
 
 #define UNUSED_PARAM(a) (void)(a);
@@ -42,15 +75,58 @@
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof *(a))
 
-typedef struct
+typedef struct glesh_texture
 {
-	char name[64];
+	char name[GLESH_TEXTURE_NAME_MAX];
 	GLuint tex_id;
 	GLuint width;
 	GLuint height;
-	EGLSurface eglpixmap;
+	EGLImageKHR eglimage; /* the texture's storage, if imported */
+	int in_atlas; /* tex_id is a shared atlas page */
+	GLfloat uv_rect[4]; /* u0, v0, u1, v1 of the image in an atlas page */
+	int refs; /* see glesh_release_texture() */
+	/* Next in the same name hash bucket, or in the list of released
+	 * textures */
+	struct glesh_texture* next;
 } glesh_texture;
 
+typedef struct
+{
+	GLint x;
+	GLint y;
+	GLint width;
+} glesh_skyline_node;
+
+typedef struct
+{
+	GLuint tex_id;
+	int num_nodes;
+	glesh_skyline_node* skyline;
+} glesh_atlas_page;
+
+/* Reusable scratch memory for texture uploads */
+typedef struct
+{
+	void* buffer;
+	size_t size;
+	unsigned int allocations;
+	unsigned int uses;
+} glesh_staging;
+
+/* Packs images into shared power-of-two texture pages. Textures added to
+ * an atlas are owned by it and not listed in the context. */
+typedef struct
+{
+	GLenum format;
+	GLint page_size;
+	int num_pages;
+	glesh_atlas_page* pages;
+	int num_textures;
+	int max_textures;
+	glesh_texture** textures;
+	glesh_staging* staging; /* of the owning context, for conversions */
+} glesh_atlas;
+
 typedef struct
 {
 	GLfloat m[4][4];
@@ -66,6 +142,18 @@ typedef struct
 	GLfloat v[4];
 } glesh_vector4;
 
+typedef struct
+{
+	unsigned int count;
+	unsigned int bins[GLESH_FRAME_HIST_BINS];
+	unsigned int overflow; /* frames longer than the histogram range */
+	double min;
+	double max;
+	int num_budgets;
+	double budgets[GLESH_MAX_FRAME_BUDGETS]; /* in seconds */
+	unsigned int over_budget[GLESH_MAX_FRAME_BUDGETS];
+} glesh_frame_stats;
+
 typedef struct
 {
 	unsigned int frames_rendered;
@@ -73,21 +161,92 @@ typedef struct
 	double fps;
 	double cpu_usage;
 	double total_load;
+	unsigned int warmup_frames;
+	double warmup_time;
+	int steady_state; /* 1 if frame times settled during warm-up */
+	glesh_frame_stats frame_stats;
 } glesh_perf_data;
 
+enum glesh_attrib_format {
+	GLESH_FORMAT_FLOAT = 0,
+	GLESH_FORMAT_HALF_FLOAT, /* requires GL_OES_vertex_half_float */
+	GLESH_FORMAT_SHORT, /* normalized, values must be within -1...1 */
+	GLESH_FORMAT_BYTE, /* normalized, values must be within -1...1 */
+};
+
+/* Growable storage. Elements are allocated in chunks and never move, so
+ * pointers to them stay valid while the pool grows. */
+typedef struct
+{
+	size_t element_size;
+	GLuint count;
+	GLuint num_chunks;
+	void** chunks;
+} glesh_pool;
+
+/* Linear allocator for data living as long as the context, e.g. meshes
+ * generated during scene setup. Nothing is freed individually. */
+typedef struct
+{
+	struct glesh_arena_block* blocks;
+	size_t block_size;
+	size_t used; /* bytes handed out */
+	size_t reserved; /* bytes allocated from the system */
+	unsigned int num_blocks;
+	unsigned int allocations;
+} glesh_arena;
+
+typedef struct
+{
+	enum glesh_attrib_format position;
+	enum glesh_attrib_format normal;
+	enum glesh_attrib_format texcoord;
+} glesh_vertex_format;
+
 typedef struct
 {
 	int num_indices;
 	int num_triangles;
 	int num_vertices;
+	int max_vertices; /* capacity of vertices, see glesh_add_vertices() */
+	/* Arena of the context the arrays come from, NULL for the heap */
+	glesh_arena* arena;
 	GLfloat* vertices;
 	GLfloat* normals;
 	GLfloat* texcoords;
 	GLuint* indices;
+	int flags; /* GLESH_OBJECT_* */
+	/* Interleaved copy of the arrays above, see glesh_interleave_object() */
+	GLubyte* interleaved;
+	GLsizei stride;
+	int attrib_offset[3]; /* indexed by enum glesh_attrib, -1 if missing */
+	glesh_vertex_format format;
+	GLushort* indices16;
+	/* Buffer objects, 0 when drawing from the client-side arrays above */
+	GLuint vertex_buffer;
+	GLuint normal_buffer;
+	GLuint texcoord_buffer;
+	GLuint index_buffer;
 	glesh_matrix modelview;
 	glesh_texture* tex;
+	GLfloat texcoord_rect[4]; /* atlas rectangle texcoords are mapped to */
 } glesh_object;
 
+enum glesh_attrib {
+	GLESH_ATTRIB_POSITION,
+	GLESH_ATTRIB_NORMAL,
+	GLESH_ATTRIB_TEXCOORD,
+};
+
+/* Time spent in glesh_load_program() since the context was created */
+typedef struct
+{
+	int compiled; /* programs compiled and linked from source */
+	int cached; /* programs loaded from the binary cache */
+	double compile_time; /* seconds */
+	double cache_time;
+} glesh_program_timing;
+
 typedef struct
 {
 	GLint width; /* Render window width in pixels */
@@ -97,6 +256,7 @@ typedef struct
 	/* EGL-specific state */
 	EGLDisplay egl_display;
 	EGLContext egl_context;
+	EGLConfig egl_config;
 	EGLSurface egl_surface;
 	EGLNativeWindowType egl_native_window;
 	EGLNativeDisplayType egl_native_display;
@@ -111,12 +271,17 @@ typedef struct
 	int wayland_output_height;
 	struct wl_surface *wayland_surface;
 	struct wl_egl_window *wayland_window;
-
-	GLuint num_textures;
-	glesh_texture textures[GLESH_MAX_TEXTURES];
-
-	GLuint num_objects;
-	glesh_object objects[GLESH_MAX_OBJECTS];
+	struct wl_callback *wayland_frame_callback;
+	struct wp_presentation *wayland_presentation;
+
+	glesh_pool textures; /* of glesh_texture */
+	glesh_texture** texture_buckets; /* textures by exact name */
+	unsigned int num_texture_buckets;
+	unsigned int num_named_textures;
+	glesh_texture* free_textures; /* released, reused before adding */
+	glesh_pool objects; /* of glesh_object */
+	glesh_arena arena; /* object data generated during setup */
+	glesh_staging staging; /* texture upload scratch memory */
 
 	glesh_matrix mvp_mat;
 	glesh_matrix perspective_mat;
@@ -124,7 +289,8 @@ typedef struct
 	float* sin_table;
 	float* cos_table;
 
-	GLuint texture_pool[GLESH_MAX_TEXTURES];
+	GLuint* texture_pool; /* names from glGenTextures, grows as needed */
+	int texture_pool_size;
 	int next_texture;
 
 	glesh_perf_data perf_data;
@@ -152,7 +318,15 @@ int glesh_execute_main_loop(glesh_context* context, DRAW_FUNCTION,
 	void* user_ptr, double runtime);
 int glesh_load_program (const char *vertex_shader_src,
 	const char *fragment_shader_src);
+int glesh_load_shader(GLenum type, const char *source);
+int glesh_compile_program(const char *vertex_shader_src,
+	const char *fragment_shader_src);
 int glesh_destroy_context(glesh_context* context);
+int glesh_shared_context_supported(glesh_context* context);
+int glesh_create_shared_context(glesh_context* context,
+	EGLContext* egl_context, EGLSurface* egl_surface);
+void glesh_destroy_shared_context(glesh_context* context,
+	EGLContext egl_context, EGLSurface egl_surface);
 
 /* Textures */
 glesh_texture* glesh_texture_from_bmp_file(glesh_context* context,
@@ -164,10 +338,23 @@ glesh_texture* glesh_bitmap_to_texture(glesh_context* context,
 glesh_texture* glesh_generate_texture(glesh_context* context,
 	const GLenum format, const int width, const int height,
 	const char* texture_name);
-glesh_texture* glest_texture_by_name(glesh_context* context,
+glesh_texture* glesh_texture_by_name(glesh_context* context,
 	const char* texture_name);
+int glesh_release_texture(glesh_context* context, glesh_texture* tex);
 GLuint glesh_get_texture_from_pool(glesh_context* context);
 
+/* Texture atlas */
+int glesh_atlas_init(glesh_context* context, glesh_atlas* atlas,
+	const GLenum format, int page_size);
+void glesh_atlas_destroy(glesh_atlas* atlas);
+glesh_texture* glesh_atlas_add_bitmap(glesh_atlas* atlas,
+	const char* texture_name, unsigned char* data,
+	glesh_bitmap_header* header);
+glesh_texture* glesh_atlas_add_bmp_file(glesh_atlas* atlas,
+	const char* texture_name, const char* filename);
+glesh_texture* glesh_atlas_texture_by_name(glesh_atlas* atlas,
+	const char* texture_name);
+
 /* Primitives */
 int glesh_generate_sphere(int numSlices, float radius, glesh_object* object);
 int glesh_generate_cube(float scale, glesh_object* object);
@@ -176,12 +363,38 @@ int glesh_generate_rectangle_strip(float scalex, float scaley,
 int glesh_generate_triangle_strip(float scale, glesh_object* object);
 int glesh_generate_plane(float scale, int numSlices, glesh_object* object);
 
+/* Pools */
+void glesh_pool_init(glesh_pool* pool, size_t element_size);
+void* glesh_pool_add(glesh_pool* pool);
+void* glesh_pool_get(const glesh_pool* pool, GLuint index);
+void glesh_pool_destroy(glesh_pool* pool);
+
+/* Arena and staging memory, ogles2_helper_arena.c */
+void glesh_arena_init(glesh_arena* arena, size_t block_size);
+void* glesh_arena_alloc(glesh_arena* arena, size_t size);
+int glesh_arena_owns(const glesh_arena* arena, const void* ptr);
+void glesh_arena_destroy(glesh_arena* arena);
+void* glesh_staging_buffer(glesh_staging* staging, size_t size);
+void glesh_staging_destroy(glesh_staging* staging);
+
 /* Objects */
-int glesh_init_object(glesh_object* object);
+int glesh_init_object(glesh_context* context, glesh_object* object);
 int glesh_destroy_object(glesh_object* object);
 int glesh_attach_texture(glesh_object* object, glesh_texture* tex);
 glesh_object* glesh_add_object(glesh_context* context, glesh_object* object);
+glesh_object* glesh_get_object(glesh_context* context, GLuint index);
+void* glesh_object_alloc(glesh_object* object, size_t size);
+void glesh_object_free(glesh_object* object, void* ptr);
 GLfloat* glesh_add_vertices(glesh_object* object, int count);
+int glesh_create_object_buffers(glesh_object* object, GLenum usage);
+void glesh_object_attrib_pointer(glesh_object* object, GLint loc,
+	enum glesh_attrib attrib);
+const GLvoid* glesh_object_bind_indices(glesh_object* object);
+GLenum glesh_object_index_type(glesh_object* object);
+int glesh_interleave_object(glesh_object* object,
+	const glesh_vertex_format* format);
+int glesh_optimize_vertex_cache(glesh_object* object);
+double glesh_object_acmr(const glesh_object* object);
 
 /* Matrix, vectors */
 void glesh_multiply(glesh_matrix* result, glesh_matrix* srcA,
@@ -196,20 +409,260 @@ void glesh_perspective(glesh_matrix* result, float fovy, float aspect,
 void glesh_translate(glesh_matrix* result, GLfloat tx, GLfloat ty, GLfloat tz);
 
 /* Misc */
+int glesh_gl_extension_supported(const char* name);
+int glesh_egl_extension_supported(glesh_context* context, const char* name);
 void glesh_report_eglerror(const char* location);
 const char* glesh_egl_error_to_string(EGLint err);
 GLuint glesh_context_triangle_count(glesh_context* context);
 unsigned char* glesh_read_bitmap(const char* filename,
 	glesh_bitmap_header* header, int bgr, int scale_w, int scale_h);
+unsigned char* glesh_read_bitmap_texels(const char* filename,
+	glesh_bitmap_header* header, const GLenum format, int scale_w,
+	int scale_h);
+unsigned short RGBA8888toRGB565(unsigned int val);
+double glesh_bitmap_load_time();
+void glesh_reset_bitmap_load_time();
+void glesh_report_bitmap_load_time(void);
+const glesh_program_timing* glesh_get_program_timing();
+void glesh_reset_program_timing();
+void glesh_set_program_cache(const char* dir);
 double glesh_time_step();
+double glesh_time(void);
 unsigned char* glesh_generate_pattern(const int width, const int height,
 	const int offset, const GLenum format);
 
+/* Results */
+enum glesh_result_direction {
+	GLESH_LOWER_IS_BETTER = 0, /* times, sizes, missed frames */
+	GLESH_HIGHER_IS_BETTER, /* rates, frames achieved */
+};
+
+struct glesh_result_sink {
+	/* Every value passed to glesh_report_result() */
+	void (*result)(const char *tag, double value, const char *unit,
+		enum glesh_result_direction direction);
+	/* After glesh_execute_main_loop() has measured, for per-frame data */
+	void (*main_loop_done)(const glesh_context *context);
+};
+void glesh_set_result_sink(const struct glesh_result_sink* sink);
+int glesh_report_result(const char* tag, double value, const char* unit);
+int glesh_report_directed_result(const char* tag, double value,
+	const char* unit, enum glesh_result_direction direction);
+
+/* Frame statistics */
+void glesh_set_frame_budgets(const double* budgets_ms, int count);
+void glesh_set_warmup(int frames, double seconds, int wait_steady_state);
+void glesh_frame_stats_add(glesh_frame_stats* stats, double frame_time);
+double glesh_frame_stats_percentile(const glesh_frame_stats* stats,
+	double percentile);
+
+/* Swap, GPU timing and frame pacing */
+void glesh_set_swap_interval(int interval);
+void glesh_set_gpu_timing(int enable);
+int glesh_swap_buffers(glesh_context* context);
+int glesh_swap_buffers_with_damage(glesh_context* context,
+	const EGLint* rects, EGLint n_rects);
+int glesh_swap_with_damage_init(glesh_context* context);
+int glesh_buffer_age(glesh_context* context);
+/* Runs the before_swap hook of the window system */
+int glesh_ws_before_swap(glesh_context* context);
+EGLBoolean glesh_ws_swap(glesh_context* context, const EGLint* rects,
+	EGLint n_rects);
+/* Called by glesh_execute_main_loop() */
+int glesh_frame_timing_begin(glesh_context* context);
+void glesh_frame_timing_frame_begin(void);
+void glesh_frame_timing_frame_end(void);
+void glesh_frame_timing_end(void);
+
+/* Wayland presentation, see -fc and -pt */
+enum glesh_wayland_feedback {
+	GLESH_WAYLAND_FRAME_CALLBACKS = (1 << 0), /* throttle on wl_surface.frame */
+	GLESH_WAYLAND_PRESENTATION_TIME = (1 << 1), /* wp_presentation feedback */
+};
+void glesh_set_wayland_feedback(int flags);
+
+/* Program compilation off the render thread, ogles2_helper_compiler.c */
+enum glesh_compile_mode {
+	GLESH_COMPILE_SERIAL, /* all done before glesh_compiler_start() returns */
+	GLESH_COMPILE_THREADS, /* worker threads with shared EGL contexts */
+	GLESH_COMPILE_KHR_PARALLEL, /* driver threads, KHR_parallel_shader_compile */
+};
+
+enum glesh_future_state {
+	GLESH_FUTURE_PENDING,
+	GLESH_FUTURE_DONE,
+	GLESH_FUTURE_FAILED,
+};
+
+typedef struct
+{
+	const char* vertex_src; /* must stay valid until the future is ready */
+	const char* fragment_src;
+	GLuint program; /* valid when state is GLESH_FUTURE_DONE */
+	int state; /* enum glesh_future_state, see glesh_program_ready() */
+	GLuint vertex_shader; /* KHR_parallel_shader_compile only */
+	GLuint fragment_shader;
+} glesh_program_future;
+
+typedef struct
+{
+	enum glesh_compile_mode mode;
+	glesh_context* context;
+	glesh_program_future* futures;
+	int count;
+	int next; /* next future taken by a worker */
+	int started; /* workers that have taken their EGL context */
+	int running; /* workers that have not exited */
+	int num_threads;
+	pthread_t threads[GLESH_MAX_COMPILER_THREADS];
+	EGLContext egl_contexts[GLESH_MAX_COMPILER_THREADS];
+	EGLSurface egl_surfaces[GLESH_MAX_COMPILER_THREADS];
+	pthread_mutex_t lock; /* of next, running and the future states */
+} glesh_compiler;
+
+int glesh_compile_mode_supported(glesh_context* context,
+	enum glesh_compile_mode mode);
+int glesh_compiler_start(glesh_compiler* compiler, glesh_context* context,
+	enum glesh_compile_mode mode, int num_threads,
+	glesh_program_future* futures, int count);
+int glesh_program_ready(glesh_compiler* compiler,
+	glesh_program_future* future);
+int glesh_compiler_finish(glesh_compiler* compiler);
+
+/* Buffers shared with the GPU through dma-buf, ogles2_helper_dmabuf.c */
+enum glesh_dmabuf_type {
+	GLESH_DMABUF_NONE,
+	GLESH_DMABUF_GBM, /* linear buffer objects of a DRM render node */
+	GLESH_DMABUF_UDMABUF, /* memfd pages exported by /dev/udmabuf */
+};
+
+typedef struct
+{
+	enum glesh_dmabuf_type type;
+	int fd; /* render node or /dev/udmabuf */
+	void* gbm; /* struct gbm_device* */
+} glesh_dmabuf_allocator;
+
+typedef struct
+{
+	int fd; /* the dma-buf, -1 if none */
+	int memfd; /* udmabuf backing store */
+	void* bo; /* struct gbm_bo* */
+	void* map; /* CPU mapping, stride bytes per row */
+	void* map_data; /* for gbm_bo_unmap() */
+	size_t size;
+	int stride;
+	EGLImageKHR image;
+} glesh_dmabuf;
+
+int glesh_dmabuf_init(glesh_context* context,
+	glesh_dmabuf_allocator* allocator);
+void glesh_dmabuf_allocator_destroy(glesh_dmabuf_allocator* allocator);
+int glesh_dmabuf_create(glesh_context* context,
+	glesh_dmabuf_allocator* allocator, glesh_dmabuf* buffer,
+	int width, int height);
+int glesh_dmabuf_bind(glesh_dmabuf* buffer, GLuint tex_id);
+void* glesh_dmabuf_begin_write(glesh_dmabuf* buffer);
+void glesh_dmabuf_end_write(glesh_dmabuf* buffer);
+void glesh_dmabuf_destroy(glesh_context* context, glesh_dmabuf* buffer);
+const char* glesh_dmabuf_type_name(enum glesh_dmabuf_type type);
+
+/* Streaming texture uploads, ogles2_helper_upload.c */
+enum glesh_upload_mode {
+	GLESH_UPLOAD_SYNC, /* produced and uploaded on the render thread */
+	GLESH_UPLOAD_THREADED, /* producer thread, uploader with shared context */
+	/* Produced on the render thread straight into dma-bufs the textures
+	 * are imported from, RGBA only */
+	GLESH_UPLOAD_DMABUF,
+};
+
+/* Writes texels of the given frame of a stream to dst, stride bytes per
+ * row. Called from the producer thread with GLESH_UPLOAD_THREADED. */
+typedef void (*glesh_frame_producer)(void* user_ptr, int stream,
+	unsigned int frame, void* dst, int stride);
+
+typedef struct
+{
+	glesh_texture texture; /* attach this, tex_id is the newest shown frame */
+	GLuint tex_ids[GLESH_MAX_UPLOAD_BUFFERS];
+	glesh_dmabuf dmabufs[GLESH_MAX_UPLOAD_BUFFERS]; /* GLESH_UPLOAD_DMABUF */
+	/* Upload done for the ready texture, render thread done reading for
+	 * the others */
+	EGLSyncKHR fences[GLESH_MAX_UPLOAD_BUFFERS];
+	int front; /* texture drawn from */
+	int ready; /* uploaded, waiting to be shown, -1 if none */
+	int writing; /* being uploaded, -1 if none */
+	int changed; /* front changed since the last glesh_upload_acquire() */
+	unsigned int requested; /* frames asked for by the render thread */
+	unsigned int produced;
+} glesh_upload_stream;
+
+typedef struct
+{
+	void* data;
+	int stream;
+	unsigned int frame;
+} glesh_upload_slot;
+
+typedef struct
+{
+	enum glesh_upload_mode mode;
+	glesh_context* context;
+	GLenum format;
+	GLenum type;
+	int width;
+	int height;
+	size_t frame_size; /* bytes */
+	int num_buffers;
+	glesh_frame_producer producer;
+	void* user_ptr;
+	int num_streams;
+	glesh_upload_stream streams[GLESH_MAX_UPLOAD_STREAMS];
+
+	/* Ring of staging buffers, filled by the producer thread and emptied
+	 * by the uploader thread, in order */
+	glesh_upload_slot slots[GLESH_UPLOAD_RING_SIZE];
+	unsigned int filled;
+	unsigned int uploaded;
+	int next_stream; /* round robin position of the producer */
+	int stop;
+	int uploader_state; /* 0 starting, 1 running, -1 failed */
+	int num_threads;
+	pthread_t threads[2];
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	EGLContext egl_context;
+	EGLSurface egl_surface;
+	glesh_dmabuf_allocator allocator;
+
+	/* Statistics */
+	unsigned int frames_uploaded;
+	unsigned int frames_shown;
+	unsigned int frames_dropped; /* replaced before they were shown */
+	/* Seconds in glTexSubImage2D, on either thread, or writing dma-bufs */
+	double upload_time;
+	double render_thread_time; /* seconds in glesh_upload_* calls */
+	unsigned int imports; /* dma-bufs imported as textures */
+	double import_time;
+} glesh_uploader;
+
+int glesh_upload_mode_supported(glesh_context* context,
+	enum glesh_upload_mode mode);
+int glesh_uploader_start(glesh_uploader* uploader, glesh_context* context,
+	enum glesh_upload_mode mode, int num_streams, int num_buffers,
+	int width, int height, GLenum format, GLenum type,
+	glesh_frame_producer producer, void* user_ptr);
+int glesh_upload_request(glesh_uploader* uploader, int stream);
+int glesh_upload_acquire(glesh_uploader* uploader, int stream);
+glesh_texture* glesh_upload_texture(glesh_uploader* uploader, int stream);
+void glesh_uploader_destroy(glesh_uploader* uploader);
+
 /* Context-specific functions */
 enum glesh_ws_context_type {
 	GLESH_WS_CONTEXT_INVALID = 0,
 	GLESH_WS_CONTEXT_WAYLAND,
 	GLESH_WS_CONTEXT_FBDEV,
+	GLESH_WS_CONTEXT_HEADLESS,
 };
 void glesh_set_ws_context_type(enum glesh_ws_context_type type);
 
@@ -218,6 +671,17 @@ struct glesh_ws_context_functions {
 			int window_width, int window_height, int depth);
 	int (*destroy_context)(glesh_context *context);
 	int (*main_loop_step)(glesh_context *context);
+
+	/* Optional, for window systems that do not render to native windows */
+	EGLDisplay (*get_display)(glesh_context *context);
+	EGLSurface (*create_surface)(glesh_context *context, EGLConfig config);
+	const EGLint *config_attr;
+
+	/* Optional. Before each eglSwapBuffers() of glesh_swap_buffers(), and
+	 * around the measured part of glesh_execute_main_loop(). */
+	int (*before_swap)(glesh_context *context);
+	void (*measure_begin)(glesh_context *context);
+	void (*measure_end)(glesh_context *context);
 };
 
 #endif // OGLES2_HELPER
@@ -0,0 +1,149 @@
+/* ogles2_helper_arena.c -- Scene setup and upload memory for GLES2 helpers
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "ogles2_helper.h"
+
+/* Enough for any vertex, index or texel type */
+#define ARENA_ALIGN 16
+
+struct glesh_arena_block
+{
+	struct glesh_arena_block* next;
+	size_t size;
+	size_t used;
+};
+
+#define BLOCK_HEADER_SIZE ((sizeof(struct glesh_arena_block) + \
+	ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+void glesh_arena_init(glesh_arena* arena, size_t block_size)
+{
+	memset(arena, 0, sizeof(glesh_arena));
+	arena->block_size = block_size;
+}
+
+/* Memory is only released by glesh_arena_destroy() */
+void* glesh_arena_alloc(glesh_arena* arena, size_t size)
+{
+	struct glesh_arena_block* block = arena->blocks;
+	size_t block_size;
+	void* ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if(!block || block->used + size > block->size)
+	{
+		block_size = GLESH_MAX(arena->block_size, size);
+		block = malloc(BLOCK_HEADER_SIZE + block_size);
+		if(!block)
+		{
+			BLTS_LOGGED_PERROR("malloc");
+			return NULL;
+		}
+		block->size = block_size;
+		block->used = 0;
+
+		/* An oversized allocation gets a block of its own and leaves the
+		 * current one open for the small ones */
+		if(arena->blocks && block_size > arena->block_size)
+		{
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		}
+		else
+		{
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+		arena->reserved += block_size;
+		arena->num_blocks++;
+	}
+
+	ptr = (char*)block + BLOCK_HEADER_SIZE + block->used;
+	block->used += size;
+	arena->used += size;
+	arena->allocations++;
+
+	return ptr;
+}
+
+int glesh_arena_owns(const glesh_arena* arena, const void* ptr)
+{
+	const struct glesh_arena_block* block;
+	const char* data;
+
+	for(block = arena->blocks; block; block = block->next)
+	{
+		data = (const char*)block + BLOCK_HEADER_SIZE;
+		if((const char*)ptr >= data && (const char*)ptr < data + block->size)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void glesh_arena_destroy(glesh_arena* arena)
+{
+	struct glesh_arena_block* block = arena->blocks;
+	struct glesh_arena_block* next;
+
+	while(block)
+	{
+		next = block->next;
+		free(block);
+		block = next;
+	}
+
+	glesh_arena_init(arena, arena->block_size);
+}
+
+/* Returns a buffer of at least size bytes, valid until the next call.
+ * Grows as needed and is never shrunk, so after the largest upload no
+ * more allocations are made. */
+void* glesh_staging_buffer(glesh_staging* staging, size_t size)
+{
+	void* buffer;
+
+	if(size > staging->size)
+	{
+		/* Contents need not be kept, avoid the copy of realloc */
+		buffer = malloc(size);
+		if(!buffer)
+		{
+			BLTS_LOGGED_PERROR("malloc");
+			return NULL;
+		}
+		free(staging->buffer);
+		staging->buffer = buffer;
+		staging->size = size;
+		staging->allocations++;
+	}
+	staging->uses++;
+
+	return staging->buffer;
+}
+
+void glesh_staging_destroy(glesh_staging* staging)
+{
+	free(staging->buffer);
+	memset(staging, 0, sizeof(glesh_staging));
+}
@@ -0,0 +1,461 @@
+/* ogles2_helper_bitmap.c -- Bitmap loading and pixel conversion for GLES2
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ogles2_helper.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BITMAP_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define BITMAP_SSE2 1
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#define BITMAP_SSSE3 1
+#endif
+#endif
+
+#define BMP_HEADER_OFFSET 14
+
+#define BITMAP_MAX_TIMED 32
+#define BITMAP_TIMED_NAME_LEN 48
+
+/* Time spent in glesh_read_bitmap() and glesh_read_bitmap_texels() */
+static double bitmap_load_time;
+
+/* The same, per image. Images past BITMAP_MAX_TIMED only count in the
+ * total. */
+static struct
+{
+	char name[BITMAP_TIMED_NAME_LEN];
+	double time;
+} bitmap_loads[BITMAP_MAX_TIMED];
+static int num_bitmap_loads;
+
+double glesh_bitmap_load_time()
+{
+	return bitmap_load_time;
+}
+
+void glesh_reset_bitmap_load_time()
+{
+	bitmap_load_time = 0.0;
+	num_bitmap_loads = 0;
+}
+
+/* Keyed by the file name and its directory without extension, e.g.
+ * widgets_image1, so loading the same image again adds to its time */
+static void add_bitmap_load_time(const char* filename, double time)
+{
+	char name[BITMAP_TIMED_NAME_LEN];
+	const char* p = filename + strlen(filename);
+	int slashes = 0;
+	int t;
+
+	while(p > filename && !(p[-1] == '/' && slashes++))
+	{
+		p--;
+	}
+	while(*p == '/')
+	{
+		p++;
+	}
+	for(t = 0; p[t] && p[t] != '.' && t < BITMAP_TIMED_NAME_LEN - 1; t++)
+	{
+		name[t] = p[t] == '/' ? '_' : p[t];
+	}
+	name[t] = 0;
+
+	bitmap_load_time += time;
+
+	for(t = 0; t < num_bitmap_loads; t++)
+	{
+		if(!strcmp(bitmap_loads[t].name, name))
+		{
+			bitmap_loads[t].time += time;
+			return;
+		}
+	}
+
+	if(num_bitmap_loads < BITMAP_MAX_TIMED)
+	{
+		strcpy(bitmap_loads[t].name, name);
+		bitmap_loads[t].time = time;
+		num_bitmap_loads++;
+	}
+}
+
+/* Reports the total as image_load_time and each image as
+ * image_load_time_<name>, nothing if no image was loaded */
+void glesh_report_bitmap_load_time(void)
+{
+	char tag[BITMAP_TIMED_NAME_LEN + 16];
+	int t;
+
+	if(bitmap_load_time <= 0.0)
+	{
+		return;
+	}
+
+	glesh_report_result("image_load_time", bitmap_load_time * 1000.0, "ms");
+	for(t = 0; t < num_bitmap_loads; t++)
+	{
+		sprintf(tag, "image_load_time_%.*s", BITMAP_TIMED_NAME_LEN - 1,
+			bitmap_loads[t].name);
+		glesh_report_result(tag, bitmap_loads[t].time * 1000.0, "ms");
+	}
+}
+
+/* One row of 24/32-bit pixels to RGBA8888, optionally swapping the first
+ * and third channel. 24-bit pixels get zero alpha. */
+static void row_to_rgba8888(unsigned char* dst, const unsigned char* src,
+	int width, int bpp, int swap)
+{
+	int x = 0;
+
+#ifdef BITMAP_NEON
+	if(bpp == 32)
+	{
+		for(; x + 16 <= width; x += 16)
+		{
+			uint8x16x4_t px = vld4q_u8(&src[x * 4]);
+			if(swap)
+			{
+				uint8x16_t tmp = px.val[0];
+				px.val[0] = px.val[2];
+				px.val[2] = tmp;
+			}
+			vst4q_u8(&dst[x * 4], px);
+		}
+	}
+	else
+	{
+		for(; x + 16 <= width; x += 16)
+		{
+			uint8x16x3_t in = vld3q_u8(&src[x * 3]);
+			uint8x16x4_t px;
+			px.val[0] = swap ? in.val[2] : in.val[0];
+			px.val[1] = in.val[1];
+			px.val[2] = swap ? in.val[0] : in.val[2];
+			px.val[3] = vdupq_n_u8(0);
+			vst4q_u8(&dst[x * 4], px);
+		}
+	}
+#elif defined(BITMAP_SSSE3)
+	if(bpp == 32)
+	{
+		const __m128i shuffle = swap ?
+			_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15) :
+			_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		for(; x + 4 <= width; x += 4)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)&src[x * 4]);
+			_mm_storeu_si128((__m128i*)&dst[x * 4],
+				_mm_shuffle_epi8(px, shuffle));
+		}
+	}
+	else
+	{
+		/* -1 (0x80) lanes produce the zero alpha. 16 bytes are loaded for
+		 * 12 used, so stop early enough not to read past the row. */
+		const __m128i shuffle = swap ?
+			_mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) :
+			_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		for(; x + 6 <= width; x += 4)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)&src[x * 3]);
+			_mm_storeu_si128((__m128i*)&dst[x * 4],
+				_mm_shuffle_epi8(px, shuffle));
+		}
+	}
+#elif defined(BITMAP_SSE2)
+	if(bpp == 32)
+	{
+		const __m128i mask_ga = _mm_set1_epi32(0xFF00FF00);
+		const __m128i mask_low = _mm_set1_epi32(0x000000FF);
+		for(; x + 4 <= width; x += 4)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)&src[x * 4]);
+			if(swap)
+			{
+				px = _mm_or_si128(_mm_and_si128(px, mask_ga),
+					_mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 16), mask_low),
+					_mm_slli_epi32(_mm_and_si128(px, mask_low), 16)));
+			}
+			_mm_storeu_si128((__m128i*)&dst[x * 4], px);
+		}
+	}
+#endif
+
+	for(; x < width; x++)
+	{
+		const unsigned char* s = &src[x * (bpp >> 3)];
+		unsigned char* d = &dst[x * 4];
+
+		d[0] = swap ? s[2] : s[0];
+		d[1] = s[1];
+		d[2] = swap ? s[0] : s[2];
+		d[3] = (bpp == 32) ? s[3] : 0;
+	}
+}
+
+/* Same as RGBA8888toRGB565() for a row of RGBA8888 pixels */
+static void rgba8888_to_rgb565(unsigned short* dst, const unsigned char* src,
+	int width)
+{
+	const unsigned int* s = (const unsigned int*)src;
+	int x = 0;
+
+#ifdef BITMAP_SSE2
+	const __m128i mask5 = _mm_set1_epi32(0x1F);
+	const __m128i mask6 = _mm_set1_epi32(0x3F);
+	for(; x + 8 <= width; x += 8)
+	{
+		__m128i out[2];
+		int i;
+
+		for(i = 0; i < 2; i++)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)&s[x + i * 4]);
+			__m128i val = _mm_or_si128(
+				_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(px, 19), mask5), 11),
+				_mm_or_si128(
+				_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(px, 10), mask6), 5),
+				_mm_and_si128(_mm_srli_epi32(px, 3), mask5)));
+			/* Sign extend so that the saturating pack keeps all 16 bits */
+			out[i] = _mm_srai_epi32(_mm_slli_epi32(val, 16), 16);
+		}
+		_mm_storeu_si128((__m128i*)&dst[x], _mm_packs_epi32(out[0], out[1]));
+	}
+#endif
+
+	for(; x < width; x++)
+	{
+		dst[x] = RGBA8888toRGB565(s[x]);
+	}
+}
+
+/* One row of 24/32-bit pixels to RGB565 in a single pass where possible,
+ * tmp must hold width RGBA8888 pixels otherwise */
+static void row_to_rgb565(unsigned short* dst, const unsigned char* src,
+	int width, int bpp, int swap, unsigned char* tmp)
+{
+#ifdef BITMAP_NEON
+	int x = 0;
+	int c0 = swap ? 2 : 0;
+	int c2 = swap ? 0 : 2;
+
+	for(; x + 8 <= width; x += 8)
+	{
+		uint8x8_t ch[3];
+		uint16x8_t out;
+
+		if(bpp == 32)
+		{
+			uint8x8x4_t px = vld4_u8(&src[x * 4]);
+			ch[0] = px.val[c0];
+			ch[1] = px.val[1];
+			ch[2] = px.val[c2];
+		}
+		else
+		{
+			uint8x8x3_t px = vld3_u8(&src[x * 3]);
+			ch[0] = px.val[c0];
+			ch[1] = px.val[1];
+			ch[2] = px.val[c2];
+		}
+
+		out = vshll_n_u8(ch[2], 8);
+		out = vsriq_n_u16(out, vshll_n_u8(ch[1], 8), 5);
+		out = vsriq_n_u16(out, vshll_n_u8(ch[0], 8), 11);
+		vst1q_u16(&dst[x], out);
+	}
+
+	if(x < width)
+	{
+		row_to_rgba8888(tmp, &src[x * (bpp >> 3)], width - x, bpp, swap);
+		rgba8888_to_rgb565(&dst[x], tmp, width - x);
+	}
+#else
+	row_to_rgba8888(tmp, src, width, bpp, swap);
+	rgba8888_to_rgb565(dst, tmp, width);
+#endif
+}
+
+/* Loads 24-bit RGB/BGR and 32-bit ARGB/ABGR bitmaps, scaled with nearest
+ * sampling, into RGBA8888 (GL_RGBA) or RGB565 (GL_RGB) texels. Each row is
+ * sampled, swizzled and converted in one go straight from the mapped file. */
+static unsigned char* load_bitmap(const char* filename,
+	glesh_bitmap_header* header, int swap, int scale_w, int scale_h,
+	GLenum format)
+{
+	unsigned char* map = MAP_FAILED;
+	unsigned char* texels = NULL;
+	unsigned char* sampled = NULL;
+	unsigned char* tmp = NULL;
+	struct stat st;
+	unsigned int offset;
+	int fd = -1;
+	int x, y, sxinc, syinc;
+	int image_width, image_height;
+	int src_pixel_size, src_stride, texel_size;
+	double start = glesh_time();
+
+	if(format != GL_RGBA && format != GL_RGB)
+	{
+		BLTS_ERROR("Unsupported pixel format (%d).\n", format);
+		return NULL;
+	}
+	texel_size = (format == GL_RGBA) ? 4 : 2;
+
+	fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		BLTS_LOGGED_PERROR("open");
+		return NULL;
+	}
+
+	if(fstat(fd, &st) < 0)
+	{
+		BLTS_LOGGED_PERROR("fstat");
+		goto cleanup;
+	}
+
+	if((size_t)st.st_size < BMP_HEADER_OFFSET + sizeof(glesh_bitmap_header))
+	{
+		BLTS_ERROR("Failed to read bitmap header from file %s\n", filename);
+		goto cleanup;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		BLTS_LOGGED_PERROR("mmap");
+		goto cleanup;
+	}
+
+	memcpy(&offset, &map[10], sizeof(offset));
+	memcpy(header, &map[BMP_HEADER_OFFSET], sizeof(glesh_bitmap_header));
+
+	if((header->biBitCount != 24 && header->biBitCount != 32) ||
+		header->biWidth <= 0 || header->biHeight <= 0)
+	{
+		BLTS_ERROR("Unsupported bitmap %s (%d x %d, %d bpp)\n", filename,
+			header->biWidth, header->biHeight, header->biBitCount);
+		goto cleanup;
+	}
+
+	/* Rows are padded to 4 bytes */
+	src_pixel_size = header->biBitCount >> 3;
+	src_stride = (header->biWidth * src_pixel_size + 3) & ~3;
+	if(offset > (size_t)st.st_size || (size_t)src_stride * header->biHeight >
+		(size_t)st.st_size - offset)
+	{
+		BLTS_ERROR("Failed to read bitmap data from file %s\n", filename);
+		goto cleanup;
+	}
+	madvise(map, st.st_size, MADV_WILLNEED);
+
+	image_width = scale_w ? scale_w : header->biWidth;
+	image_height = scale_h ? scale_h : header->biHeight;
+
+	texels = malloc(image_width * image_height * texel_size);
+	sampled = malloc(image_width * src_pixel_size + 16);
+	tmp = malloc(image_width * 4);
+	if(!texels || !sampled || !tmp)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+		free(texels);
+		texels = NULL;
+		goto cleanup;
+	}
+
+	sxinc = (header->biWidth << 16) / image_width;
+	syinc = (header->biHeight << 16) / image_height;
+
+	/* Bitmaps are stored bottom-up */
+	for(y = 0; y < image_height; y++)
+	{
+		const unsigned char* src = &map[offset + src_stride *
+			((image_height - 1 - y) * syinc >> 16)];
+		unsigned char* dst = &texels[y * image_width * texel_size];
+
+		if(image_width != header->biWidth)
+		{
+			for(x = 0; x < image_width; x++)
+			{
+				memcpy(&sampled[x * src_pixel_size],
+					&src[(x * sxinc >> 16) * src_pixel_size], src_pixel_size);
+			}
+			src = sampled;
+		}
+
+		if(format == GL_RGBA)
+		{
+			row_to_rgba8888(dst, src, image_width, header->biBitCount, swap);
+		}
+		else
+		{
+			row_to_rgb565((unsigned short*)dst, src, image_width,
+				header->biBitCount, swap, tmp);
+		}
+	}
+
+	header->biWidth = image_width;
+	header->biHeight = image_height;
+
+	start = glesh_time() - start;
+	add_bitmap_load_time(filename, start);
+	BLTS_DEBUG("Loaded %s (%d x %d) in %.2f ms\n", filename, image_width,
+		image_height, start * 1000.0);
+
+cleanup:
+	free(sampled);
+	free(tmp);
+	if(map != MAP_FAILED)
+	{
+		munmap(map, st.st_size);
+	}
+	close(fd);
+
+	return texels;
+}
+
+unsigned char* glesh_read_bitmap(const char* filename,
+	glesh_bitmap_header* header, int bgr, int scale_w, int scale_h)
+{
+	return load_bitmap(filename, header, bgr, scale_w, scale_h, GL_RGBA);
+}
+
+/* Like glesh_read_bitmap(), but returns texels ready for glTexImage2D in the
+ * given format; GL_RGBA is swizzled from BGR, GL_RGB is RGB565. */
+unsigned char* glesh_read_bitmap_texels(const char* filename,
+	glesh_bitmap_header* header, const GLenum format, int scale_w,
+	int scale_h)
+{
+	return load_bitmap(filename, header, format == GL_RGBA, scale_w, scale_h,
+		format);
+}
@@ -0,0 +1,406 @@
+/* ogles2_helper_compiler.c -- Program compilation off the render thread
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ogles2_helper.h"
+#include <GLES2/gl2ext.h>
+
+int glesh_compile_mode_supported(glesh_context* context,
+	enum glesh_compile_mode mode)
+{
+	switch(mode)
+	{
+	case GLESH_COMPILE_SERIAL:
+		return 1;
+	case GLESH_COMPILE_THREADS:
+		return glesh_shared_context_supported(context);
+	case GLESH_COMPILE_KHR_PARALLEL:
+#ifdef GL_KHR_parallel_shader_compile
+		return glesh_gl_extension_supported("GL_KHR_parallel_shader_compile");
+#else
+		return 0;
+#endif
+	}
+
+	return 0;
+}
+
+static void set_state(glesh_compiler* compiler, glesh_program_future* future,
+	GLuint program)
+{
+	pthread_mutex_lock(&compiler->lock);
+	future->program = program;
+	future->state = program ? GLESH_FUTURE_DONE : GLESH_FUTURE_FAILED;
+	pthread_mutex_unlock(&compiler->lock);
+}
+
+/* With the lock held. The last worker to exit fails the programs no
+ * worker took, so that polling ends even if none of them could make its
+ * context current. */
+static void workers_exited(glesh_compiler* compiler, int count)
+{
+	compiler->running -= count;
+	if(compiler->running)
+	{
+		return;
+	}
+
+	for(; compiler->next < compiler->count; compiler->next++)
+	{
+		compiler->futures[compiler->next].state = GLESH_FUTURE_FAILED;
+	}
+}
+
+static void* compiler_thread(void* arg)
+{
+	glesh_compiler* compiler = arg;
+	EGLDisplay display = compiler->context->egl_display;
+	glesh_program_future* future;
+	EGLSurface surface;
+	EGLContext egl_context;
+	GLuint program;
+	int index;
+
+	pthread_mutex_lock(&compiler->lock);
+	index = compiler->started++;
+	pthread_mutex_unlock(&compiler->lock);
+
+	surface = compiler->egl_surfaces[index];
+	egl_context = compiler->egl_contexts[index];
+	if(!eglMakeCurrent(display, surface, surface, egl_context))
+	{
+		/* The other workers take the programs */
+		glesh_report_eglerror("eglMakeCurrent");
+		eglReleaseThread();
+		pthread_mutex_lock(&compiler->lock);
+		workers_exited(compiler, 1);
+		pthread_mutex_unlock(&compiler->lock);
+		return NULL;
+	}
+
+	for(;;)
+	{
+		pthread_mutex_lock(&compiler->lock);
+		future = compiler->next < compiler->count ?
+			&compiler->futures[compiler->next++] : NULL;
+		pthread_mutex_unlock(&compiler->lock);
+		if(!future)
+		{
+			break;
+		}
+
+		program = glesh_compile_program(future->vertex_src,
+			future->fragment_src);
+		/* Changes to shared objects are only guaranteed to be seen by
+		 * other contexts once the changing context has completed them */
+		glFinish();
+		set_state(compiler, future, program);
+	}
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglReleaseThread();
+	pthread_mutex_lock(&compiler->lock);
+	workers_exited(compiler, 1);
+	pthread_mutex_unlock(&compiler->lock);
+
+	return NULL;
+}
+
+static void destroy_workers(glesh_compiler* compiler)
+{
+	int t;
+
+	for(t = 0; t < compiler->num_threads; t++)
+	{
+		glesh_destroy_shared_context(compiler->context,
+			compiler->egl_contexts[t], compiler->egl_surfaces[t]);
+	}
+	compiler->num_threads = 0;
+}
+
+static int start_threads(glesh_compiler* compiler, int num_threads)
+{
+	int t;
+
+	if(num_threads <= 0)
+	{
+		num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	num_threads = GLESH_MAX(1, GLESH_MIN(num_threads,
+		GLESH_MIN(compiler->count, GLESH_MAX_COMPILER_THREADS)));
+
+	/* Contexts share the program objects with the render context */
+	for(t = 0; t < num_threads; t++)
+	{
+		if(!glesh_create_shared_context(compiler->context,
+			&compiler->egl_contexts[t], &compiler->egl_surfaces[t]))
+		{
+			break;
+		}
+		compiler->num_threads++;
+	}
+	if(t < num_threads)
+	{
+		destroy_workers(compiler);
+		return 0;
+	}
+
+	compiler->running = num_threads;
+	for(t = 0; t < num_threads; t++)
+	{
+		if(pthread_create(&compiler->threads[t], NULL, compiler_thread,
+			compiler))
+		{
+			BLTS_LOGGED_PERROR("pthread_create");
+			break;
+		}
+	}
+	if(t < num_threads)
+	{
+		/* Threads already started finish the whole batch */
+		pthread_mutex_lock(&compiler->lock);
+		workers_exited(compiler, num_threads - t);
+		pthread_mutex_unlock(&compiler->lock);
+		for(num_threads = t; t < compiler->num_threads; t++)
+		{
+			glesh_destroy_shared_context(compiler->context,
+				compiler->egl_contexts[t], compiler->egl_surfaces[t]);
+		}
+		compiler->num_threads = num_threads;
+		return num_threads > 0;
+	}
+
+	return 1;
+}
+
+#ifdef GL_KHR_parallel_shader_compile
+
+static GLuint create_shader(GLenum type, const char* source)
+{
+	GLuint shader = glCreateShader(type);
+
+	if(shader)
+	{
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+	}
+
+	return shader;
+}
+
+/* Nothing is queried, so that the driver is not forced to finish */
+static void start_khr_parallel(glesh_compiler* compiler, int num_threads)
+{
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_compiler_threads;
+	glesh_program_future* future;
+	GLuint program;
+	int t;
+
+	max_compiler_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)
+		eglGetProcAddress("glMaxShaderCompilerThreadsKHR");
+	if(max_compiler_threads)
+	{
+		/* 0xFFFFFFFF lets the driver decide */
+		max_compiler_threads(num_threads > 0 ? (GLuint)num_threads :
+			0xFFFFFFFF);
+	}
+
+	for(t = 0; t < compiler->count; t++)
+	{
+		future = &compiler->futures[t];
+		future->vertex_shader = create_shader(GL_VERTEX_SHADER,
+			future->vertex_src);
+		future->fragment_shader = create_shader(GL_FRAGMENT_SHADER,
+			future->fragment_src);
+		program = glCreateProgram();
+		if(!program || !future->vertex_shader || !future->fragment_shader)
+		{
+			BLTS_ERROR("Failed to create shader program\n");
+			/* Deleting name 0 is ignored */
+			glDeleteProgram(program);
+			glDeleteShader(future->vertex_shader);
+			glDeleteShader(future->fragment_shader);
+			future->vertex_shader = 0;
+			future->fragment_shader = 0;
+			future->state = GLESH_FUTURE_FAILED;
+			continue;
+		}
+		glAttachShader(program, future->vertex_shader);
+		glAttachShader(program, future->fragment_shader);
+		glLinkProgram(program);
+		future->program = program;
+	}
+}
+
+static void finish_khr_parallel(glesh_program_future* future)
+{
+	GLint linked = 0;
+	GLint info_len = 0;
+	char* info_log;
+
+	glGetProgramiv(future->program, GL_LINK_STATUS, &linked);
+	if(!linked)
+	{
+		glGetProgramiv(future->program, GL_INFO_LOG_LENGTH, &info_len);
+		info_log = info_len > 1 ? malloc(info_len) : NULL;
+		if(info_log)
+		{
+			glGetProgramInfoLog(future->program, info_len, NULL, info_log);
+			BLTS_ERROR("Error linking shader program:\n%s\n", info_log);
+			free(info_log);
+		}
+		else
+		{
+			BLTS_ERROR("Error linking shader program\n");
+		}
+		glDeleteProgram(future->program);
+		future->program = 0;
+	}
+
+	/* Freed with the program */
+	glDeleteShader(future->vertex_shader);
+	glDeleteShader(future->fragment_shader);
+	future->vertex_shader = 0;
+	future->fragment_shader = 0;
+	future->state = linked ? GLESH_FUTURE_DONE : GLESH_FUTURE_FAILED;
+}
+
+#endif /* GL_KHR_parallel_shader_compile */
+
+/* Starts building count programs. num_threads <= 0 uses one per CPU, or
+ * lets the driver decide with GLESH_COMPILE_KHR_PARALLEL. The futures
+ * must stay valid until glesh_compiler_finish(). */
+int glesh_compiler_start(glesh_compiler* compiler, glesh_context* context,
+	enum glesh_compile_mode mode, int num_threads,
+	glesh_program_future* futures, int count)
+{
+	int t;
+
+	memset(compiler, 0, sizeof(glesh_compiler));
+	compiler->mode = mode;
+	compiler->context = context;
+	compiler->futures = futures;
+	compiler->count = count;
+	pthread_mutex_init(&compiler->lock, NULL);
+
+	for(t = 0; t < count; t++)
+	{
+		futures[t].program = 0;
+		futures[t].state = GLESH_FUTURE_PENDING;
+		futures[t].vertex_shader = 0;
+		futures[t].fragment_shader = 0;
+	}
+
+	if(!glesh_compile_mode_supported(context, mode))
+	{
+		BLTS_ERROR("Compile mode %d not supported\n", mode);
+		pthread_mutex_destroy(&compiler->lock);
+		return 0;
+	}
+
+	switch(mode)
+	{
+	case GLESH_COMPILE_SERIAL:
+		for(t = 0; t < count; t++)
+		{
+			set_state(compiler, &futures[t], glesh_compile_program(
+				futures[t].vertex_src, futures[t].fragment_src));
+		}
+		break;
+	case GLESH_COMPILE_THREADS:
+		if(!start_threads(compiler, num_threads))
+		{
+			pthread_mutex_destroy(&compiler->lock);
+			return 0;
+		}
+		break;
+	case GLESH_COMPILE_KHR_PARALLEL:
+#ifdef GL_KHR_parallel_shader_compile
+		start_khr_parallel(compiler, num_threads);
+#endif
+		break;
+	}
+
+	return 1;
+}
+
+/* Does not block. Returns 1 when the future is done or failed. */
+int glesh_program_ready(glesh_compiler* compiler,
+	glesh_program_future* future)
+{
+	int state;
+
+#ifdef GL_KHR_parallel_shader_compile
+	GLint completed = 0;
+
+	if(compiler->mode == GLESH_COMPILE_KHR_PARALLEL)
+	{
+		if(future->state == GLESH_FUTURE_PENDING)
+		{
+			glGetProgramiv(future->program, GL_COMPLETION_STATUS_KHR,
+				&completed);
+			if(completed)
+			{
+				finish_khr_parallel(future);
+			}
+		}
+		return future->state != GLESH_FUTURE_PENDING;
+	}
+#endif
+
+	pthread_mutex_lock(&compiler->lock);
+	state = future->state;
+	pthread_mutex_unlock(&compiler->lock);
+
+	return state != GLESH_FUTURE_PENDING;
+}
+
+/* Waits for all programs. Returns 1 if all of them were built. */
+int glesh_compiler_finish(glesh_compiler* compiler)
+{
+	int failed = 0;
+	int t;
+
+	for(t = 0; t < compiler->num_threads; t++)
+	{
+		pthread_join(compiler->threads[t], NULL);
+	}
+	destroy_workers(compiler);
+
+	for(t = 0; t < compiler->count; t++)
+	{
+#ifdef GL_KHR_parallel_shader_compile
+		if(compiler->mode == GLESH_COMPILE_KHR_PARALLEL &&
+			compiler->futures[t].state == GLESH_FUTURE_PENDING)
+		{
+			finish_khr_parallel(&compiler->futures[t]);
+		}
+#endif
+		/* Left over if no worker could make its context current */
+		if(compiler->futures[t].state == GLESH_FUTURE_PENDING)
+		{
+			compiler->futures[t].state = GLESH_FUTURE_FAILED;
+		}
+		failed += compiler->futures[t].state != GLESH_FUTURE_DONE;
+	}
+	pthread_mutex_destroy(&compiler->lock);
+
+	return !failed;
+}
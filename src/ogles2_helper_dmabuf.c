@@ -0,0 +1,446 @@
+/* ogles2_helper_dmabuf.c -- Textures imported from dma-buf buffers
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#define _GNU_SOURCE /* memfd_create() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "ogles2_helper.h"
+#include <GLES2/gl2ext.h>
+
+#ifdef HAVE_GBM
+#include <gbm.h>
+#endif
+
+/* Kernel headers of the build host decide what can be tried at all */
+#if defined(__has_include)
+#if __has_include(<linux/udmabuf.h>)
+#include <linux/udmabuf.h>
+#define HAVE_UDMABUF
+#endif
+#if __has_include(<linux/dma-buf.h>)
+#include <linux/dma-buf.h>
+#endif
+#endif
+
+/* DRM_FORMAT_ABGR8888, bytes R, G, B, A in memory like GL_RGBA */
+#define FOURCC_ABGR8888 0x34324241
+#define RENDER_NODE_FIRST 128
+#define RENDER_NODE_COUNT 8
+
+#if defined(EGL_EXT_image_dma_buf_import) && defined(GL_OES_EGL_image)
+#define HAVE_DMABUF_IMPORT
+static PFNEGLCREATEIMAGEKHRPROC create_image = NULL;
+static PFNEGLDESTROYIMAGEKHRPROC destroy_image = NULL;
+static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture = NULL;
+#endif
+
+const char* glesh_dmabuf_type_name(enum glesh_dmabuf_type type)
+{
+	switch(type)
+	{
+	case GLESH_DMABUF_NONE:
+		return "none";
+	case GLESH_DMABUF_GBM:
+		return "GBM";
+	case GLESH_DMABUF_UDMABUF:
+		return "udmabuf";
+	}
+
+	return "unknown";
+}
+
+#ifdef HAVE_GBM
+static int init_gbm(glesh_dmabuf_allocator* allocator)
+{
+	char filename[32];
+	int t;
+
+	for(t = 0; t < RENDER_NODE_COUNT; t++)
+	{
+		sprintf(filename, "/dev/dri/renderD%d", RENDER_NODE_FIRST + t);
+		allocator->fd = open(filename, O_RDWR | O_CLOEXEC);
+		if(allocator->fd < 0)
+		{
+			continue;
+		}
+
+		allocator->gbm = gbm_create_device(allocator->fd);
+		if(allocator->gbm && gbm_device_is_format_supported(allocator->gbm,
+			GBM_FORMAT_ABGR8888, GBM_BO_USE_LINEAR | GBM_BO_USE_RENDERING))
+		{
+			allocator->type = GLESH_DMABUF_GBM;
+			BLTS_DEBUG("dma-buf buffers from GBM on %s\n", filename);
+			return 1;
+		}
+
+		if(allocator->gbm)
+		{
+			gbm_device_destroy(allocator->gbm);
+			allocator->gbm = NULL;
+		}
+		close(allocator->fd);
+		allocator->fd = -1;
+	}
+
+	return 0;
+}
+#endif
+
+#ifdef HAVE_UDMABUF
+static int init_udmabuf(glesh_dmabuf_allocator* allocator)
+{
+	allocator->fd = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+	if(allocator->fd < 0)
+	{
+		return 0;
+	}
+
+	allocator->type = GLESH_DMABUF_UDMABUF;
+	BLTS_DEBUG("dma-buf buffers from /dev/udmabuf\n");
+
+	return 1;
+}
+#endif
+
+/* Returns 0 if textures can not be imported from dma-bufs, or no buffers
+ * can be allocated; callers then copy with glTexSubImage2D instead */
+int glesh_dmabuf_init(glesh_context* context,
+	glesh_dmabuf_allocator* allocator)
+{
+	memset(allocator, 0, sizeof(glesh_dmabuf_allocator));
+	allocator->fd = -1;
+
+#ifdef HAVE_DMABUF_IMPORT
+	if(!glesh_egl_extension_supported(context,
+		"EGL_EXT_image_dma_buf_import") ||
+		!glesh_gl_extension_supported("GL_OES_EGL_image"))
+	{
+		BLTS_DEBUG("EGL_EXT_image_dma_buf_import or GL_OES_EGL_image not "
+			"supported\n");
+		return 0;
+	}
+
+	if(!create_image)
+	{
+		create_image = (PFNEGLCREATEIMAGEKHRPROC)
+			eglGetProcAddress("eglCreateImageKHR");
+		destroy_image = (PFNEGLDESTROYIMAGEKHRPROC)
+			eglGetProcAddress("eglDestroyImageKHR");
+		image_target_texture = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)
+			eglGetProcAddress("glEGLImageTargetTexture2DOES");
+	}
+	if(!create_image || !destroy_image || !image_target_texture)
+	{
+		BLTS_ERROR("Failed to get EGLImage functions\n");
+		return 0;
+	}
+
+#ifdef HAVE_GBM
+	if(init_gbm(allocator))
+	{
+		return 1;
+	}
+#endif
+#ifdef HAVE_UDMABUF
+	if(init_udmabuf(allocator))
+	{
+		return 1;
+	}
+#endif
+	BLTS_DEBUG("No DRM render node or /dev/udmabuf to allocate dma-bufs\n");
+#else
+	UNUSED_PARAM(context);
+	BLTS_DEBUG("Built without dma-buf import support\n");
+#endif
+
+	return 0;
+}
+
+void glesh_dmabuf_allocator_destroy(glesh_dmabuf_allocator* allocator)
+{
+#ifdef HAVE_GBM
+	if(allocator->gbm)
+	{
+		gbm_device_destroy(allocator->gbm);
+	}
+#endif
+	if(allocator->fd >= 0)
+	{
+		close(allocator->fd);
+	}
+	memset(allocator, 0, sizeof(glesh_dmabuf_allocator));
+	allocator->fd = -1;
+}
+
+#ifdef HAVE_GBM
+static int create_gbm(glesh_dmabuf_allocator* allocator, glesh_dmabuf* buffer,
+	int width, int height)
+{
+	buffer->bo = gbm_bo_create(allocator->gbm, width, height,
+		GBM_FORMAT_ABGR8888, GBM_BO_USE_LINEAR | GBM_BO_USE_RENDERING);
+	if(!buffer->bo)
+	{
+		BLTS_LOGGED_PERROR("gbm_bo_create");
+		return 0;
+	}
+
+	buffer->fd = gbm_bo_get_fd(buffer->bo);
+	buffer->stride = gbm_bo_get_stride(buffer->bo);
+	buffer->size = (size_t)buffer->stride * height;
+	if(buffer->fd < 0)
+	{
+		BLTS_ERROR("Failed to export GBM buffer\n");
+		return 0;
+	}
+
+	return 1;
+}
+#endif
+
+#ifdef HAVE_UDMABUF
+static int create_udmabuf(glesh_dmabuf_allocator* allocator,
+	glesh_dmabuf* buffer, int width, int height)
+{
+	struct udmabuf_create create;
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	buffer->stride = width * 4;
+	buffer->size = ((size_t)buffer->stride * height + page_size - 1) &
+		~(size_t)(page_size - 1);
+
+	/* udmabuf only takes memfds that can not shrink under the GPU */
+	buffer->memfd = memfd_create("glesh_dmabuf", MFD_CLOEXEC |
+		MFD_ALLOW_SEALING);
+	if(buffer->memfd < 0)
+	{
+		BLTS_LOGGED_PERROR("memfd_create");
+		return 0;
+	}
+	if(ftruncate(buffer->memfd, buffer->size) ||
+		fcntl(buffer->memfd, F_ADD_SEALS, F_SEAL_SHRINK))
+	{
+		BLTS_LOGGED_PERROR("ftruncate");
+		return 0;
+	}
+
+	memset(&create, 0, sizeof(create));
+	create.memfd = buffer->memfd;
+	create.flags = UDMABUF_FLAGS_CLOEXEC;
+	create.offset = 0;
+	create.size = buffer->size;
+	buffer->fd = ioctl(allocator->fd, UDMABUF_CREATE, &create);
+	if(buffer->fd < 0)
+	{
+		BLTS_LOGGED_PERROR("UDMABUF_CREATE");
+		return 0;
+	}
+
+	/* Written through the memfd, the pages are the same */
+	buffer->map = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, buffer->memfd, 0);
+	if(buffer->map == MAP_FAILED)
+	{
+		BLTS_LOGGED_PERROR("mmap");
+		buffer->map = NULL;
+		return 0;
+	}
+
+	return 1;
+}
+#endif
+
+/* An RGBA buffer of width x height texels and its EGLImage */
+int glesh_dmabuf_create(glesh_context* context,
+	glesh_dmabuf_allocator* allocator, glesh_dmabuf* buffer,
+	int width, int height)
+{
+	int ok = 0;
+
+	memset(buffer, 0, sizeof(glesh_dmabuf));
+	buffer->fd = -1;
+	buffer->memfd = -1;
+	buffer->image = EGL_NO_IMAGE_KHR;
+
+	switch(allocator->type)
+	{
+	case GLESH_DMABUF_GBM:
+#ifdef HAVE_GBM
+		ok = create_gbm(allocator, buffer, width, height);
+#endif
+		break;
+	case GLESH_DMABUF_UDMABUF:
+#ifdef HAVE_UDMABUF
+		ok = create_udmabuf(allocator, buffer, width, height);
+#endif
+		break;
+	case GLESH_DMABUF_NONE:
+		break;
+	}
+
+#ifdef HAVE_DMABUF_IMPORT
+	if(ok)
+	{
+		EGLint attribs[] =
+		{
+			EGL_WIDTH, width,
+			EGL_HEIGHT, height,
+			EGL_LINUX_DRM_FOURCC_EXT, FOURCC_ABGR8888,
+			EGL_DMA_BUF_PLANE0_FD_EXT, buffer->fd,
+			EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
+			EGL_DMA_BUF_PLANE0_PITCH_EXT, buffer->stride,
+			EGL_NONE
+		};
+
+		buffer->image = create_image(context->egl_display, EGL_NO_CONTEXT,
+			EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)NULL, attribs);
+		if(buffer->image == EGL_NO_IMAGE_KHR)
+		{
+			glesh_report_eglerror("eglCreateImageKHR");
+			ok = 0;
+		}
+	}
+#endif
+
+	if(!ok)
+	{
+		glesh_dmabuf_destroy(context, buffer);
+	}
+
+	return ok;
+}
+
+/* The texture's storage becomes the buffer, it is not copied */
+int glesh_dmabuf_bind(glesh_dmabuf* buffer, GLuint tex_id)
+{
+#ifdef HAVE_DMABUF_IMPORT
+	glBindTexture(GL_TEXTURE_2D, tex_id);
+	image_target_texture(GL_TEXTURE_2D, (GLeglImageOES)buffer->image);
+	if(glGetError() != GL_NO_ERROR)
+	{
+		/* E.g. the format is only supported for external textures */
+		BLTS_ERROR("glEGLImageTargetTexture2DOES failed\n");
+		return 0;
+	}
+
+	return 1;
+#else
+	UNUSED_PARAM(buffer);
+	UNUSED_PARAM(tex_id);
+	return 0;
+#endif
+}
+
+#ifdef DMA_BUF_IOCTL_SYNC
+static void sync_dmabuf(glesh_dmabuf* buffer, int flags)
+{
+	struct dma_buf_sync sync;
+
+	/* Keeps CPU caches coherent with what the GPU reads */
+	sync.flags = flags | DMA_BUF_SYNC_WRITE;
+	while(ioctl(buffer->fd, DMA_BUF_IOCTL_SYNC, &sync) && errno == EINTR);
+}
+#endif
+
+/* Returns the CPU mapping, buffer->stride bytes per row. The GPU must
+ * be done reading the buffer. */
+void* glesh_dmabuf_begin_write(glesh_dmabuf* buffer)
+{
+#ifdef HAVE_GBM
+	uint32_t stride;
+
+	if(buffer->bo)
+	{
+		buffer->map = gbm_bo_map(buffer->bo, 0, 0,
+			gbm_bo_get_width(buffer->bo), gbm_bo_get_height(buffer->bo),
+			GBM_BO_TRANSFER_WRITE, &stride, &buffer->map_data);
+		if(!buffer->map)
+		{
+			BLTS_ERROR("gbm_bo_map failed\n");
+			return NULL;
+		}
+		buffer->stride = stride;
+		return buffer->map;
+	}
+#endif
+
+#ifdef DMA_BUF_IOCTL_SYNC
+	sync_dmabuf(buffer, DMA_BUF_SYNC_START);
+#endif
+
+	return buffer->map;
+}
+
+void glesh_dmabuf_end_write(glesh_dmabuf* buffer)
+{
+#ifdef HAVE_GBM
+	if(buffer->bo)
+	{
+		gbm_bo_unmap(buffer->bo, buffer->map_data);
+		buffer->map = NULL;
+		buffer->map_data = NULL;
+		return;
+	}
+#endif
+
+#ifdef DMA_BUF_IOCTL_SYNC
+	sync_dmabuf(buffer, DMA_BUF_SYNC_END);
+#endif
+}
+
+/* Textures bound to the buffer keep the storage until deleted */
+void glesh_dmabuf_destroy(glesh_context* context, glesh_dmabuf* buffer)
+{
+#ifdef HAVE_DMABUF_IMPORT
+	if(buffer->image != EGL_NO_IMAGE_KHR)
+	{
+		destroy_image(context->egl_display, buffer->image);
+	}
+#else
+	UNUSED_PARAM(context);
+#endif
+
+	if(buffer->map && !buffer->bo)
+	{
+		munmap(buffer->map, buffer->size);
+	}
+#ifdef HAVE_GBM
+	if(buffer->bo)
+	{
+		gbm_bo_destroy(buffer->bo);
+	}
+#endif
+	if(buffer->fd >= 0)
+	{
+		close(buffer->fd);
+	}
+	if(buffer->memfd >= 0)
+	{
+		close(buffer->memfd);
+	}
+
+	memset(buffer, 0, sizeof(glesh_dmabuf));
+	buffer->fd = -1;
+	buffer->memfd = -1;
+	buffer->image = EGL_NO_IMAGE_KHR;
+}
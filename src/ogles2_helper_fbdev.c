@@ -59,4 +59,10 @@ struct glesh_ws_context_functions glesh_fbdev = {
 	glesh_create_context_fbdev,
 	glesh_destroy_context_fbdev,
 	glesh_main_loop_step_fbdev,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
 };
@@ -0,0 +1,494 @@
+/* ogles2_helper_gputime.c -- Per-frame CPU/GPU timing and frame pacing
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <string.h>
+#include <math.h>
+
+#include "ogles2_helper.h"
+#include <EGL/eglext.h>
+#include <GLES2/gl2ext.h>
+
+/* Splits each frame into the time the CPU spends issuing GL calls, the
+ * time eglSwapBuffers blocks and the time until the GPU has finished the
+ * frame. A fence (EGL_KHR_fence_sync) is inserted before the swap and
+ * waited for after it, which serializes CPU and GPU once per frame; frame
+ * rates measured with GPU timing enabled are not comparable to those
+ * without. If GL_EXT_disjoint_timer_query is present, the GPU execution
+ * time of the frame is measured as well.
+ *
+ * Independent of that, every swap is timed and the interval between
+ * consecutive swaps is used for a frame pacing report. */
+
+/* Frames presented later than this many nominal frame periods are
+ * counted as stutter */
+#define STUTTER_THRESHOLD 1.5
+
+static int gpu_timing_requested = 0;
+static int gpu_timing_active = 0;
+static int pacing_active = 0;
+
+static EGLDisplay display;
+static PFNEGLCREATESYNCKHRPROC create_sync;
+static PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+static PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+
+#ifdef GL_EXT_disjoint_timer_query
+static PFNGLGENQUERIESEXTPROC gen_queries;
+static PFNGLDELETEQUERIESEXTPROC delete_queries;
+static PFNGLBEGINQUERYEXTPROC begin_query;
+static PFNGLENDQUERYEXTPROC end_query;
+static PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_ui64;
+static GLuint query;
+#endif
+static int query_running;
+
+static double frame_start;
+static int frame_swapped;
+
+/* Frame pacing: interval histogram plus running sums for the jitter */
+static glesh_frame_stats swap_stats;
+static glesh_frame_stats interval_stats;
+static double prev_swap_end;
+static double prev_interval;
+static unsigned int num_intervals;
+static double interval_sum;
+static double interval_sum_sq;
+static double interval_diff_sum;
+
+static glesh_frame_stats cpu_submit_stats;
+static glesh_frame_stats gpu_latency_stats;
+static glesh_frame_stats gpu_time_stats;
+static unsigned int disjoint_frames;
+static unsigned int unswapped_frames;
+
+void glesh_set_gpu_timing(int enable)
+{
+	gpu_timing_requested = enable;
+}
+
+static int init_timer_query()
+{
+#ifdef GL_EXT_disjoint_timer_query
+	if(!glesh_gl_extension_supported("GL_EXT_disjoint_timer_query"))
+	{
+		return 0;
+	}
+
+	gen_queries = (PFNGLGENQUERIESEXTPROC)
+		eglGetProcAddress("glGenQueriesEXT");
+	delete_queries = (PFNGLDELETEQUERIESEXTPROC)
+		eglGetProcAddress("glDeleteQueriesEXT");
+	begin_query = (PFNGLBEGINQUERYEXTPROC)
+		eglGetProcAddress("glBeginQueryEXT");
+	end_query = (PFNGLENDQUERYEXTPROC)
+		eglGetProcAddress("glEndQueryEXT");
+	get_query_ui64 = (PFNGLGETQUERYOBJECTUI64VEXTPROC)
+		eglGetProcAddress("glGetQueryObjectui64vEXT");
+	if(!gen_queries || !delete_queries || !begin_query || !end_query ||
+		!get_query_ui64)
+	{
+		return 0;
+	}
+
+	gen_queries(1, &query);
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/* Called by glesh_execute_main_loop() after warm-up */
+int glesh_frame_timing_begin(glesh_context* context)
+{
+	memset(&swap_stats, 0, sizeof(glesh_frame_stats));
+	memset(&interval_stats, 0, sizeof(glesh_frame_stats));
+	prev_swap_end = -1.0;
+	num_intervals = 0;
+	interval_sum = 0.0;
+	interval_sum_sq = 0.0;
+	interval_diff_sum = 0.0;
+	unswapped_frames = 0;
+	pacing_active = 1;
+
+	gpu_timing_active = 0;
+
+	if(!gpu_timing_requested)
+	{
+		return 1;
+	}
+
+	if(!glesh_egl_extension_supported(context, "EGL_KHR_fence_sync"))
+	{
+		BLTS_ERROR("GPU timing requires EGL_KHR_fence_sync\n");
+		return 0;
+	}
+
+	create_sync = (PFNEGLCREATESYNCKHRPROC)
+		eglGetProcAddress("eglCreateSyncKHR");
+	destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+		eglGetProcAddress("eglDestroySyncKHR");
+	client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)
+		eglGetProcAddress("eglClientWaitSyncKHR");
+	if(!create_sync || !destroy_sync || !client_wait_sync)
+	{
+		BLTS_ERROR("Failed to get EGL_KHR_fence_sync functions\n");
+		return 0;
+	}
+
+	display = context->egl_display;
+	query_running = 0;
+	disjoint_frames = 0;
+	memset(&cpu_submit_stats, 0, sizeof(glesh_frame_stats));
+	memset(&gpu_latency_stats, 0, sizeof(glesh_frame_stats));
+	memset(&gpu_time_stats, 0, sizeof(glesh_frame_stats));
+
+	if(!init_timer_query())
+	{
+		BLTS_DEBUG("GL_EXT_disjoint_timer_query not available, GPU "
+			"execution time not measured\n");
+	}
+#ifdef GL_EXT_disjoint_timer_query
+	else
+	{
+		/* Clears the disjoint flag */
+		GLint disjoint;
+		glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+	}
+#endif
+
+	gpu_timing_active = 1;
+
+	return 1;
+}
+
+void glesh_frame_timing_frame_begin(void)
+{
+	if(!pacing_active)
+	{
+		return;
+	}
+
+	frame_start = timing_elapsed();
+	frame_swapped = 0;
+
+#ifdef GL_EXT_disjoint_timer_query
+	if(gpu_timing_active && query)
+	{
+		begin_query(GL_TIME_ELAPSED_EXT, query);
+		query_running = 1;
+	}
+#endif
+}
+
+/* Called once per frame; must not allocate or log */
+static void frame_pacing_add(double swap_start, double swap_end)
+{
+	double interval;
+
+	glesh_frame_stats_add(&swap_stats, swap_end - swap_start);
+
+	if(prev_swap_end >= 0.0)
+	{
+		interval = swap_end - prev_swap_end;
+		glesh_frame_stats_add(&interval_stats, interval);
+		if(num_intervals)
+		{
+			interval_diff_sum += fabs(interval - prev_interval);
+		}
+		interval_sum += interval;
+		interval_sum_sq += interval * interval;
+		prev_interval = interval;
+		num_intervals++;
+	}
+
+	prev_swap_end = swap_end;
+}
+
+/* Draw functions call this instead of eglSwapBuffers() */
+int glesh_swap_buffers(glesh_context* context)
+{
+	return glesh_swap_buffers_with_damage(context, NULL, 0);
+}
+
+/* rects are x, y, width, height from the bottom left corner, NULL for the
+ * whole surface */
+int glesh_swap_buffers_with_damage(glesh_context* context,
+	const EGLint* rects, EGLint n_rects)
+{
+	EGLSyncKHR fence;
+	EGLBoolean ret;
+	double submitted, swapped, swap_end;
+
+	if(!glesh_ws_before_swap(context))
+	{
+		return 0;
+	}
+
+	if(!gpu_timing_active)
+	{
+		swapped = timing_elapsed();
+		ret = glesh_ws_swap(context, rects, n_rects);
+		if(pacing_active)
+		{
+			frame_pacing_add(swapped, timing_elapsed());
+			frame_swapped = 1;
+		}
+		return ret;
+	}
+
+	submitted = timing_elapsed();
+	glesh_frame_stats_add(&cpu_submit_stats, submitted - frame_start);
+
+#ifdef GL_EXT_disjoint_timer_query
+	if(query_running)
+	{
+		end_query(GL_TIME_ELAPSED_EXT);
+	}
+#endif
+
+	fence = create_sync(display, EGL_SYNC_FENCE_KHR, NULL);
+	if(fence == EGL_NO_SYNC_KHR)
+	{
+		glesh_report_eglerror("eglCreateSyncKHR");
+		return 0;
+	}
+
+	swapped = timing_elapsed();
+	ret = glesh_ws_swap(context, rects, n_rects);
+	swap_end = timing_elapsed();
+	frame_pacing_add(swapped, swap_end);
+
+	if(client_wait_sync(display, fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+		EGL_FOREVER_KHR) != EGL_CONDITION_SATISFIED_KHR)
+	{
+		glesh_report_eglerror("eglClientWaitSyncKHR");
+		destroy_sync(display, fence);
+		return 0;
+	}
+	glesh_frame_stats_add(&gpu_latency_stats, timing_elapsed() - submitted);
+	destroy_sync(display, fence);
+
+#ifdef GL_EXT_disjoint_timer_query
+	/* The fence has signaled, so the result is available without
+	 * stalling */
+	if(query_running)
+	{
+		GLuint64 elapsed = 0;
+		GLint disjoint = 0;
+
+		query_running = 0;
+		get_query_ui64(query, GL_QUERY_RESULT_EXT, &elapsed);
+		glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+		if(disjoint || elapsed * 1e-9 > timing_elapsed() - frame_start)
+		{
+			/* e.g. a frequency change, the value is meaningless. Some
+			 * drivers do not flag it, but the GPU cannot have been busy
+			 * for longer than the frame took. */
+			disjoint_frames++;
+		}
+		else
+		{
+			glesh_frame_stats_add(&gpu_time_stats, elapsed * 1e-9);
+		}
+	}
+#endif
+
+	frame_swapped = 1;
+
+	return ret;
+}
+
+void glesh_frame_timing_frame_end(void)
+{
+	if(!pacing_active)
+	{
+		return;
+	}
+
+#ifdef GL_EXT_disjoint_timer_query
+	/* Draw function did not swap, leave no query open */
+	if(gpu_timing_active && query_running)
+	{
+		end_query(GL_TIME_ELAPSED_EXT);
+		query_running = 0;
+	}
+#endif
+
+	if(!frame_swapped)
+	{
+		unswapped_frames++;
+	}
+}
+
+static void report_stats(const char* name, const char* tag,
+	const glesh_frame_stats* stats)
+{
+	char buf[64];
+	double p50, p99;
+
+	p50 = glesh_frame_stats_percentile(stats, 50.0) * 1000.0;
+	p99 = glesh_frame_stats_percentile(stats, 99.0) * 1000.0;
+
+	BLTS_DEBUG("%s: median %lf ms, 99th percentile %lf ms, max %lf ms\n",
+		name, p50, p99, stats->max * 1000.0);
+
+	sprintf(buf, "%s_p50", tag);
+	glesh_report_result(buf, p50, "ms");
+	sprintf(buf, "%s_p99", tag);
+	glesh_report_result(buf, p99, "ms");
+	sprintf(buf, "%s_max", tag);
+	glesh_report_result(buf, stats->max * 1000.0, "ms");
+}
+
+static void report_frame_split()
+{
+	double cpu, gpu;
+
+	report_stats("CPU submit time", "cpu_submit_time", &cpu_submit_stats);
+	report_stats("GPU completion latency", "gpu_completion_latency",
+		&gpu_latency_stats);
+	gpu = glesh_frame_stats_percentile(&gpu_latency_stats, 50.0);
+
+	if(gpu_time_stats.count)
+	{
+		report_stats("GPU execution time", "gpu_time", &gpu_time_stats);
+		gpu = glesh_frame_stats_percentile(&gpu_time_stats, 50.0);
+	}
+	if(disjoint_frames)
+	{
+		BLTS_DEBUG("GPU execution time not available for %u frames "
+			"(disjoint or invalid)\n", disjoint_frames);
+	}
+
+	/* Median frame: whichever side takes longer limits the frame rate */
+	cpu = glesh_frame_stats_percentile(&cpu_submit_stats, 50.0);
+	BLTS_DEBUG("Median frame is %s-bound (CPU %lf ms, GPU %lf ms)\n",
+		gpu > cpu ? "GPU" : "CPU", cpu * 1000.0, gpu * 1000.0);
+}
+
+/* The median interval is taken as the nominal frame period: the vsync
+ * period times the swap interval when the compositor paces the swaps,
+ * otherwise the typical frame time. Missed vsyncs are estimated from the
+ * histogram as the number of nominal periods each late frame spans. */
+static void report_frame_pacing()
+{
+	double period, mean, jitter, interval;
+	unsigned int stutter = 0;
+	unsigned int missed = 0;
+	unsigned int longest = 0;
+	unsigned int periods;
+	unsigned int t;
+
+	report_stats("Swap blocked time", "swap_blocked_time", &swap_stats);
+
+	if(num_intervals < 2)
+	{
+		return;
+	}
+
+	period = glesh_frame_stats_percentile(&interval_stats, 50.0);
+	mean = interval_sum / num_intervals;
+	jitter = sqrt(fabs(interval_sum_sq / num_intervals - mean * mean));
+
+	for(t = 0; t < GLESH_FRAME_HIST_BINS && period > 0.0; t++)
+	{
+		if(!interval_stats.bins[t])
+		{
+			continue;
+		}
+
+		interval = (t + 0.5) * GLESH_FRAME_HIST_BIN_WIDTH;
+		if(interval > STUTTER_THRESHOLD * period)
+		{
+			periods = (unsigned int)(interval / period + 0.5);
+			stutter += interval_stats.bins[t];
+			missed += (periods - 1) * interval_stats.bins[t];
+			longest = GLESH_MAX(longest, periods - 1);
+		}
+	}
+
+	/* Intervals beyond the histogram, only the longest one is known */
+	if(interval_stats.overflow && period > 0.0)
+	{
+		periods = (unsigned int)(interval_stats.max / period + 0.5);
+		stutter += interval_stats.overflow;
+		missed += (periods - 1) * interval_stats.overflow;
+		longest = GLESH_MAX(longest, periods - 1);
+	}
+
+	BLTS_DEBUG("Frame pacing: nominal period %lf ms, jitter %lf ms "
+		"(frame to frame %lf ms)\n", period * 1000.0, jitter * 1000.0,
+		interval_diff_sum / (num_intervals - 1) * 1000.0);
+	BLTS_DEBUG("Stuttered frames: %u, missed vsyncs: %u, longest run of "
+		"missed vsyncs: %u\n", stutter, missed, longest);
+
+	glesh_report_result("frame_period", period * 1000.0, "ms");
+	glesh_report_result("frame_jitter", jitter * 1000.0, "ms");
+	glesh_report_result("frame_to_frame_jitter",
+		interval_diff_sum / (num_intervals - 1) * 1000.0, "ms");
+	glesh_report_result("stutter_frames", stutter, "frames");
+	glesh_report_result("missed_vsyncs", missed, "vsyncs");
+	glesh_report_result("longest_missed_vsync_run", longest, "vsyncs");
+}
+
+/* Called by glesh_execute_main_loop() after the measurement, or when it
+ * fails */
+void glesh_frame_timing_end(void)
+{
+	if(!pacing_active)
+	{
+		return;
+	}
+	pacing_active = 0;
+
+	if(unswapped_frames)
+	{
+		BLTS_DEBUG("%u frames not swapped with glesh_swap_buffers()\n",
+			unswapped_frames);
+	}
+
+	if(swap_stats.count)
+	{
+		report_frame_pacing();
+	}
+
+	if(!gpu_timing_active)
+	{
+		return;
+	}
+	gpu_timing_active = 0;
+
+#ifdef GL_EXT_disjoint_timer_query
+	if(query)
+	{
+		if(query_running)
+		{
+			end_query(GL_TIME_ELAPSED_EXT);
+			query_running = 0;
+		}
+		delete_queries(1, &query);
+		query = 0;
+	}
+#endif
+
+	if(cpu_submit_stats.count)
+	{
+		report_frame_split();
+	}
+}
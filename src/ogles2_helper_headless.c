@@ -0,0 +1,146 @@
+/* ogles2_helper_headless.c -- Offscreen (pbuffer) helper functions for GLES2
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <string.h>
+
+#include "ogles2_helper.h"
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+/* Used when no window size is given, there is no output to query */
+#define HEADLESS_DEFAULT_WIDTH 800
+#define HEADLESS_DEFAULT_HEIGHT 480
+
+static const EGLint headless_config_attr[] =
+{
+	EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+	EGL_RED_SIZE, 5,
+	EGL_GREEN_SIZE, 6,
+	EGL_BLUE_SIZE, 5,
+	EGL_DEPTH_SIZE, 16, /* test_vert_shader and zoom tests use depth test */
+	EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+	EGL_NONE
+};
+
+int glesh_create_context_headless(glesh_context* context,
+		int window_width,
+		int window_height,
+		int depth)
+{
+	if(!depth)
+	{
+		context->depth = 32;
+	}
+	else
+	{
+		context->depth = depth;
+	}
+
+	if(window_width == 0)
+	{
+		context->width = HEADLESS_DEFAULT_WIDTH;
+	}
+	else
+	{
+		context->width = window_width;
+	}
+
+	if(window_height == 0)
+	{
+		context->height = HEADLESS_DEFAULT_HEIGHT;
+	}
+	else
+	{
+		context->height = window_height;
+	}
+
+	context->egl_native_display = EGL_DEFAULT_DISPLAY;
+	context->egl_native_window = (EGLNativeWindowType)0;
+
+	return 1;
+}
+
+int glesh_destroy_context_headless(glesh_context* context)
+{
+	UNUSED_PARAM(context);
+	return 1;
+}
+
+int glesh_main_loop_step_headless(glesh_context *context)
+{
+	UNUSED_PARAM(context);
+
+	/**
+	 * eglSwapBuffers() is a no-op on pbuffers, so nothing would otherwise
+	 * wait for the frame to be rendered.
+	 **/
+	glFinish();
+	return 1;
+}
+
+EGLDisplay glesh_get_display_headless(glesh_context *context)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+	const char* client_extensions;
+
+	/* Client extensions are only available with EGL 1.5 or EGL_EXT_client_extensions */
+	client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if(client_extensions &&
+		strstr(client_extensions, "EGL_MESA_platform_surfaceless"))
+	{
+		get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+			eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if(get_platform_display)
+		{
+			BLTS_DEBUG("Using EGL_MESA_platform_surfaceless\n");
+			return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+				EGL_DEFAULT_DISPLAY, NULL);
+		}
+	}
+
+	return eglGetDisplay(context->egl_native_display);
+}
+
+EGLSurface glesh_create_surface_headless(glesh_context *context,
+		EGLConfig config)
+{
+	EGLint pbuffer_attr[] =
+	{
+		EGL_WIDTH, context->width,
+		EGL_HEIGHT, context->height,
+		EGL_NONE
+	};
+
+	return eglCreatePbufferSurface(context->egl_display, config,
+		pbuffer_attr);
+}
+
+struct glesh_ws_context_functions glesh_headless = {
+	glesh_create_context_headless,
+	glesh_destroy_context_headless,
+	glesh_main_loop_step_headless,
+	glesh_get_display_headless,
+	glesh_create_surface_headless,
+	headless_config_attr,
+	NULL,
+	NULL,
+	NULL,
+};
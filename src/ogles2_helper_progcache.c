@@ -0,0 +1,293 @@
+/* ogles2_helper_progcache.c -- On-disk cache of linked GLES2 programs
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "ogles2_helper.h"
+#include <GLES2/gl2ext.h>
+
+#define CACHE_MAGIC 0x31435047 /* "GPC1" */
+
+typedef struct
+{
+	unsigned int magic;
+	unsigned int format; /* as returned by glGetProgramBinaryOES */
+	unsigned int length;
+	unsigned int reserved;
+	unsigned long long key; /* guards against renamed files */
+} cache_header;
+
+/* Directory of the cache files, NULL if disabled */
+static const char* cache_dir = NULL;
+
+static glesh_program_timing program_timing;
+
+#ifdef GL_OES_get_program_binary
+static PFNGLGETPROGRAMBINARYOESPROC get_program_binary = NULL;
+static PFNGLPROGRAMBINARYOESPROC program_binary = NULL;
+#endif
+
+void glesh_set_program_cache(const char* dir)
+{
+	cache_dir = dir;
+}
+
+const glesh_program_timing* glesh_get_program_timing()
+{
+	return &program_timing;
+}
+
+void glesh_reset_program_timing()
+{
+	memset(&program_timing, 0, sizeof(program_timing));
+}
+
+#ifdef GL_OES_get_program_binary
+
+static int cache_supported()
+{
+	GLint num_formats = 0;
+
+	if(!glesh_gl_extension_supported("GL_OES_get_program_binary"))
+	{
+		return 0;
+	}
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &num_formats);
+	if(num_formats <= 0)
+	{
+		return 0;
+	}
+
+	if(!get_program_binary)
+	{
+		get_program_binary = (PFNGLGETPROGRAMBINARYOESPROC)
+			eglGetProcAddress("glGetProgramBinaryOES");
+		program_binary = (PFNGLPROGRAMBINARYOESPROC)
+			eglGetProcAddress("glProgramBinaryOES");
+	}
+
+	return get_program_binary && program_binary;
+}
+
+static unsigned long long fnv1a(unsigned long long hash, const char* str)
+{
+	/* The terminating zero is included, so that sources of two programs
+	 * can not run into each other */
+	do
+	{
+		hash ^= (unsigned char)*str;
+		hash *= 1099511628211ull;
+	} while(*str++);
+
+	return hash;
+}
+
+/* Binaries are only valid for the driver that made them */
+static unsigned long long program_key(const char* vertex_shader_src,
+	const char* fragment_shader_src)
+{
+	unsigned long long hash = 14695981039346656037ull;
+
+	hash = fnv1a(hash, (const char*)glGetString(GL_VENDOR));
+	hash = fnv1a(hash, (const char*)glGetString(GL_RENDERER));
+	hash = fnv1a(hash, (const char*)glGetString(GL_VERSION));
+	hash = fnv1a(hash, vertex_shader_src);
+	hash = fnv1a(hash, fragment_shader_src);
+
+	return hash;
+}
+
+static void cache_filename(char* filename, size_t size,
+	unsigned long long key, const char* suffix)
+{
+	snprintf(filename, size, "%s/%016llx%s", cache_dir, key, suffix);
+}
+
+static GLuint load_cached_program(unsigned long long key)
+{
+	char filename[PATH_MAX];
+	cache_header header;
+	void* binary;
+	GLuint program;
+	GLint linked = 0;
+	FILE* fp;
+
+	cache_filename(filename, sizeof(filename), key, ".bin");
+	fp = fopen(filename, "rb");
+	if(!fp)
+	{
+		return 0;
+	}
+
+	if(fread(&header, sizeof(header), 1, fp) != 1 ||
+		header.magic != CACHE_MAGIC || header.key != key || !header.length)
+	{
+		BLTS_DEBUG("Ignoring invalid program cache file %s\n", filename);
+		fclose(fp);
+		return 0;
+	}
+
+	binary = malloc(header.length);
+	if(!binary)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+		fclose(fp);
+		return 0;
+	}
+
+	if(fread(binary, header.length, 1, fp) != 1)
+	{
+		BLTS_DEBUG("Truncated program cache file %s\n", filename);
+		free(binary);
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+
+	program = glCreateProgram();
+	if(program)
+	{
+		program_binary(program, header.format, binary, header.length);
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if(!linked)
+		{
+			/* E.g. the driver was updated without changing its strings */
+			BLTS_DEBUG("Program cache file %s rejected by the driver\n",
+				filename);
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	free(binary);
+
+	return program;
+}
+
+static void store_program(unsigned long long key, GLuint program)
+{
+	char filename[PATH_MAX];
+	char tmp_filename[PATH_MAX];
+	char suffix[32];
+	cache_header header;
+	GLint length = 0;
+	GLenum format;
+	void* binary;
+	FILE* fp;
+	int ok;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+	if(length <= 0)
+	{
+		return;
+	}
+
+	binary = malloc(length);
+	if(!binary)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+		return;
+	}
+	get_program_binary(program, length, &length, &format, binary);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CACHE_MAGIC;
+	header.format = format;
+	header.length = length;
+	header.key = key;
+
+	if(mkdir(cache_dir, 0755) && errno != EEXIST)
+	{
+		BLTS_LOGGED_PERROR("mkdir");
+		free(binary);
+		return;
+	}
+
+	/* Write aside and rename, so that a concurrent or interrupted run
+	 * never sees a partial file */
+	sprintf(suffix, ".tmp%d", (int)getpid());
+	cache_filename(tmp_filename, sizeof(tmp_filename), key, suffix);
+	cache_filename(filename, sizeof(filename), key, ".bin");
+
+	fp = fopen(tmp_filename, "wb");
+	if(!fp)
+	{
+		BLTS_LOGGED_PERROR("fopen");
+		free(binary);
+		return;
+	}
+	ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		fwrite(binary, length, 1, fp) == 1;
+	ok = !fclose(fp) && ok;
+	free(binary);
+
+	if(!ok || rename(tmp_filename, filename))
+	{
+		BLTS_ERROR("Failed to write program cache file %s\n", filename);
+		unlink(tmp_filename);
+	}
+}
+
+#endif /* GL_OES_get_program_binary */
+
+/* Like glesh_compile_program(), but with a cache directory set the
+ * program binary is reused across runs when the driver supports
+ * GL_OES_get_program_binary. */
+int glesh_load_program(const char *vertex_shader_src,
+	const char *fragment_shader_src)
+{
+	unsigned long long key = 0;
+	GLuint program;
+	double start = glesh_time();
+
+#ifdef GL_OES_get_program_binary
+	if(cache_dir && cache_supported())
+	{
+		key = program_key(vertex_shader_src, fragment_shader_src);
+		program = load_cached_program(key);
+		if(program)
+		{
+			program_timing.cached++;
+			program_timing.cache_time += glesh_time() - start;
+			return program;
+		}
+	}
+#endif
+
+	program = glesh_compile_program(vertex_shader_src, fragment_shader_src);
+	if(!program)
+	{
+		return 0;
+	}
+	program_timing.compiled++;
+	program_timing.compile_time += glesh_time() - start;
+
+#ifdef GL_OES_get_program_binary
+	if(key)
+	{
+		store_program(key, program);
+	}
+#endif
+
+	return program;
+}
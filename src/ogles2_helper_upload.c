@@ -0,0 +1,748 @@
+/* ogles2_helper_upload.c -- Streaming texture uploads off the render thread
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "ogles2_helper.h"
+
+/* Every frame of a stream goes through the same steps:
+ *
+ * 1. The render thread asks for it with glesh_upload_request().
+ * 2. The producer thread writes it to the next free staging buffer of the
+ *    ring.
+ * 3. The uploader thread waits until the render thread has stopped reading
+ *    one of the stream's textures, copies the frame into it with
+ *    glTexSubImage2D and sets a fence behind the copy.
+ * 4. glesh_upload_acquire() on the render thread switches to the texture
+ *    once its fence has signaled, and sets a fence for the texture it
+ *    stopped drawing from.
+ *
+ * So neither thread waits for the other's GPU work, and textures are
+ * never re-specified after glesh_uploader_start().
+ *
+ * GLESH_UPLOAD_DMABUF has no copy at all: the textures are imported from
+ * dma-bufs and the producer writes each frame straight into the buffer
+ * of a texture the GPU is done with. */
+
+static PFNEGLCREATESYNCKHRPROC create_sync = NULL;
+static PFNEGLDESTROYSYNCKHRPROC destroy_sync = NULL;
+static PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync = NULL;
+
+static int texel_size(GLenum format, GLenum type)
+{
+	if(type == GL_UNSIGNED_SHORT_5_6_5 || type == GL_UNSIGNED_SHORT_4_4_4_4 ||
+		type == GL_UNSIGNED_SHORT_5_5_5_1)
+	{
+		return 2;
+	}
+
+	switch(format)
+	{
+	case GL_RGBA:
+		return 4;
+	case GL_RGB:
+		return 3;
+	case GL_LUMINANCE_ALPHA:
+		return 2;
+	case GL_LUMINANCE:
+	case GL_ALPHA:
+		return 1;
+	}
+
+	return 0;
+}
+
+static int frame_stride(const glesh_uploader* uploader)
+{
+	return texel_size(uploader->format, uploader->type) * uploader->width;
+}
+
+static int init_fence_sync(glesh_context* context)
+{
+	if(!glesh_egl_extension_supported(context, "EGL_KHR_fence_sync"))
+	{
+		return 0;
+	}
+
+	if(!create_sync)
+	{
+		create_sync = (PFNEGLCREATESYNCKHRPROC)
+			eglGetProcAddress("eglCreateSyncKHR");
+		destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+			eglGetProcAddress("eglDestroySyncKHR");
+		client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)
+			eglGetProcAddress("eglClientWaitSyncKHR");
+	}
+
+	return create_sync && destroy_sync && client_wait_sync;
+}
+
+static int dmabuf_supported(glesh_context* context)
+{
+	glesh_dmabuf_allocator allocator;
+	int ret = glesh_dmabuf_init(context, &allocator);
+
+	glesh_dmabuf_allocator_destroy(&allocator);
+
+	return ret;
+}
+
+int glesh_upload_mode_supported(glesh_context* context,
+	enum glesh_upload_mode mode)
+{
+	switch(mode)
+	{
+	case GLESH_UPLOAD_SYNC:
+		return 1;
+	case GLESH_UPLOAD_THREADED:
+		return glesh_shared_context_supported(context) &&
+			init_fence_sync(context);
+	case GLESH_UPLOAD_DMABUF:
+		return init_fence_sync(context) && dmabuf_supported(context);
+	}
+
+	return 0;
+}
+
+static EGLSyncKHR fence(glesh_uploader* uploader)
+{
+	EGLSyncKHR sync = create_sync(uploader->context->egl_display,
+		EGL_SYNC_FENCE_KHR, NULL);
+
+	if(sync == EGL_NO_SYNC_KHR)
+	{
+		/* Falls back to waiting for the whole context */
+		glesh_report_eglerror("eglCreateSyncKHR");
+		glFinish();
+	}
+
+	return sync;
+}
+
+static void destroy_fence(glesh_uploader* uploader, EGLSyncKHR sync)
+{
+	if(sync != EGL_NO_SYNC_KHR)
+	{
+		destroy_sync(uploader->context->egl_display, sync);
+	}
+}
+
+static void upload(glesh_uploader* uploader, GLuint tex_id, const void* data)
+{
+	double start = glesh_time();
+
+	glBindTexture(GL_TEXTURE_2D, tex_id);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, uploader->width, uploader->height,
+		uploader->format, uploader->type, data);
+
+	uploader->upload_time += glesh_time() - start;
+	uploader->frames_uploaded++;
+}
+
+/* A texture of the stream that is neither drawn from nor waiting to be */
+static int free_buffer(glesh_uploader* uploader, glesh_upload_stream* stream)
+{
+	int t;
+
+	for(t = 0; t < uploader->num_buffers; t++)
+	{
+		if(t != stream->front && t != stream->ready && t != stream->writing)
+		{
+			return t;
+		}
+	}
+
+	return -1;
+}
+
+/* The caller holds the lock */
+static int next_requested_stream(glesh_uploader* uploader)
+{
+	glesh_upload_stream* stream;
+	int t, s;
+
+	for(t = 0; t < uploader->num_streams; t++)
+	{
+		s = (uploader->next_stream + t) % uploader->num_streams;
+		stream = &uploader->streams[s];
+		if(stream->produced != stream->requested)
+		{
+			uploader->next_stream = (s + 1) % uploader->num_streams;
+			return s;
+		}
+	}
+
+	return -1;
+}
+
+static void* producer_thread(void* arg)
+{
+	glesh_uploader* uploader = arg;
+	glesh_upload_slot* slot;
+	unsigned int frame;
+	int s;
+
+	pthread_mutex_lock(&uploader->lock);
+	for(;;)
+	{
+		s = -1;
+		if(uploader->filled - uploader->uploaded < GLESH_UPLOAD_RING_SIZE)
+		{
+			s = next_requested_stream(uploader);
+		}
+		if(uploader->stop)
+		{
+			break;
+		}
+		if(s < 0)
+		{
+			pthread_cond_wait(&uploader->cond, &uploader->lock);
+			continue;
+		}
+
+		/* Only this thread fills, the slot stays free while unlocked */
+		slot = &uploader->slots[uploader->filled % GLESH_UPLOAD_RING_SIZE];
+		frame = uploader->streams[s].produced++;
+		pthread_mutex_unlock(&uploader->lock);
+
+		uploader->producer(uploader->user_ptr, s, frame, slot->data,
+			frame_stride(uploader));
+
+		pthread_mutex_lock(&uploader->lock);
+		slot->stream = s;
+		slot->frame = frame;
+		uploader->filled++;
+		pthread_cond_broadcast(&uploader->cond);
+	}
+	pthread_mutex_unlock(&uploader->lock);
+
+	return NULL;
+}
+
+static void* uploader_thread(void* arg)
+{
+	glesh_uploader* uploader = arg;
+	EGLDisplay display = uploader->context->egl_display;
+	glesh_upload_stream* stream;
+	glesh_upload_slot* slot;
+	EGLSyncKHR sync;
+	int buffer;
+
+	if(!eglMakeCurrent(display, uploader->egl_surface, uploader->egl_surface,
+		uploader->egl_context))
+	{
+		glesh_report_eglerror("eglMakeCurrent");
+		pthread_mutex_lock(&uploader->lock);
+		uploader->uploader_state = -1;
+		pthread_cond_broadcast(&uploader->cond);
+		pthread_mutex_unlock(&uploader->lock);
+		eglReleaseThread();
+		return NULL;
+	}
+
+	pthread_mutex_lock(&uploader->lock);
+	uploader->uploader_state = 1;
+	pthread_cond_broadcast(&uploader->cond);
+	for(;;)
+	{
+		buffer = -1;
+		slot = NULL;
+		stream = NULL;
+		if(uploader->uploaded != uploader->filled)
+		{
+			slot = &uploader->slots[uploader->uploaded %
+				GLESH_UPLOAD_RING_SIZE];
+			stream = &uploader->streams[slot->stream];
+			/* Only with double buffering while a frame is ready */
+			buffer = free_buffer(uploader, stream);
+		}
+		if(uploader->stop)
+		{
+			break;
+		}
+		if(buffer < 0)
+		{
+			pthread_cond_wait(&uploader->cond, &uploader->lock);
+			continue;
+		}
+
+		stream->writing = buffer;
+		sync = stream->fences[buffer];
+		stream->fences[buffer] = EGL_NO_SYNC_KHR;
+		pthread_mutex_unlock(&uploader->lock);
+
+		/* Until the render thread's draws from the texture are done */
+		if(sync != EGL_NO_SYNC_KHR)
+		{
+			client_wait_sync(display, sync, 0, EGL_FOREVER_KHR);
+			destroy_fence(uploader, sync);
+		}
+
+		upload(uploader, stream->tex_ids[buffer], slot->data);
+		sync = fence(uploader);
+		glFlush();
+
+		pthread_mutex_lock(&uploader->lock);
+		if(stream->ready >= 0)
+		{
+			/* The render thread did not keep up, the older frame is
+			 * never shown */
+			destroy_fence(uploader, stream->fences[stream->ready]);
+			stream->fences[stream->ready] = EGL_NO_SYNC_KHR;
+			uploader->frames_dropped++;
+		}
+		stream->ready = buffer;
+		stream->fences[buffer] = sync;
+		stream->writing = -1;
+		uploader->uploaded++;
+		pthread_cond_broadcast(&uploader->cond);
+	}
+	pthread_mutex_unlock(&uploader->lock);
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglReleaseThread();
+
+	return NULL;
+}
+
+static int start_threads(glesh_uploader* uploader)
+{
+	int ret;
+
+	if(!glesh_create_shared_context(uploader->context, &uploader->egl_context,
+		&uploader->egl_surface))
+	{
+		return 0;
+	}
+
+	if(pthread_create(&uploader->threads[0], NULL, uploader_thread,
+		uploader))
+	{
+		BLTS_LOGGED_PERROR("pthread_create");
+		return 0;
+	}
+	uploader->num_threads++;
+
+	pthread_mutex_lock(&uploader->lock);
+	while(!uploader->uploader_state)
+	{
+		pthread_cond_wait(&uploader->cond, &uploader->lock);
+	}
+	ret = uploader->uploader_state > 0;
+	pthread_mutex_unlock(&uploader->lock);
+	if(!ret)
+	{
+		return 0;
+	}
+
+	if(pthread_create(&uploader->threads[1], NULL, producer_thread,
+		uploader))
+	{
+		BLTS_LOGGED_PERROR("pthread_create");
+		return 0;
+	}
+	uploader->num_threads++;
+
+	return 1;
+}
+
+/* Textures get their storage from dma-bufs instead of glTexImage2D */
+static int import_dmabufs(glesh_uploader* uploader,
+	glesh_upload_stream* stream, int stream_index)
+{
+	glesh_dmabuf* buffer;
+	double start;
+	void* dst;
+	int t;
+
+	for(t = 0; t < uploader->num_buffers; t++)
+	{
+		buffer = &stream->dmabufs[t];
+		start = glesh_time();
+		if(!glesh_dmabuf_create(uploader->context, &uploader->allocator,
+			buffer, uploader->width, uploader->height) ||
+			!glesh_dmabuf_bind(buffer, stream->tex_ids[t]))
+		{
+			return 0;
+		}
+		uploader->import_time += glesh_time() - start;
+		uploader->imports++;
+	}
+
+	buffer = &stream->dmabufs[0];
+	dst = glesh_dmabuf_begin_write(buffer);
+	if(!dst)
+	{
+		return 0;
+	}
+	uploader->producer(uploader->user_ptr, stream_index, 0, dst,
+		buffer->stride);
+	glesh_dmabuf_end_write(buffer);
+	stream->texture.eglimage = buffer->image;
+
+	return 1;
+}
+
+/* The first frame of each stream is produced and uploaded here, the
+ * others on request. Textures are specified once with all their
+ * parameters; later frames only replace the texels. */
+static int init_streams(glesh_uploader* uploader)
+{
+	glesh_upload_stream* stream;
+	void* frame;
+	int s, t;
+
+	frame = glesh_staging_buffer(&uploader->context->staging,
+		uploader->frame_size);
+	if(!frame)
+	{
+		return 0;
+	}
+
+	for(s = 0; s < uploader->num_streams; s++)
+	{
+		stream = &uploader->streams[s];
+		glGenTextures(uploader->num_buffers, stream->tex_ids);
+		stream->texture.eglimage = EGL_NO_IMAGE_KHR;
+		if(uploader->mode == GLESH_UPLOAD_DMABUF)
+		{
+			if(!import_dmabufs(uploader, stream, s))
+			{
+				return 0;
+			}
+		}
+		else
+		{
+			uploader->producer(uploader->user_ptr, s, 0, frame,
+				frame_stride(uploader));
+		}
+
+		for(t = 0; t < uploader->num_buffers; t++)
+		{
+			glBindTexture(GL_TEXTURE_2D, stream->tex_ids[t]);
+			if(uploader->mode != GLESH_UPLOAD_DMABUF)
+			{
+				glTexImage2D(GL_TEXTURE_2D, 0, uploader->format,
+					uploader->width, uploader->height, 0, uploader->format,
+					uploader->type, t ? NULL : frame);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			stream->fences[t] = EGL_NO_SYNC_KHR;
+		}
+		if(glGetError() != GL_NO_ERROR)
+		{
+			BLTS_ERROR("Failed to create stream textures\n");
+			return 0;
+		}
+
+		stream->front = 0;
+		stream->ready = -1;
+		stream->writing = -1;
+		stream->requested = 1;
+		stream->produced = 1;
+		stream->texture.tex_id = stream->tex_ids[0];
+		stream->texture.width = uploader->width;
+		stream->texture.height = uploader->height;
+	}
+
+	/* Shared contexts see the textures only after they are complete */
+	glFinish();
+
+	return 1;
+}
+
+/* Streams of num_buffers textures of width x height texels each. With
+ * GLESH_UPLOAD_THREADED the producer is called from another thread and
+ * must not use GL. */
+int glesh_uploader_start(glesh_uploader* uploader, glesh_context* context,
+	enum glesh_upload_mode mode, int num_streams, int num_buffers,
+	int width, int height, GLenum format, GLenum type,
+	glesh_frame_producer producer, void* user_ptr)
+{
+	int t;
+
+	memset(uploader, 0, sizeof(glesh_uploader));
+	uploader->mode = mode;
+	uploader->context = context;
+	uploader->format = format;
+	uploader->type = type;
+	uploader->width = width;
+	uploader->height = height;
+	uploader->frame_size = (size_t)width * height * texel_size(format, type);
+	uploader->num_buffers = num_buffers;
+	uploader->num_streams = num_streams;
+	uploader->producer = producer;
+	uploader->user_ptr = user_ptr;
+	uploader->egl_context = EGL_NO_CONTEXT;
+	uploader->egl_surface = EGL_NO_SURFACE;
+	uploader->allocator.fd = -1;
+	pthread_mutex_init(&uploader->lock, NULL);
+	pthread_cond_init(&uploader->cond, NULL);
+
+	if(num_streams <= 0 || num_streams > GLESH_MAX_UPLOAD_STREAMS ||
+		num_buffers < 2 || num_buffers > GLESH_MAX_UPLOAD_BUFFERS ||
+		!uploader->frame_size)
+	{
+		BLTS_ERROR("Invalid upload stream parameters\n");
+		goto error;
+	}
+
+	if(!glesh_upload_mode_supported(context, mode))
+	{
+		BLTS_ERROR("Upload mode %d not supported\n", mode);
+		goto error;
+	}
+
+	if(mode == GLESH_UPLOAD_DMABUF)
+	{
+		if(format != GL_RGBA || type != GL_UNSIGNED_BYTE)
+		{
+			BLTS_ERROR("dma-buf streams must be GL_RGBA\n");
+			goto error;
+		}
+		if(!glesh_dmabuf_init(context, &uploader->allocator))
+		{
+			goto error;
+		}
+	}
+
+	if(!init_streams(uploader))
+	{
+		goto error;
+	}
+
+	if(mode == GLESH_UPLOAD_THREADED)
+	{
+		for(t = 0; t < GLESH_UPLOAD_RING_SIZE; t++)
+		{
+			uploader->slots[t].data = malloc(uploader->frame_size);
+			if(!uploader->slots[t].data)
+			{
+				BLTS_LOGGED_PERROR("malloc");
+				goto error;
+			}
+		}
+
+		if(!start_threads(uploader))
+		{
+			goto error;
+		}
+	}
+
+	return 1;
+
+error:
+	glesh_uploader_destroy(uploader);
+	return 0;
+}
+
+/* The frame is written where the GPU reads it, once the GPU is done with
+ * the frame the buffer held before */
+static int write_dmabuf(glesh_uploader* uploader,
+	glesh_upload_stream* stream, int stream_index, int buffer)
+{
+	glesh_dmabuf* dmabuf = &stream->dmabufs[buffer];
+	double start = glesh_time();
+	void* dst;
+
+	if(stream->fences[buffer] != EGL_NO_SYNC_KHR)
+	{
+		client_wait_sync(uploader->context->egl_display,
+			stream->fences[buffer], EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+			EGL_FOREVER_KHR);
+		destroy_fence(uploader, stream->fences[buffer]);
+		stream->fences[buffer] = EGL_NO_SYNC_KHR;
+	}
+
+	dst = glesh_dmabuf_begin_write(dmabuf);
+	if(!dst)
+	{
+		return 0;
+	}
+	uploader->producer(uploader->user_ptr, stream_index, stream->produced++,
+		dst, dmabuf->stride);
+	glesh_dmabuf_end_write(dmabuf);
+
+	/* Covers all draws from the texture shown until now */
+	stream->fences[stream->front] = fence(uploader);
+	stream->texture.eglimage = dmabuf->image;
+
+	uploader->upload_time += glesh_time() - start;
+	uploader->frames_uploaded++;
+
+	return 1;
+}
+
+/* Asks for the next frame of the stream. Returns at once with
+ * GLESH_UPLOAD_THREADED, the frame is shown by a later
+ * glesh_upload_acquire(). */
+int glesh_upload_request(glesh_uploader* uploader, int stream_index)
+{
+	glesh_upload_stream* stream = &uploader->streams[stream_index];
+	double start = glesh_time();
+	void* frame;
+	int buffer;
+
+	if(uploader->mode == GLESH_UPLOAD_THREADED)
+	{
+		pthread_mutex_lock(&uploader->lock);
+		stream->requested++;
+		pthread_cond_broadcast(&uploader->cond);
+		pthread_mutex_unlock(&uploader->lock);
+		uploader->render_thread_time += glesh_time() - start;
+		return 1;
+	}
+
+	/* Not the texture the previous frame drew from, so the driver need
+	 * not wait for it or copy it */
+	buffer = (stream->front + 1) % uploader->num_buffers;
+
+	if(uploader->mode == GLESH_UPLOAD_DMABUF)
+	{
+		if(!write_dmabuf(uploader, stream, stream_index, buffer))
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		frame = glesh_staging_buffer(&uploader->context->staging,
+			uploader->frame_size);
+		if(!frame)
+		{
+			return 0;
+		}
+		uploader->producer(uploader->user_ptr, stream_index,
+			stream->produced++, frame, frame_stride(uploader));
+		upload(uploader, stream->tex_ids[buffer], frame);
+	}
+	stream->requested++;
+
+	stream->front = buffer;
+	stream->texture.tex_id = stream->tex_ids[buffer];
+	stream->changed = 1;
+	uploader->frames_shown++;
+
+	uploader->render_thread_time += glesh_time() - start;
+
+	return 1;
+}
+
+/* Switches the stream to its newest uploaded frame if the upload has
+ * finished. Never blocks. Returns 1 if the texture changed. */
+int glesh_upload_acquire(glesh_uploader* uploader, int stream_index)
+{
+	glesh_upload_stream* stream = &uploader->streams[stream_index];
+	double start = glesh_time();
+	EGLSyncKHR sync;
+	EGLint status;
+	int changed;
+
+	if(uploader->mode == GLESH_UPLOAD_THREADED)
+	{
+		pthread_mutex_lock(&uploader->lock);
+		if(stream->ready >= 0)
+		{
+			sync = stream->fences[stream->ready];
+			status = sync == EGL_NO_SYNC_KHR ? EGL_CONDITION_SATISFIED_KHR :
+				client_wait_sync(uploader->context->egl_display, sync, 0, 0);
+			if(status == EGL_CONDITION_SATISFIED_KHR)
+			{
+				destroy_fence(uploader, sync);
+				stream->fences[stream->ready] = EGL_NO_SYNC_KHR;
+				/* Covers all draws from the old texture so far */
+				stream->fences[stream->front] = fence(uploader);
+				stream->front = stream->ready;
+				stream->ready = -1;
+				stream->texture.tex_id = stream->tex_ids[stream->front];
+				stream->changed = 1;
+				uploader->frames_shown++;
+				pthread_cond_broadcast(&uploader->cond);
+			}
+		}
+		pthread_mutex_unlock(&uploader->lock);
+	}
+
+	changed = stream->changed;
+	stream->changed = 0;
+	uploader->render_thread_time += glesh_time() - start;
+
+	return changed;
+}
+
+glesh_texture* glesh_upload_texture(glesh_uploader* uploader,
+	int stream_index)
+{
+	return &uploader->streams[stream_index].texture;
+}
+
+/* Must be called on the render thread, with the render context current */
+void glesh_uploader_destroy(glesh_uploader* uploader)
+{
+	glesh_upload_stream* stream;
+	int s, t;
+
+	if(!uploader->context)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&uploader->lock);
+	uploader->stop = 1;
+	pthread_cond_broadcast(&uploader->cond);
+	pthread_mutex_unlock(&uploader->lock);
+	for(t = 0; t < uploader->num_threads; t++)
+	{
+		pthread_join(uploader->threads[t], NULL);
+	}
+	glesh_destroy_shared_context(uploader->context, uploader->egl_context,
+		uploader->egl_surface);
+
+	for(s = 0; s < uploader->num_streams; s++)
+	{
+		stream = &uploader->streams[s];
+		for(t = 0; t < uploader->num_buffers; t++)
+		{
+			if(stream->fences[t] != EGL_NO_SYNC_KHR)
+			{
+				destroy_fence(uploader, stream->fences[t]);
+			}
+			if(stream->dmabufs[t].image != EGL_NO_IMAGE_KHR)
+			{
+				glesh_dmabuf_destroy(uploader->context, &stream->dmabufs[t]);
+			}
+		}
+		/* Unused names are ignored */
+		glDeleteTextures(uploader->num_buffers, stream->tex_ids);
+	}
+	if(uploader->mode == GLESH_UPLOAD_DMABUF)
+	{
+		glesh_dmabuf_allocator_destroy(&uploader->allocator);
+	}
+
+	for(t = 0; t < GLESH_UPLOAD_RING_SIZE; t++)
+	{
+		free(uploader->slots[t].data);
+	}
+	pthread_cond_destroy(&uploader->cond);
+	pthread_mutex_destroy(&uploader->lock);
+	memset(uploader, 0, sizeof(glesh_uploader));
+}
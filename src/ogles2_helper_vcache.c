@@ -0,0 +1,375 @@
+/* ogles2_helper_vcache.c -- Post-transform vertex cache optimization
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ogles2_helper.h"
+
+/* Triangle ordering follows Tom Forsyth's "Linear-Speed Vertex Cache
+ * Optimisation": vertices are scored by their position in a simulated LRU
+ * cache and by how many unprocessed triangles still use them, and the
+ * triangle with the highest total score is emitted next. */
+#define VCACHE_SIZE 32
+#define VCACHE_DECAY_POWER 1.5f
+#define VCACHE_LAST_TRI_SCORE 0.75f
+#define VCACHE_VALENCE_SCALE 2.0f
+#define VCACHE_VALENCE_POWER 0.5f
+
+typedef struct
+{
+	float score;
+	int cache_pos; /* -1 if not in cache */
+	int num_tris; /* triangles not yet emitted */
+	int tri_start; /* into the adjacency list */
+} vcache_vertex;
+
+static float vertex_score(const vcache_vertex* v)
+{
+	float score = 0.0f;
+
+	if(!v->num_tris)
+	{
+		return -1.0f;
+	}
+
+	if(v->cache_pos >= 0)
+	{
+		if(v->cache_pos < 3)
+		{
+			/* Used by the last triangle, fixed score so that the ordering
+			 * does not prefer strips over fans */
+			score = VCACHE_LAST_TRI_SCORE;
+		}
+		else
+		{
+			score = powf(1.0f - (float)(v->cache_pos - 3) /
+				(float)(VCACHE_SIZE - 3), VCACHE_DECAY_POWER);
+		}
+	}
+
+	return score + VCACHE_VALENCE_SCALE *
+		powf((float)v->num_tris, -VCACHE_VALENCE_POWER);
+}
+
+static int reorder_triangles(glesh_object* object)
+{
+	int num_tris = object->num_indices / 3;
+	vcache_vertex* verts;
+	int* adjacency;
+	char* emitted;
+	GLuint* out;
+	int cache[VCACHE_SIZE + 3];
+	int new_cache[VCACHE_SIZE + 3];
+	int cache_used = 0;
+	int tri_verts;
+	float best_score;
+	int best_tri = -1;
+	int scan_pos = 0;
+	int num_out = 0;
+	int i, t, v, n;
+
+	verts = calloc(object->num_vertices, sizeof(*verts));
+	adjacency = malloc(sizeof(int) * object->num_indices);
+	emitted = calloc(num_tris, 1);
+	out = malloc(sizeof(GLuint) * object->num_indices);
+	if(!verts || !adjacency || !emitted || !out)
+	{
+		BLTS_ERROR("Failed to allocate vertex cache optimizer data\n");
+		free(verts);
+		free(adjacency);
+		free(emitted);
+		free(out);
+		return 0;
+	}
+
+	for(i = 0; i < object->num_indices; i++)
+	{
+		verts[object->indices[i]].num_tris++;
+	}
+
+	for(v = 0, n = 0; v < object->num_vertices; v++)
+	{
+		verts[v].tri_start = n;
+		n += verts[v].num_tris;
+		verts[v].num_tris = 0;
+		verts[v].cache_pos = -1;
+	}
+
+	for(i = 0; i < object->num_indices; i++)
+	{
+		vcache_vertex* vert = &verts[object->indices[i]];
+		adjacency[vert->tri_start + vert->num_tris++] = i / 3;
+	}
+
+	for(v = 0; v < object->num_vertices; v++)
+	{
+		verts[v].score = vertex_score(&verts[v]);
+	}
+
+	while(num_out < num_tris)
+	{
+		if(best_tri < 0)
+		{
+			/* Nothing in the cache is connected to unprocessed triangles;
+			 * continue from the next one in the original order */
+			while(emitted[scan_pos])
+			{
+				scan_pos++;
+			}
+			best_tri = scan_pos;
+		}
+
+		emitted[best_tri] = 1;
+		n = 0;
+
+		for(i = 0; i < 3; i++)
+		{
+			int idx = object->indices[best_tri * 3 + i];
+			vcache_vertex* vert = &verts[idx];
+			int* tris = &adjacency[vert->tri_start];
+
+			out[num_out * 3 + i] = idx;
+
+			/* Remove the triangle from the vertex's active list */
+			for(t = 0; t < vert->num_tris; t++)
+			{
+				if(tris[t] == best_tri)
+				{
+					tris[t] = tris[vert->num_tris - 1];
+					vert->num_tris--;
+					break;
+				}
+			}
+
+			if(!n || (new_cache[0] != idx && (n < 2 || new_cache[1] != idx)))
+			{
+				new_cache[n++] = idx;
+			}
+		}
+		num_out++;
+
+		/* The emitted triangle moves to the front and the rest is shifted
+		 * back; entries past VCACHE_SIZE are evicted but still rescored */
+		tri_verts = n;
+		for(i = 0; i < cache_used; i++)
+		{
+			for(t = 0; t < tri_verts; t++)
+			{
+				if(new_cache[t] == cache[i])
+				{
+					break;
+				}
+			}
+			if(t == tri_verts)
+			{
+				new_cache[n++] = cache[i];
+			}
+		}
+
+		for(i = 0; i < n; i++)
+		{
+			vcache_vertex* vert = &verts[new_cache[i]];
+
+			vert->cache_pos = (i < VCACHE_SIZE) ? i : -1;
+			vert->score = vertex_score(vert);
+			cache[i] = new_cache[i];
+		}
+		cache_used = GLESH_MIN(n, VCACHE_SIZE);
+
+		/* Rescore the triangles touching the cache and pick the best */
+		best_score = -1.0f;
+		best_tri = -1;
+		for(i = 0; i < n; i++)
+		{
+			vcache_vertex* vert = &verts[new_cache[i]];
+
+			for(t = 0; t < vert->num_tris; t++)
+			{
+				int tri = adjacency[vert->tri_start + t];
+				float score = verts[object->indices[tri * 3 + 0]].score +
+					verts[object->indices[tri * 3 + 1]].score +
+					verts[object->indices[tri * 3 + 2]].score;
+
+				if(score > best_score)
+				{
+					best_score = score;
+					best_tri = tri;
+				}
+			}
+		}
+	}
+
+	memcpy(object->indices, out, sizeof(GLuint) * object->num_indices);
+
+	free(verts);
+	free(adjacency);
+	free(emitted);
+	free(out);
+
+	return 1;
+}
+
+static int permute_array(GLfloat** array, int components, const int* remap,
+	int num_vertices)
+{
+	GLfloat* reordered;
+	int v;
+
+	if(!*array)
+	{
+		return 1;
+	}
+
+	reordered = malloc(sizeof(GLfloat) * components * num_vertices);
+	if(!reordered)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+		return 0;
+	}
+
+	for(v = 0; v < num_vertices; v++)
+	{
+		memcpy(&reordered[remap[v] * components], &(*array)[v * components],
+			sizeof(GLfloat) * components);
+	}
+
+	/* Copy back rather than swap, the array may live in the context
+	 * arena */
+	memcpy(*array, reordered, sizeof(GLfloat) * components * num_vertices);
+	free(reordered);
+
+	return 1;
+}
+
+/* Renumbers vertices in the order the indices first use them, so that
+ * vertex fetch walks the arrays linearly. */
+static int reorder_vertices(glesh_object* object)
+{
+	int* remap;
+	int next = 0;
+	int i, v;
+
+	remap = malloc(sizeof(int) * object->num_vertices);
+	if(!remap)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+		return 0;
+	}
+
+	for(v = 0; v < object->num_vertices; v++)
+	{
+		remap[v] = -1;
+	}
+
+	for(i = 0; i < object->num_indices; i++)
+	{
+		if(remap[object->indices[i]] < 0)
+		{
+			remap[object->indices[i]] = next++;
+		}
+		object->indices[i] = remap[object->indices[i]];
+	}
+
+	/* Unreferenced vertices go last */
+	for(v = 0; v < object->num_vertices; v++)
+	{
+		if(remap[v] < 0)
+		{
+			remap[v] = next++;
+		}
+	}
+
+	if(!permute_array(&object->vertices, 3, remap, object->num_vertices) ||
+		!permute_array(&object->normals, 3, remap, object->num_vertices) ||
+		!permute_array(&object->texcoords, 2, remap, object->num_vertices))
+	{
+		free(remap);
+		return 0;
+	}
+
+	free(remap);
+
+	return 1;
+}
+
+/* Reorders the triangles of an indexed triangle list for the post-transform
+ * vertex cache and the vertices for fetch locality. Must be called before
+ * glesh_interleave_object() and glesh_create_object_buffers(). */
+int glesh_optimize_vertex_cache(glesh_object* object)
+{
+	if(!object->indices || !object->num_indices)
+	{
+		BLTS_ERROR("glesh_optimize_vertex_cache: Object has no indices\n");
+		return 0;
+	}
+
+	if(object->interleaved || object->vertex_buffer)
+	{
+		BLTS_ERROR("glesh_optimize_vertex_cache: Vertex data already "
+			"uploaded\n");
+		return 0;
+	}
+
+	if(!reorder_triangles(object))
+	{
+		return 0;
+	}
+
+	return reorder_vertices(object);
+}
+
+/* Average cache miss ratio, i.e. vertex shader invocations per triangle,
+ * for a FIFO cache of GLESH_ACMR_CACHE_SIZE entries. 0.5 is the optimum
+ * for a regular grid, 3.0 means no reuse at all. */
+double glesh_object_acmr(const glesh_object* object)
+{
+	unsigned int* timestamps;
+	unsigned int misses = 0;
+	int i;
+
+	if(!object->indices || object->num_indices < 3)
+	{
+		return 0.0;
+	}
+
+	timestamps = calloc(object->num_vertices, sizeof(unsigned int));
+	if(!timestamps)
+	{
+		BLTS_LOGGED_PERROR("calloc");
+		return 0.0;
+	}
+
+	/* A vertex is in the FIFO if fewer than GLESH_ACMR_CACHE_SIZE misses
+	 * have happened since it was inserted. Timestamps start from 1 so that
+	 * 0 means never seen. */
+	for(i = 0; i < object->num_indices; i++)
+	{
+		unsigned int stamp = timestamps[object->indices[i]];
+
+		if(!stamp || misses - stamp >= GLESH_ACMR_CACHE_SIZE)
+		{
+			misses++;
+			timestamps[object->indices[i]] = misses;
+		}
+	}
+
+	free(timestamps);
+
+	return (double)misses / (double)(object->num_indices / 3);
+}
@@ -20,9 +20,233 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <time.h>
 #include <wayland-egl.h>
 
 #include "ogles2_helper.h"
+#ifdef HAVE_PRESENTATION_TIME
+#include "presentation-time-client-protocol.h"
+#endif
+
+/* Frames that may wait for presentation feedback at the same time */
+#define MAX_PENDING_FEEDBACK 16
+
+static int feedback_flags = 0;
+
+void glesh_set_wayland_feedback(int flags)
+{
+	feedback_flags = flags;
+}
+
+#ifdef HAVE_PRESENTATION_TIME
+
+/* Times are in the clock of the presentation timestamps */
+typedef struct
+{
+	struct wp_presentation_feedback *feedback;
+	double frame_start; /* when the frame started, after the previous one */
+	double commit; /* just before eglSwapBuffers */
+} pending_frame;
+
+static pending_frame pending[MAX_PENDING_FEEDBACK];
+static clockid_t presentation_clock = CLOCK_MONOTONIC;
+static int measuring;
+static double next_frame_start;
+
+static double last_present;
+static uint64_t last_seq;
+static int have_seq;
+static uint32_t refresh_ns;
+
+static glesh_frame_stats present_interval_stats;
+static glesh_frame_stats commit_latency_stats;
+static glesh_frame_stats input_latency_stats;
+static unsigned int frames_presented;
+static unsigned int frames_discarded;
+static unsigned int frames_unobserved;
+static unsigned int missed_refreshes;
+
+static double presentation_clock_now()
+{
+	struct timespec ts;
+
+	clock_gettime(presentation_clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static void
+wayland_presentation_listener_clock_id(void *data,
+		struct wp_presentation *wp_presentation,
+		uint32_t clk_id)
+{
+	UNUSED_PARAM(data);
+	UNUSED_PARAM(wp_presentation);
+
+	presentation_clock = clk_id;
+}
+
+static struct wp_presentation_listener
+wayland_presentation_listener = {
+	wayland_presentation_listener_clock_id,
+};
+
+static void
+wayland_feedback_listener_sync_output(void *data,
+		struct wp_presentation_feedback *feedback,
+		struct wl_output *output)
+{
+	UNUSED_PARAM(data);
+	UNUSED_PARAM(feedback);
+	UNUSED_PARAM(output);
+}
+
+static void
+wayland_feedback_listener_presented(void *data,
+		struct wp_presentation_feedback *feedback,
+		uint32_t tv_sec_hi,
+		uint32_t tv_sec_lo,
+		uint32_t tv_nsec,
+		uint32_t refresh,
+		uint32_t seq_hi,
+		uint32_t seq_lo,
+		uint32_t flags)
+{
+	pending_frame *frame = (pending_frame *)data;
+	uint64_t seq = ((uint64_t)seq_hi << 32) | seq_lo;
+	double present;
+
+	present = (double)(((uint64_t)tv_sec_hi << 32) | tv_sec_lo) +
+		tv_nsec * 1E-9;
+
+	glesh_frame_stats_add(&commit_latency_stats,
+		present - frame->commit);
+	glesh_frame_stats_add(&input_latency_stats,
+		present - frame->frame_start);
+
+	if(frames_presented)
+	{
+		glesh_frame_stats_add(&present_interval_stats,
+			present - last_present);
+	}
+
+	/* The refresh counter is only meaningful for vsynced outputs */
+	if(flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC)
+	{
+		if(have_seq && seq > last_seq + 1)
+		{
+			missed_refreshes += seq - last_seq - 1;
+		}
+		last_seq = seq;
+		have_seq = 1;
+	}
+
+	last_present = present;
+	refresh_ns = refresh;
+	frames_presented++;
+
+	wp_presentation_feedback_destroy(feedback);
+	frame->feedback = NULL;
+}
+
+static void
+wayland_feedback_listener_discarded(void *data,
+		struct wp_presentation_feedback *feedback)
+{
+	pending_frame *frame = (pending_frame *)data;
+
+	frames_discarded++;
+
+	wp_presentation_feedback_destroy(feedback);
+	frame->feedback = NULL;
+}
+
+static struct wp_presentation_feedback_listener
+wayland_feedback_listener = {
+	wayland_feedback_listener_sync_output,
+	wayland_feedback_listener_presented,
+	wayland_feedback_listener_discarded,
+};
+
+static void request_feedback(glesh_context *context)
+{
+	pending_frame *frame = NULL;
+	int t;
+
+	for(t = 0; t < MAX_PENDING_FEEDBACK; t++)
+	{
+		if(!pending[t].feedback)
+		{
+			frame = &pending[t];
+			break;
+		}
+	}
+
+	/* More frames in flight than the compositor keeps up with */
+	if(!frame)
+	{
+		frames_unobserved++;
+		return;
+	}
+
+	frame->feedback = wp_presentation_feedback(
+			context->wayland_presentation,
+			context->wayland_surface);
+	if(!frame->feedback)
+	{
+		frames_unobserved++;
+		return;
+	}
+
+	wp_presentation_feedback_add_listener(frame->feedback,
+			&wayland_feedback_listener, frame);
+	frame->frame_start = next_frame_start;
+	frame->commit = presentation_clock_now();
+}
+
+static void report_stats(const char* name, const char* tag,
+	const glesh_frame_stats* stats)
+{
+	char buf[64];
+	double p50, p99;
+
+	if(!stats->count)
+	{
+		return;
+	}
+
+	p50 = glesh_frame_stats_percentile(stats, 50.0) * 1000.0;
+	p99 = glesh_frame_stats_percentile(stats, 99.0) * 1000.0;
+
+	BLTS_DEBUG("%s: median %lf ms, 99th percentile %lf ms, max %lf ms\n",
+		name, p50, p99, stats->max * 1000.0);
+
+	sprintf(buf, "%s_p50", tag);
+	glesh_report_result(buf, p50, "ms");
+	sprintf(buf, "%s_p99", tag);
+	glesh_report_result(buf, p99, "ms");
+	sprintf(buf, "%s_max", tag);
+	glesh_report_result(buf, stats->max * 1000.0, "ms");
+}
+
+#endif /* HAVE_PRESENTATION_TIME */
+
+static void
+wayland_frame_callback_listener_done(void *data,
+		struct wl_callback *callback,
+		uint32_t time)
+{
+	UNUSED_PARAM(time);
+
+	glesh_context *context = (glesh_context *)data;
+
+	wl_callback_destroy(callback);
+	context->wayland_frame_callback = NULL;
+}
+
+static struct wl_callback_listener
+wayland_frame_callback_listener = {
+	wayland_frame_callback_listener_done,
+};
 
 
 static void
@@ -101,6 +325,16 @@ wayland_registry_listener_global(void *data,
 		context->wayland_shell = wl_registry_bind(wl_registry,
 				name, &wl_shell_interface, 1);
 	}
+#ifdef HAVE_PRESENTATION_TIME
+	else if (strcmp(interface, "wp_presentation") == 0 &&
+			(feedback_flags & GLESH_WAYLAND_PRESENTATION_TIME))
+	{
+		context->wayland_presentation = wl_registry_bind(wl_registry,
+				name, &wp_presentation_interface, 1);
+		wp_presentation_add_listener(context->wayland_presentation,
+				&wayland_presentation_listener, context);
+	}
+#endif
 }
 
 static void
@@ -256,6 +490,20 @@ int glesh_create_context_wayland(glesh_context* context,
 
 int glesh_destroy_context_wayland(glesh_context* context)
 {
+	if(context->wayland_frame_callback)
+	{
+		wl_callback_destroy(context->wayland_frame_callback);
+		context->wayland_frame_callback = NULL;
+	}
+
+#ifdef HAVE_PRESENTATION_TIME
+	if(context->wayland_presentation)
+	{
+		wp_presentation_destroy(context->wayland_presentation);
+		context->wayland_presentation = NULL;
+	}
+#endif
+
 	if(context->wayland_window)
 	{
 		wl_egl_window_destroy(context->wayland_window);
@@ -281,11 +529,149 @@ int glesh_main_loop_step_wayland(glesh_context *context)
 {
 	wl_display_flush(context->wayland_display);
 	wl_display_dispatch_pending(context->wayland_display);
+
+	/* Throttle to the compositor: the next frame starts when the
+	 * compositor signals it is a good time to draw one */
+	while(context->wayland_frame_callback)
+	{
+		if(wl_display_dispatch(context->wayland_display) < 0)
+		{
+			BLTS_ERROR("Error: Lost connection to Wayland display\n");
+			return 0;
+		}
+	}
+
+#ifdef HAVE_PRESENTATION_TIME
+	next_frame_start = presentation_clock_now();
+#endif
+
+	return 1;
+}
+
+static int glesh_before_swap_wayland(glesh_context *context)
+{
+	if(feedback_flags & GLESH_WAYLAND_FRAME_CALLBACKS)
+	{
+		if(context->wayland_frame_callback)
+		{
+			wl_callback_destroy(context->wayland_frame_callback);
+		}
+		context->wayland_frame_callback = wl_surface_frame(
+				context->wayland_surface);
+		wl_callback_add_listener(context->wayland_frame_callback,
+				&wayland_frame_callback_listener, context);
+	}
+
+#ifdef HAVE_PRESENTATION_TIME
+	if(measuring && context->wayland_presentation)
+	{
+		request_feedback(context);
+	}
+#endif
+
 	return 1;
 }
 
+static void glesh_measure_begin_wayland(glesh_context *context)
+{
+#ifdef HAVE_PRESENTATION_TIME
+	if(!(feedback_flags & GLESH_WAYLAND_PRESENTATION_TIME))
+	{
+		return;
+	}
+
+	if(!context->wayland_presentation)
+	{
+		BLTS_DEBUG("Compositor does not support wp_presentation, "
+			"no presentation feedback\n");
+		return;
+	}
+
+	memset(&present_interval_stats, 0, sizeof(glesh_frame_stats));
+	memset(&commit_latency_stats, 0, sizeof(glesh_frame_stats));
+	memset(&input_latency_stats, 0, sizeof(glesh_frame_stats));
+	frames_presented = 0;
+	frames_discarded = 0;
+	frames_unobserved = 0;
+	missed_refreshes = 0;
+	have_seq = 0;
+	refresh_ns = 0;
+
+	measuring = 1;
+	next_frame_start = presentation_clock_now();
+#else
+	UNUSED_PARAM(context);
+
+	if(feedback_flags & GLESH_WAYLAND_PRESENTATION_TIME)
+	{
+		BLTS_DEBUG("Built without wayland-protocols, "
+			"no presentation feedback\n");
+	}
+#endif
+}
+
+static void glesh_measure_end_wayland(glesh_context *context)
+{
+#ifdef HAVE_PRESENTATION_TIME
+	unsigned int lost = 0;
+	int t;
+
+	if(!measuring)
+	{
+		return;
+	}
+	measuring = 0;
+
+	/* Collect the feedback of the last frames in flight */
+	wl_display_roundtrip(context->wayland_display);
+	wl_display_roundtrip(context->wayland_display);
+
+	for(t = 0; t < MAX_PENDING_FEEDBACK; t++)
+	{
+		if(pending[t].feedback)
+		{
+			wp_presentation_feedback_destroy(pending[t].feedback);
+			pending[t].feedback = NULL;
+			lost++;
+		}
+	}
+
+	BLTS_DEBUG("Frames presented: %u, discarded: %u, without feedback: %u\n",
+		frames_presented, frames_discarded, frames_unobserved + lost);
+	if(refresh_ns)
+	{
+		BLTS_DEBUG("Output refresh period: %lf ms\n", refresh_ns * 1E-6);
+	}
+
+	report_stats("Present interval", "present_interval",
+		&present_interval_stats);
+	report_stats("Commit to present latency", "commit_to_present_latency",
+		&commit_latency_stats);
+	report_stats("Input to present latency", "input_to_present_latency",
+		&input_latency_stats);
+
+	glesh_report_directed_result("frames_presented", frames_presented,
+		"frames", GLESH_HIGHER_IS_BETTER);
+	glesh_report_result("frames_discarded", frames_discarded, "frames");
+	if(have_seq)
+	{
+		BLTS_DEBUG("Missed refreshes: %u\n", missed_refreshes);
+		glesh_report_result("missed_refreshes", missed_refreshes,
+			"refreshes");
+	}
+#else
+	UNUSED_PARAM(context);
+#endif
+}
+
 struct glesh_ws_context_functions glesh_wayland = {
 	glesh_create_context_wayland,
 	glesh_destroy_context_wayland,
 	glesh_main_loop_step_wayland,
+	NULL,
+	NULL,
+	NULL,
+	glesh_before_swap_wayland,
+	glesh_measure_begin_wayland,
+	glesh_measure_end_wayland,
 };
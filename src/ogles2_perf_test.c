@@ -19,12 +19,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <blts_cli_frontend.h>
 
 #include "ogles2_helper.h"
 #include "test_blitter.h"
 #include "test_common.h"
 #include "ogles2_conf_file.h"
+#include "ogles2_results.h"
+#include "ogles2_baseline.h"
 
 const char* config_filename = "/opt/tests/blts-opengles2-tests/cnf/blts-opengles2-perf.cnf";
 
@@ -32,24 +35,72 @@ static void blts_gles2_help(const char* help_msg_base)
 {
 	fprintf(stdout, help_msg_base,
 		"[-t execution_time_in_seconds] [-w window_width] [-h window_height]"
-		"[-d depth] [-c] [-ws wayland|fbdev]"
+		"[-d depth] [-c] [-ws wayland|fbdev|headless] [-fb budget_ms,...]"
+		" [-wf warmup_frames] [-wt warmup_seconds] [-ss] [-gt]"
+		" [-si swap_interval] [-fc] [-pt] [-pc program_cache_dir]"
+		" [-rf results_file] [-rt json|csv] [-r runs] [-rc cooldown_seconds]"
+		" [-b baseline_file] [-bt tolerance_percent]"
 		,
 		"-t: Maximum execution time of each test in seconds (default: 10s)\n"
 		"-w: Used window width. If 0 uses desktop width. (default: 0)\n"
 		"-h: Used window height. If 0 uses desktop height. (default: 0)\n"
 		"-d: Used window depth. 16, 24 or 32. If 0 uses desktop depth. (default: 0)\n"
-		"-ws: Used window system. wayland or fbdev. (default: wayland)\n"
+		"-ws: Used window system. wayland, fbdev or headless (offscreen pbuffer,\n"
+		"     no compositor needed). (default: wayland)\n"
+		"-fb: Comma separated list of frame time budgets in milliseconds. Frames\n"
+		"     exceeding each budget are counted. (default: 16.6,33.3)\n"
+		"-wf: Number of frames rendered before measuring, at most 1000.\n"
+		"     (default: 0)\n"
+		"-wt: Seconds of rendering before measuring. (default: 0)\n"
+		"-ss: Continue warm-up until frame times are steady (at most 10s).\n"
+		"-gt: Split frame time into CPU submit, swap and GPU time using\n"
+		"     EGL_KHR_fence_sync and GL_EXT_disjoint_timer_query. Waits for\n"
+		"     the GPU every frame, so frame rates are lower than without.\n"
+		"-si: eglSwapInterval: 0 renders unthrottled, 1 syncs each frame to\n"
+		"     vblank, 2 to every other vblank. (default: EGL default)\n"
+		"-fc: Wayland only. Start each frame when the compositor sends a\n"
+		"     frame callback for the previous one. Use with -si 0 to be\n"
+		"     throttled by the compositor only.\n"
+		"-pt: Wayland only. Report present-to-present intervals and commit\n"
+		"     and input to present latencies from wp_presentation feedback.\n"
+		"-pc: Store linked shader programs in the given directory and load\n"
+		"     them from there on later runs (GL_OES_get_program_binary).\n"
+		"     Compile and cache load times are reported.\n"
+		"-rf: Append results of each test case to a file: parameters,\n"
+		"     configuration, metrics and the frame time histogram.\n"
+		"-rt: Format of the results file. json (one object per line) or csv\n"
+		"     (one metric per row). (default: json)\n"
+		"-r: Number of times each test case is run. Mean, standard deviation,\n"
+		"    min/max and 95% confidence interval of each metric are reported\n"
+		"    after the runs. (default: 1)\n"
+		"-rc: Seconds to idle between runs of a case, e.g. to let the device\n"
+		"     cool down. (default: 0)\n"
+		"-b: Compare against a results file written with -rf. A case fails if\n"
+		"    a metric regresses beyond its tolerance and, with at least two\n"
+		"    runs on either side, the change is statistically significant.\n"
+		"-bt: Tolerance in percent used for all cases instead of the per-case\n"
+		"     defaults.\n"
 		);
 }
 
 static void* blts_gles2_argument_processor(int argc, char **argv)
 {
 	int t;
+	char* budget;
+	const char* results_file = NULL;
+	const char* baseline_file = NULL;
+	enum results_format results_fmt = RESULTS_FORMAT_JSON;
 	test_execution_params* params = malloc(sizeof(test_execution_params));
 	memset(params, 0, sizeof(test_execution_params));
 
 	params->execution_time = 10;
 	params->ws = GLESH_WS_CONTEXT_WAYLAND;
+	params->frame_budgets[0] = 16.6;
+	params->frame_budgets[1] = 33.3;
+	params->num_frame_budgets = 2;
+	params->runs = 1;
+	params->swap_interval = -1;
+	params->tolerance = -1.0;
 
 	for(t = 1; t < argc; t++)
 	{
@@ -81,6 +132,104 @@ static void* blts_gles2_argument_processor(int argc, char **argv)
 				params->ws = GLESH_WS_CONTEXT_WAYLAND;
 			} else if (strcmp(argv[t], "fbdev") == 0) {
 				params->ws = GLESH_WS_CONTEXT_FBDEV;
+			} else if (strcmp(argv[t], "headless") == 0) {
+				params->ws = GLESH_WS_CONTEXT_HEADLESS;
+			} else {
+				return NULL;
+			}
+		}
+		else if(strcmp(argv[t], "-fb") == 0)
+		{
+			if(++t >= argc) return NULL;
+
+			params->num_frame_budgets = 0;
+			budget = strtok(argv[t], ",");
+			while(budget &&
+				params->num_frame_budgets < GLESH_MAX_FRAME_BUDGETS)
+			{
+				params->frame_budgets[params->num_frame_budgets++] =
+					atof(budget);
+				budget = strtok(NULL, ",");
+			}
+		}
+		else if(strcmp(argv[t], "-wf") == 0)
+		{
+			if(++t >= argc) return NULL;
+			params->warmup_frames = atoi(argv[t]);
+			if(params->warmup_frames < 0) return NULL;
+			if(params->warmup_frames > GLESH_MAX_WARMUP_FRAMES)
+			{
+				BLTS_DEBUG("Warm-up limited to %d frames\n",
+					GLESH_MAX_WARMUP_FRAMES);
+				params->warmup_frames = GLESH_MAX_WARMUP_FRAMES;
+			}
+		}
+		else if(strcmp(argv[t], "-wt") == 0)
+		{
+			if(++t >= argc) return NULL;
+			params->warmup_time = atof(argv[t]);
+		}
+		else if(strcmp(argv[t], "-ss") == 0)
+		{
+			params->steady_state = 1;
+		}
+		else if(strcmp(argv[t], "-gt") == 0)
+		{
+			params->gpu_timing = 1;
+		}
+		else if(strcmp(argv[t], "-si") == 0)
+		{
+			if(++t >= argc) return NULL;
+			params->swap_interval = atoi(argv[t]);
+			if(params->swap_interval < 0) return NULL;
+		}
+		else if(strcmp(argv[t], "-fc") == 0)
+		{
+			params->wayland_feedback |= GLESH_WAYLAND_FRAME_CALLBACKS;
+		}
+		else if(strcmp(argv[t], "-pt") == 0)
+		{
+			params->wayland_feedback |= GLESH_WAYLAND_PRESENTATION_TIME;
+		}
+		else if(strcmp(argv[t], "-pc") == 0)
+		{
+			if(++t >= argc) return NULL;
+			params->program_cache = argv[t];
+		}
+		else if(strcmp(argv[t], "-rf") == 0)
+		{
+			if(++t >= argc) return NULL;
+			results_file = argv[t];
+		}
+		else if(strcmp(argv[t], "-r") == 0)
+		{
+			if(++t >= argc) return NULL;
+			params->runs = atoi(argv[t]);
+			if(params->runs < 1) return NULL;
+		}
+		else if(strcmp(argv[t], "-rc") == 0)
+		{
+			if(++t >= argc) return NULL;
+			params->cooldown = atoi(argv[t]);
+		}
+		else if(strcmp(argv[t], "-b") == 0)
+		{
+			if(++t >= argc) return NULL;
+			baseline_file = argv[t];
+		}
+		else if(strcmp(argv[t], "-bt") == 0)
+		{
+			if(++t >= argc) return NULL;
+			params->tolerance = atof(argv[t]);
+		}
+		else if(strcmp(argv[t], "-rt") == 0)
+		{
+			if(++t >= argc) return NULL;
+
+			if(strcmp(argv[t], "json") == 0) {
+				results_fmt = RESULTS_FORMAT_JSON;
+			} else if (strcmp(argv[t], "csv") == 0) {
+				results_fmt = RESULTS_FORMAT_CSV;
 			} else {
 				return NULL;
 			}
@@ -91,23 +240,54 @@ static void* blts_gles2_argument_processor(int argc, char **argv)
 		}
 	}
 
-	blts_cli_set_timeout((params->execution_time + 30) * 1000);
+	blts_cli_set_timeout((params->execution_time + params->warmup_time +
+		params->warmup_frames * GLESH_WARMUP_FRAME_TIMEOUT +
+		(params->steady_state ? GLESH_MAX_WARMUP_TIME : 0) + 30 +
+		params->cooldown) * params->runs * 1000);
 	glesh_set_ws_context_type(params->ws);
+	glesh_set_frame_budgets(params->frame_budgets, params->num_frame_budgets);
+	glesh_set_warmup(params->warmup_frames, params->warmup_time,
+		params->steady_state);
+	glesh_set_gpu_timing(params->gpu_timing);
+	glesh_set_swap_interval(params->swap_interval);
+	glesh_set_wayland_feedback(params->wayland_feedback);
+	glesh_set_program_cache(params->program_cache);
+
+	if(results_file && !results_open(results_file, results_fmt))
+	{
+		BLTS_ERROR("Failed to open results file %s\n", results_file);
+		free(params);
+		return NULL;
+	}
+
+	if(baseline_file)
+	{
+		if(!baseline_load(baseline_file))
+		{
+			BLTS_ERROR("Failed to read baseline file %s\n", baseline_file);
+			results_close();
+			free(params);
+			return NULL;
+		}
+		params->compare_baseline = 1;
+	}
 
 	return params;
 }
 
 static void blts_gles2_teardown(void *user_ptr)
 {
+	results_close();
+	baseline_free();
+
 	if(user_ptr)
 	{
 		free(user_ptr);
 	}
 }
 
-static int exec_test(void* user_ptr, int test_num)
+static int run_test(test_execution_params* params, int test_num)
 {
-	test_execution_params* params = user_ptr;
 	int ret = 0;
 
 	if(read_config(config_filename, &params->config))
@@ -177,6 +357,7 @@ static int exec_test(void* user_ptr, int test_num)
 
 	/* more synthetic benchmarks */
 	case 14:
+		params->flag = 0;
 		ret = test_polygons(params);
 		break;
 	case 15:
@@ -189,6 +370,7 @@ static int exec_test(void* user_ptr, int test_num)
 		ret = test_frag_shader(params);
 		break;
 	case 18:
+		params->flag = 0;
 		ret = test_vert_shader(params);
 		break;
 
@@ -198,6 +380,92 @@ static int exec_test(void* user_ptr, int test_num)
 			T_FLAG_WIDGET_SHADOWS;
 		ret = test_blitter(params);
 		break;
+
+	/* client-side arrays vs. buffer objects */
+	case 20:
+		params->flag = T_FLAG_VBO;
+		ret = test_polygons(params);
+		break;
+	case 21:
+		params->flag = T_FLAG_VBO;
+		ret = test_vert_shader(params);
+		break;
+	case 22:
+		params->flag = T_FLAG_BLEND|T_FLAG_WIDGETS|T_FLAG_WIDGET_SHADOWS|
+			T_FLAG_VBO;
+		ret = test_blitter(params);
+		break;
+	case 23:
+		params->flag = T_FLAG_VBO|T_FLAG_INTERLEAVED;
+		ret = test_polygons(params);
+		break;
+	case 24:
+		params->flag = T_FLAG_VBO|T_FLAG_COMPACT_VERTICES;
+		ret = test_polygons(params);
+		break;
+	case 25:
+		params->flag = T_FLAG_VBO|T_FLAG_OPTIMIZE_VERTEX_CACHE;
+		ret = test_polygons(params);
+		break;
+	case 26:
+		params->flag = T_FLAG_VBO|T_FLAG_OPTIMIZE_VERTEX_CACHE;
+		ret = test_vert_shader(params);
+		break;
+
+	/* per-widget draws vs. one draw per layer */
+	case 27:
+		params->flag = T_FLAG_BLEND|T_FLAG_WIDGETS|T_FLAG_WIDGET_SHADOWS|
+			T_FLAG_BATCH_WIDGETS;
+		ret = test_blitter(params);
+		break;
+	case 28:
+		params->flag = T_FLAG_BLEND|T_FLAG_WIDGETS|T_FLAG_WIDGET_SHADOWS|
+			T_FLAG_ZOOM|T_FLAG_ROTATE|T_FLAG_PARTICLES|T_FLAG_BATCH_WIDGETS;
+		ret = test_blitter(params);
+		break;
+
+	/* damage tracking with buffer age */
+	case 29:
+		params->flag = T_FLAG_BLEND|T_FLAG_WIDGETS|T_FLAG_WIDGET_SHADOWS|
+			T_FLAG_PARTIAL_UPDATE;
+		ret = test_blitter(params);
+		break;
+	case 30:
+		params->flag = T_FLAG_BLEND|T_FLAG_WIDGETS|T_FLAG_WIDGET_SHADOWS|
+			T_FLAG_VIDEO_WIDGETS|T_FLAG_PARTIAL_UPDATE;
+		ret = test_blitter(params);
+		break;
+	case 31:
+		params->flag = 0;
+		ret = test_shader_compile(params);
+		break;
+	case 32:
+		params->flag = 0;
+		ret = test_parallel_compile(params);
+		break;
+	case 33:
+		params->flag = T_FLAG_BLEND|T_FLAG_WIDGETS|T_FLAG_WIDGET_SHADOWS|
+			T_FLAG_VIDEO_WIDGETS|T_FLAG_ASYNC_UPLOAD;
+		ret = test_blitter(params);
+		break;
+	case 34:
+		params->flag = T_FLAG_BLEND|T_FLAG_WIDGETS|T_FLAG_WIDGET_SHADOWS|
+			T_FLAG_VIDEO_WIDGETS|T_FLAG_ZERO_COPY;
+		ret = test_blitter(params);
+		break;
+	case 35:
+		params->flag = 0;
+		ret = test_texture_upload(params);
+		break;
+	case 36:
+		params->flag = T_FLAG_BLEND|T_FLAG_WIDGETS|T_FLAG_WIDGET_SHADOWS|
+			T_FLAG_VIDEO_WIDGETS|T_FLAG_SUBIMAGE_UPLOAD;
+		ret = test_blitter(params);
+		break;
+	case 37:
+		params->flag = 0;
+		ret = test_texture_reuse(params);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -206,6 +474,8 @@ static int exec_test(void* user_ptr, int test_num)
 	return ret;
 }
 
+static int exec_test(void* user_ptr, int test_num);
+
 static blts_cli_testcase blts_gles2_cases[] =
 {
 	{ "OpenGL-Enumerate GL extensions", exec_test, 20000 },
@@ -227,9 +497,103 @@ static blts_cli_testcase blts_gles2_cases[] =
 	{ "OpenGL-Fragment shader performance", exec_test, 20000 },
 	{ "OpenGL-Vertex shader performance", exec_test, 20000 },
 	{ "OpenGL-Convolution filter", exec_test, 20000 },
+	{ "OpenGL-Polygons-per-second (VBO)", exec_test, 20000 },
+	{ "OpenGL-Vertex shader performance (VBO)", exec_test, 20000 },
+	{ "OpenGL-Blit with blend and widgets with shadows (VBO)", exec_test, 20000 },
+	{ "OpenGL-Polygons-per-second (interleaved)", exec_test, 20000 },
+	{ "OpenGL-Polygons-per-second (compact vertices)", exec_test, 20000 },
+	{ "OpenGL-Polygons-per-second (VBO, vertex cache optimized)", exec_test, 20000 },
+	{ "OpenGL-Vertex shader performance (VBO, vertex cache optimized)", exec_test, 20000 },
+	{ "OpenGL-Blit with blend and widgets with shadows (batched)", exec_test, 20000 },
+	{ "OpenGL-Blit with blend and widgets with shadows + particles + rotate + zoom (batched)", exec_test, 20000 },
+	{ "OpenGL-Blit with blend and widgets with shadows (partial update)", exec_test, 20000 },
+	{ "OpenGL-Blit with blend and animated widgets with shadows (partial update)", exec_test, 20000 },
+	{ "OpenGL-Shader compile and link times", exec_test, 20000 },
+	{ "OpenGL-Parallel shader compilation", exec_test, 20000 },
+	{ "OpenGL-Blit with blend and animated widgets with shadows (async upload)", exec_test, 20000 },
+	{ "OpenGL-Blit with blend and animated widgets with shadows (zero-copy)", exec_test, 20000 },
+	{ "OpenGL-Texture upload throughput", exec_test, 20000 },
+	{ "OpenGL-Blit with blend and animated widgets with shadows (double buffered upload)", exec_test, 20000 },
+	{ "OpenGL-Texture load and release", exec_test, 20000 },
 	BLTS_CLI_END_OF_LIST
 };
 
+/* Allowed regression against the baseline in percent, in the order of
+ * blts_gles2_cases. Negative values are reported but not gated. */
+static const double blts_gles2_tolerances[] =
+{
+	-1.0, -1.0, -1.0, -1.0,
+	5.0, 5.0, 5.0, 5.0, 5.0, 5.0, 5.0, 5.0,
+	10.0, /* generated video textures */
+	3.0, 3.0, 3.0, 3.0, 3.0,
+	5.0,
+	3.0, 3.0, 5.0, 3.0, 3.0, 3.0, 3.0,
+	5.0, 5.0,
+	5.0, 10.0,
+	20.0, /* compiler times vary more than frame rates */
+	20.0,
+	10.0, 10.0,
+	20.0, /* uploads of the small sizes take microseconds */
+	10.0,
+	20.0,
+};
+
+typedef char blts_gles2_tolerances_size_check[
+	(sizeof(blts_gles2_tolerances) / sizeof(blts_gles2_tolerances[0]) ==
+	sizeof(blts_gles2_cases) / sizeof(blts_gles2_cases[0]) - 1) ? 1 : -1];
+
+static int exec_test(void* user_ptr, int test_num)
+{
+	test_execution_params* params = user_ptr;
+	const char* name = blts_gles2_cases[test_num - 1].case_name;
+	const results_metric* metrics;
+	int num_metrics;
+	double tolerance;
+	int run;
+	int ret = 0;
+
+	results_begin_runs();
+
+	for(run = 0; run < params->runs && !ret; run++)
+	{
+		if(run && params->cooldown > 0)
+		{
+			BLTS_DEBUG("Cooling down for %d s\n", params->cooldown);
+			sleep(params->cooldown);
+		}
+
+		if(params->runs > 1)
+		{
+			BLTS_DEBUG("Run %d/%d\n", run + 1, params->runs);
+		}
+
+		results_begin_case(test_num, name);
+		ret = run_test(params, test_num);
+		results_end_case(params, ret);
+
+		if(!ret)
+		{
+			metrics = results_get_metrics(&num_metrics);
+			baseline_add_run(name, metrics, num_metrics);
+		}
+	}
+
+	results_end_runs();
+
+	if(!ret && params->compare_baseline)
+	{
+		tolerance = params->tolerance >= 0.0 ? params->tolerance :
+			blts_gles2_tolerances[test_num - 1];
+		if(baseline_compare_case(name, tolerance))
+		{
+			BLTS_ERROR("Regression against baseline\n");
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
 static blts_cli gles2_cli =
 {
 	.test_cases = blts_gles2_cases,
@@ -0,0 +1,602 @@
+/* ogles2_results.c -- Machine-readable result output
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "ogles2_helper.h"
+#include "ogles2_results.h"
+#include "ogles2_stats.h"
+
+static FILE* results_fp;
+static enum results_format results_fmt;
+
+static int case_num;
+static const char* case_name;
+static results_metric results[RESULTS_MAX_METRICS];
+static int num_results;
+
+/* Accumulated over the runs of a case */
+typedef struct
+{
+	char tag[RESULTS_MAX_TAG_LEN];
+	char unit[RESULTS_MAX_UNIT_LEN];
+	stats_acc acc;
+} run_metric;
+
+static run_metric run_metrics[RESULTS_MAX_METRICS];
+static int num_run_metrics;
+static int num_runs;
+
+/* Copied at the end of the main loop, the context is gone by the time the
+ * case finishes */
+static int have_frame_data;
+static GLint window_width;
+static GLint window_height;
+static GLint window_depth;
+static unsigned int frames_rendered;
+static double time_elapsed;
+static glesh_frame_stats frame_stats;
+
+static void sink_result(const char* tag, double value, const char* unit,
+	enum glesh_result_direction direction)
+{
+	int t;
+
+	/* Last value wins if a tag is reported more than once */
+	for(t = 0; t < num_results; t++)
+	{
+		if(!strcmp(results[t].tag, tag))
+		{
+			break;
+		}
+	}
+
+	if(t == RESULTS_MAX_METRICS)
+	{
+		BLTS_DEBUG("Too many results, '%s' not written\n", tag);
+		return;
+	}
+
+	strncpy(results[t].tag, tag, RESULTS_MAX_TAG_LEN - 1);
+	results[t].tag[RESULTS_MAX_TAG_LEN - 1] = 0;
+	strncpy(results[t].unit, unit ? unit : "", RESULTS_MAX_UNIT_LEN - 1);
+	results[t].unit[RESULTS_MAX_UNIT_LEN - 1] = 0;
+	results[t].value = value;
+	results[t].direction = direction;
+
+	if(t == num_results)
+	{
+		num_results++;
+	}
+}
+
+static void sink_main_loop_done(const glesh_context* context)
+{
+	have_frame_data = 1;
+	window_width = context->width;
+	window_height = context->height;
+	window_depth = context->depth;
+	frames_rendered = context->perf_data.frames_rendered;
+	time_elapsed = context->perf_data.total_time_elapsed;
+	frame_stats = context->perf_data.frame_stats;
+}
+
+static const struct glesh_result_sink results_sink = {
+	sink_result,
+	sink_main_loop_done,
+};
+
+static const char* ws_name(enum glesh_ws_context_type ws)
+{
+	switch(ws)
+	{
+	case GLESH_WS_CONTEXT_WAYLAND:
+		return "wayland";
+	case GLESH_WS_CONTEXT_FBDEV:
+		return "fbdev";
+	case GLESH_WS_CONTEXT_HEADLESS:
+		return "headless";
+	default:
+		return "invalid";
+	}
+}
+
+/* JSON */
+
+static void json_string(const char* str)
+{
+	fputc('"', results_fp);
+	for(; *str; str++)
+	{
+		if(*str == '"' || *str == '\\')
+		{
+			fprintf(results_fp, "\\%c", *str);
+		}
+		else if((unsigned char)*str < 0x20)
+		{
+			fprintf(results_fp, "\\u%04x", *str);
+		}
+		else
+		{
+			fputc(*str, results_fp);
+		}
+	}
+	fputc('"', results_fp);
+}
+
+/* %.17g keeps doubles exact; JSON has no representation for inf or nan */
+static void json_number(double value)
+{
+	if(value != value || value > 1e308 || value < -1e308)
+	{
+		fprintf(results_fp, "null");
+	}
+	else
+	{
+		fprintf(results_fp, "%.17g", value);
+	}
+}
+
+static void json_write_config(const test_configuration_file_params* config)
+{
+	int t;
+
+	fprintf(results_fp, "\"config\":{\"scale_images_to_window\":%d,"
+		"\"desktop_count\":%d,\"layer_count\":%d,\"widget_count\":%d,"
+		"\"particle_count\":%d,\"video_widget_tex_width\":%d,"
+		"\"video_widget_tex_height\":%d,\"video_widget_generation_freq\":%d,"
+		"\"scroll_speed\":%d,\"convolution_mat\":[",
+		config->scale_images_to_window, config->desktop_count,
+		config->layer_count, config->widget_count, config->particle_count,
+		config->video_widget_tex_width, config->video_widget_tex_height,
+		config->video_widget_generation_freq, config->scroll_speed);
+
+	for(t = 0; t < config->convolution_mat_size; t++)
+	{
+		fputs(t ? "," : "", results_fp);
+		json_number(config->convolution_mat[t]);
+	}
+
+	fprintf(results_fp, "],\"convolution_mat_divisor\":");
+	json_number(config->convolution_mat_divisor);
+
+	fprintf(results_fp, ",\"egl_config_attr\":{");
+	for(t = 0; config->config_attr && config->config_attr[t] != EGL_NONE;
+		t += 2)
+	{
+		fprintf(results_fp, "%s\"0x%04x\":%d", t ? "," : "",
+			config->config_attr[t], config->config_attr[t + 1]);
+	}
+	fprintf(results_fp, "}}");
+}
+
+static void json_write_case(const test_execution_params* params, int ret)
+{
+	int t;
+	int first;
+
+	fprintf(results_fp, "{\"test\":");
+	json_string(case_name);
+	fprintf(results_fp, ",\"case\":%d,\"result\":\"%s\",\"ret\":%d,"
+		"\"ws\":\"%s\",\"execution_time\":%d,\"flags\":%d,",
+		case_num, ret ? "fail" : "pass", ret, ws_name(params->ws),
+		params->execution_time, params->flag);
+
+	fprintf(results_fp, "\"requested_window\":{\"width\":%d,\"height\":%d,"
+		"\"depth\":%d},", params->w, params->h, params->d);
+	if(have_frame_data)
+	{
+		fprintf(results_fp, "\"window\":{\"width\":%d,\"height\":%d,"
+			"\"depth\":%d},", window_width, window_height, window_depth);
+	}
+
+	fprintf(results_fp, "\"warmup\":{\"frames\":%d,\"time\":",
+		params->warmup_frames);
+	json_number(params->warmup_time);
+	fprintf(results_fp, ",\"steady_state\":%d},\"gpu_timing\":%d,"
+		"\"swap_interval\":%d,\"frame_callbacks\":%d,"
+		"\"presentation_time\":%d,\"program_cache\":%d,"
+		"\"frame_budgets_ms\":[",
+		params->steady_state, params->gpu_timing, params->swap_interval,
+		!!(params->wayland_feedback & GLESH_WAYLAND_FRAME_CALLBACKS),
+		!!(params->wayland_feedback & GLESH_WAYLAND_PRESENTATION_TIME),
+		!!params->program_cache);
+	for(t = 0; t < params->num_frame_budgets; t++)
+	{
+		fputs(t ? "," : "", results_fp);
+		json_number(params->frame_budgets[t]);
+	}
+	fprintf(results_fp, "],");
+
+	json_write_config(&params->config);
+
+	fprintf(results_fp, ",\"metrics\":{");
+	for(t = 0; t < num_results; t++)
+	{
+		fputs(t ? "," : "", results_fp);
+		json_string(results[t].tag);
+		fprintf(results_fp, ":{\"value\":");
+		json_number(results[t].value);
+		fprintf(results_fp, ",\"unit\":");
+		json_string(results[t].unit);
+		fprintf(results_fp, "}");
+	}
+	fprintf(results_fp, "}");
+
+	if(have_frame_data)
+	{
+		/* Sparse, most of the bins are empty */
+		fprintf(results_fp, ",\"frames\":%u,\"time_elapsed\":",
+			frames_rendered);
+		json_number(time_elapsed);
+		fprintf(results_fp, ",\"frame_time_histogram\":{\"bin_width_ms\":");
+		json_number(GLESH_FRAME_HIST_BIN_WIDTH * 1000.0);
+		fprintf(results_fp, ",\"bins\":[");
+		for(t = 0, first = 1; t < GLESH_FRAME_HIST_BINS; t++)
+		{
+			if(frame_stats.bins[t])
+			{
+				fprintf(results_fp, "%s[%d,%u]", first ? "" : ",", t,
+					frame_stats.bins[t]);
+				first = 0;
+			}
+		}
+		fprintf(results_fp, "],\"overflow\":%u}", frame_stats.overflow);
+	}
+
+	fprintf(results_fp, "}\n");
+}
+
+/* CSV */
+
+static void csv_row(const char* metric, double value, const char* unit)
+{
+	const char* c;
+
+	/* Case names contain commas, quote them */
+	fputc('"', results_fp);
+	for(c = case_name; *c; c++)
+	{
+		if(*c == '"')
+		{
+			fputc('"', results_fp);
+		}
+		fputc(*c, results_fp);
+	}
+	fprintf(results_fp, "\",%d,%s,%.17g,%s\n", case_num, metric, value,
+		unit);
+}
+
+static void csv_write_case(const test_execution_params* params, int ret)
+{
+	const test_configuration_file_params* config = &params->config;
+	char metric[RESULTS_MAX_TAG_LEN + 32];
+	int t;
+
+	csv_row("ret", ret, "");
+	csv_row("param.execution_time", params->execution_time, "s");
+	csv_row("param.flags", params->flag, "");
+	csv_row("param.ws", params->ws, ws_name(params->ws));
+	csv_row("param.width", params->w, "pixels");
+	csv_row("param.height", params->h, "pixels");
+	csv_row("param.depth", params->d, "bpp");
+	csv_row("param.warmup_frames", params->warmup_frames, "frames");
+	csv_row("param.warmup_time", params->warmup_time, "s");
+	csv_row("param.steady_state", params->steady_state, "");
+	csv_row("param.gpu_timing", params->gpu_timing, "");
+	csv_row("param.swap_interval", params->swap_interval, "");
+	csv_row("param.frame_callbacks",
+		!!(params->wayland_feedback & GLESH_WAYLAND_FRAME_CALLBACKS), "");
+	csv_row("param.presentation_time",
+		!!(params->wayland_feedback & GLESH_WAYLAND_PRESENTATION_TIME), "");
+	csv_row("param.program_cache", !!params->program_cache, "");
+	for(t = 0; t < params->num_frame_budgets; t++)
+	{
+		sprintf(metric, "param.frame_budget.%d", t);
+		csv_row(metric, params->frame_budgets[t], "ms");
+	}
+
+	csv_row("config.scale_images_to_window", config->scale_images_to_window,
+		"");
+	csv_row("config.desktop_count", config->desktop_count, "");
+	csv_row("config.layer_count", config->layer_count, "");
+	csv_row("config.widget_count", config->widget_count, "");
+	csv_row("config.particle_count", config->particle_count, "");
+	csv_row("config.video_widget_tex_width", config->video_widget_tex_width,
+		"pixels");
+	csv_row("config.video_widget_tex_height",
+		config->video_widget_tex_height, "pixels");
+	csv_row("config.video_widget_generation_freq",
+		config->video_widget_generation_freq, "");
+	csv_row("config.scroll_speed", config->scroll_speed, "");
+	for(t = 0; t < config->convolution_mat_size; t++)
+	{
+		sprintf(metric, "config.convolution_mat.%d", t);
+		csv_row(metric, config->convolution_mat[t], "");
+	}
+	csv_row("config.convolution_mat_divisor",
+		config->convolution_mat_divisor, "");
+	for(t = 0; config->config_attr && config->config_attr[t] != EGL_NONE;
+		t += 2)
+	{
+		sprintf(metric, "config.egl_config_attr.0x%04x",
+			config->config_attr[t]);
+		csv_row(metric, config->config_attr[t + 1], "");
+	}
+
+	if(have_frame_data)
+	{
+		csv_row("window.width", window_width, "pixels");
+		csv_row("window.height", window_height, "pixels");
+		csv_row("window.depth", window_depth, "bpp");
+		csv_row("frames", frames_rendered, "frames");
+		csv_row("time_elapsed", time_elapsed, "s");
+	}
+
+	for(t = 0; t < num_results; t++)
+	{
+		sprintf(metric, "metric.%.*s", RESULTS_MAX_TAG_LEN - 1,
+			results[t].tag);
+		csv_row(metric, results[t].value, results[t].unit);
+	}
+
+	if(have_frame_data)
+	{
+		csv_row("frame_time_histogram.bin_width",
+			GLESH_FRAME_HIST_BIN_WIDTH * 1000.0, "ms");
+		for(t = 0; t < GLESH_FRAME_HIST_BINS; t++)
+		{
+			if(frame_stats.bins[t])
+			{
+				sprintf(metric, "frame_time_histogram.%d", t);
+				csv_row(metric, frame_stats.bins[t], "frames");
+			}
+		}
+		csv_row("frame_time_histogram.overflow", frame_stats.overflow,
+			"frames");
+	}
+}
+
+static void json_write_summary()
+{
+	const stats_acc* acc;
+	int t;
+
+	fprintf(results_fp, "{\"test\":");
+	json_string(case_name);
+	fprintf(results_fp, ",\"case\":%d,\"runs\":%d,\"summary\":{",
+		case_num, num_runs);
+
+	for(t = 0; t < num_run_metrics; t++)
+	{
+		acc = &run_metrics[t].acc;
+
+		fputs(t ? "," : "", results_fp);
+		json_string(run_metrics[t].tag);
+		fprintf(results_fp, ":{\"n\":%d,\"mean\":", acc->n);
+		json_number(acc->mean);
+		fprintf(results_fp, ",\"stddev\":");
+		json_number(stats_stddev(acc));
+		fprintf(results_fp, ",\"min\":");
+		json_number(acc->min);
+		fprintf(results_fp, ",\"max\":");
+		json_number(acc->max);
+		fprintf(results_fp, ",\"ci95\":");
+		json_number(stats_ci95(acc));
+		fprintf(results_fp, ",\"unit\":");
+		json_string(run_metrics[t].unit);
+		fprintf(results_fp, "}");
+	}
+
+	fprintf(results_fp, "}}\n");
+}
+
+static void csv_write_summary()
+{
+	char metric[RESULTS_MAX_TAG_LEN + 32];
+	const stats_acc* acc;
+	const char* tag;
+	const char* unit;
+	int t;
+
+	csv_row("summary.runs", num_runs, "");
+
+	for(t = 0; t < num_run_metrics; t++)
+	{
+		acc = &run_metrics[t].acc;
+		tag = run_metrics[t].tag;
+		unit = run_metrics[t].unit;
+
+		sprintf(metric, "summary.%.*s.mean", RESULTS_MAX_TAG_LEN - 1, tag);
+		csv_row(metric, acc->mean, unit);
+		sprintf(metric, "summary.%.*s.stddev", RESULTS_MAX_TAG_LEN - 1, tag);
+		csv_row(metric, stats_stddev(acc), unit);
+		sprintf(metric, "summary.%.*s.min", RESULTS_MAX_TAG_LEN - 1, tag);
+		csv_row(metric, acc->min, unit);
+		sprintf(metric, "summary.%.*s.max", RESULTS_MAX_TAG_LEN - 1, tag);
+		csv_row(metric, acc->max, unit);
+		sprintf(metric, "summary.%.*s.ci95", RESULTS_MAX_TAG_LEN - 1, tag);
+		csv_row(metric, stats_ci95(acc), unit);
+	}
+}
+
+/* Results are appended so that several runs can share a file. */
+int results_open(const char* filename, enum results_format format)
+{
+	results_fp = fopen(filename, "a");
+	if(!results_fp)
+	{
+		BLTS_LOGGED_PERROR("fopen");
+		return 0;
+	}
+
+	results_fmt = format;
+
+	if(format == RESULTS_FORMAT_CSV)
+	{
+		fseek(results_fp, 0, SEEK_END);
+		if(!ftell(results_fp))
+		{
+			fprintf(results_fp, "test,case,metric,value,unit\n");
+		}
+	}
+
+	return 1;
+}
+
+void results_close()
+{
+	glesh_set_result_sink(NULL);
+
+	if(results_fp)
+	{
+		fclose(results_fp);
+		results_fp = NULL;
+	}
+}
+
+/* Metrics are collected even without a results file, see
+ * results_get_metrics() */
+void results_begin_case(int test_num, const char* name)
+{
+	glesh_set_result_sink(&results_sink);
+	case_num = test_num;
+	case_name = name;
+	num_results = 0;
+	have_frame_data = 0;
+}
+
+static void accumulate_run()
+{
+	int t, i;
+
+	num_runs++;
+
+	for(t = 0; t < num_results; t++)
+	{
+		for(i = 0; i < num_run_metrics; i++)
+		{
+			if(!strcmp(run_metrics[i].tag, results[t].tag))
+			{
+				break;
+			}
+		}
+
+		if(i == RESULTS_MAX_METRICS)
+		{
+			BLTS_DEBUG("Too many results, '%s' not summarised\n",
+				results[t].tag);
+			continue;
+		}
+
+		if(i == num_run_metrics)
+		{
+			memset(&run_metrics[i], 0, sizeof(run_metric));
+			strcpy(run_metrics[i].tag, results[t].tag);
+			strcpy(run_metrics[i].unit, results[t].unit);
+			num_run_metrics++;
+		}
+
+		stats_add(&run_metrics[i].acc, results[t].value);
+	}
+}
+
+void results_end_case(const test_execution_params* params, int ret)
+{
+	if(!ret)
+	{
+		accumulate_run();
+	}
+
+	if(!results_fp)
+	{
+		return;
+	}
+
+	if(results_fmt == RESULTS_FORMAT_CSV)
+	{
+		csv_write_case(params, ret);
+	}
+	else
+	{
+		json_write_case(params, ret);
+	}
+
+	/* Keep what has been measured if a later case crashes */
+	fflush(results_fp);
+}
+
+/* Metrics of the last case, valid until the next results_begin_case() */
+const results_metric* results_get_metrics(int* count)
+{
+	*count = num_results;
+	return results;
+}
+
+/* Starts accumulating metrics over the runs of a case */
+void results_begin_runs()
+{
+	num_runs = 0;
+	num_run_metrics = 0;
+}
+
+/* Logs mean, standard deviation, range and the 95% confidence interval of
+ * each metric over the successful runs, and writes them as a summary
+ * record if there was more than one */
+void results_end_runs()
+{
+	const stats_acc* acc;
+	int t;
+
+	if(num_runs < 2)
+	{
+		return;
+	}
+
+	BLTS_DEBUG("Summary of %d runs:\n", num_runs);
+	BLTS_DEBUG("%-24s %14s %12s %14s %14s %12s %6s\n", "metric", "mean",
+		"stddev", "min", "max", "95% CI +-", "CI %");
+
+	for(t = 0; t < num_run_metrics; t++)
+	{
+		acc = &run_metrics[t].acc;
+
+		BLTS_DEBUG("%-24s %14.6g %12.4g %14.6g %14.6g %12.4g %5.1f%% %s\n",
+			run_metrics[t].tag, acc->mean, stats_stddev(acc), acc->min,
+			acc->max, stats_ci95(acc), acc->mean != 0.0 ?
+			stats_ci95(acc) / fabs(acc->mean) * 100.0 : 0.0,
+			run_metrics[t].unit);
+	}
+
+	if(!results_fp)
+	{
+		return;
+	}
+
+	if(results_fmt == RESULTS_FORMAT_CSV)
+	{
+		csv_write_summary();
+	}
+	else
+	{
+		json_write_summary();
+	}
+
+	fflush(results_fp);
+}
@@ -0,0 +1,51 @@
+/* ogles2_results.h -- Machine-readable result output
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef OGLES2_RESULTS_H
+#define OGLES2_RESULTS_H
+
+#include "test_common.h"
+
+/* Metrics reported by one test case, the texture upload case reports four
+ * for each of its ~120 configurations */
+#define RESULTS_MAX_METRICS 512
+#define RESULTS_MAX_TAG_LEN 64
+#define RESULTS_MAX_UNIT_LEN 32
+
+typedef struct
+{
+	char tag[RESULTS_MAX_TAG_LEN];
+	double value;
+	char unit[RESULTS_MAX_UNIT_LEN];
+	enum glesh_result_direction direction;
+} results_metric;
+
+enum results_format {
+	RESULTS_FORMAT_JSON = 0, /* one object per test case and line */
+	RESULTS_FORMAT_CSV, /* test,case,metric,value,unit rows */
+};
+
+int results_open(const char* filename, enum results_format format);
+void results_close();
+void results_begin_runs();
+void results_end_runs();
+void results_begin_case(int test_num, const char* name);
+void results_end_case(const test_execution_params* params, int ret);
+const results_metric* results_get_metrics(int* count);
+
+#endif // OGLES2_RESULTS_H
@@ -0,0 +1,166 @@
+/* ogles2_stats.c -- Statistics over repeated test runs
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include "ogles2_stats.h"
+
+/* Two-sided 95% critical values of Student's t for 1...30 degrees of
+ * freedom */
+static const double t95_table[] =
+{
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+void stats_add(stats_acc* acc, double value)
+{
+	double delta;
+
+	if(!acc->n || value < acc->min)
+	{
+		acc->min = value;
+	}
+	if(!acc->n || value > acc->max)
+	{
+		acc->max = value;
+	}
+
+	acc->n++;
+	delta = value - acc->mean;
+	acc->mean += delta / acc->n;
+	acc->m2 += delta * (value - acc->mean);
+}
+
+/* Sample standard deviation, 0 for fewer than two samples */
+double stats_stddev(const stats_acc* acc)
+{
+	if(acc->n < 2)
+	{
+		return 0.0;
+	}
+
+	return sqrt(acc->m2 / (acc->n - 1));
+}
+
+/* Half-width of the 95% confidence interval of the mean */
+double stats_ci95(const stats_acc* acc)
+{
+	if(acc->n < 2)
+	{
+		return 0.0;
+	}
+
+	return stats_t95(acc->n - 1) * stats_stddev(acc) / sqrt(acc->n);
+}
+
+/* Fractional degrees of freedom are rounded down, which errs on the side
+ * of a wider interval */
+double stats_t95(double df)
+{
+	int i = (int)df;
+
+	if(i < 1)
+	{
+		return t95_table[0];
+	}
+	if(i <= 30)
+	{
+		return t95_table[i - 1];
+	}
+	if(i < 40)
+	{
+		return 2.021;
+	}
+	if(i < 60)
+	{
+		return 2.000;
+	}
+	if(i < 120)
+	{
+		return 1.980;
+	}
+
+	return 1.960;
+}
+
+/* Welch's t-test at the 5% level. Returns 1 if the means differ, 0 if not
+ * and -1 if neither side has two samples. A single sample is compared
+ * against the 95% prediction interval of the other side. */
+int stats_differ(const stats_acc* a, const stats_acc* b)
+{
+	const stats_acc* single;
+	const stats_acc* other;
+	double va, vb, se2, df;
+
+	if(a->n < 2 && b->n < 2)
+	{
+		return -1;
+	}
+
+	if(a->n < 2 || b->n < 2)
+	{
+		single = a->n < 2 ? a : b;
+		other = a->n < 2 ? b : a;
+
+		return fabs(single->mean - other->mean) > stats_t95(other->n - 1) *
+			stats_stddev(other) * sqrt(1.0 + 1.0 / other->n);
+	}
+
+	va = a->m2 / (a->n - 1) / a->n;
+	vb = b->m2 / (b->n - 1) / b->n;
+	se2 = va + vb;
+
+	if(se2 <= 0.0)
+	{
+		return a->mean != b->mean;
+	}
+
+	/* Welch-Satterthwaite */
+	df = se2 * se2 / (va * va / (a->n - 1) + vb * vb / (b->n - 1));
+
+	return fabs(a->mean - b->mean) > stats_t95(df) * sqrt(se2);
+}
+
+static int compare_samples(const void* a, const void* b)
+{
+	double da = *(const double*)a;
+	double db = *(const double*)b;
+
+	return da < db ? -1 : da > db;
+}
+
+void stats_sort(double* samples, int count)
+{
+	qsort(samples, count, sizeof(double), compare_samples);
+}
+
+/* Nearest rank, like glesh_frame_stats_percentile() but exact. Samples
+ * must be sorted with stats_sort(). */
+double stats_percentile(const double* samples, int count, double percentile)
+{
+	int rank = (int)ceil(percentile / 100.0 * count);
+
+	if(!count)
+	{
+		return 0.0;
+	}
+
+	return samples[rank < 1 ? 0 : rank - 1];
+}
@@ -0,0 +1,42 @@
+/* ogles2_stats.h -- Statistics over repeated test runs
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef OGLES2_STATS_H
+#define OGLES2_STATS_H
+
+/* Running mean and variance (Welford), no samples are stored */
+typedef struct
+{
+	int n;
+	double mean;
+	double m2;
+	double min;
+	double max;
+} stats_acc;
+
+void stats_add(stats_acc* acc, double value);
+double stats_stddev(const stats_acc* acc);
+double stats_ci95(const stats_acc* acc);
+double stats_t95(double df);
+int stats_differ(const stats_acc* a, const stats_acc* b);
+
+/* For the few cases that keep every sample */
+void stats_sort(double* samples, int count);
+double stats_percentile(const double* samples, int count, double percentile);
+
+#endif // OGLES2_STATS_H
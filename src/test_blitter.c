@@ -132,6 +132,21 @@ static const char convolution_template[] =
 
 static char* frag_shader_convolution;
 
+/* The first one is also the vertex shader of the convolution filter */
+static const test_shader_program programs[] =
+{
+	{ "blit", vertex_shader_proj, frag_shader_simple },
+	{ "blit_opaque", vertex_shader_proj, frag_shader_opaque },
+	{ "blit_blurred", vertex_shader_proj, frag_shader_opaque_blurred },
+	{ "particle", vertex_shader_particle, frag_shader_particle },
+};
+
+int test_blitter_programs(const test_shader_program** out)
+{
+	*out = programs;
+	return ARRAY_SIZE(programs);
+}
+
 typedef struct
 {
 	glesh_vector3* pos;
@@ -147,8 +162,9 @@ typedef struct
 	int num_particles;
 	int video_offset;
 	float video_time;
+	int video_stream; /* of data->uploader */
+	glesh_texture video_texture; /* without the uploader */
 	glesh_object* particle_obj;
-	glesh_texture video_texture;
 	s_particle particles[MAX_PARTICLES];
 } s_widget;
 
@@ -156,7 +172,9 @@ typedef struct
 {
 	glesh_object* obj;
 	int num_widgets;
-	s_widget widgets[MAX_WIDGETS];
+	s_widget* widgets; /* allocated for all widgets of the desktop */
+	GLuint shadow_buffer; /* batched mode, one dynamic buffer per layer */
+	GLuint widget_buffer;
 } s_desktop;
 
 typedef struct
@@ -178,6 +196,14 @@ typedef struct
 	int wsize_loc;
 } s_shader_program;
 
+/* Window coordinates, x, y, width, height from the bottom left corner */
+typedef struct
+{
+	int full;
+	int num_rects;
+	EGLint rects[MAX_DAMAGE_RECTS * 4];
+} s_damage;
+
 typedef struct
 {
 	float rot_angle;
@@ -187,14 +213,34 @@ typedef struct
 	s_shader_program particle_shader;
 	s_scene scenes[MAX_SCENES];
 	unsigned char* video_images[NUM_VIDEO_IMAGES];
+	glesh_uploader uploader;
+	int num_video_widgets;
+	s_widget** video_widgets; /* by stream */
+	/* Without the uploader */
+	unsigned int video_frames;
+	double video_upload_time;
 	int num_scenes;
 	int flags;
+	glesh_atlas widget_atlas;
+	GLfloat* batch_vertices; /* for the widgets of one desktop */
+	unsigned int draw_calls; /* in the last frame */
+	float scroll_time; /* partial update, position in the scroll step */
+	float last_pos;
+	int swap_with_damage;
+	s_damage damage; /* of the frame being drawn */
+	s_damage damage_history[DAMAGE_HISTORY]; /* [0] is the previous frame */
+	unsigned int frames;
+	unsigned int partial_frames;
+	double redrawn_area; /* sum of the fraction of the window per frame */
 	test_configuration_file_params* test_config;
 } s_test_data;
 
 static int get_new_video_texture(s_test_data* data, int tex_id,
 	int offset, const GLenum format);
 
+#define VIDEO_UPLOADER_FLAGS (T_FLAG_SUBIMAGE_UPLOAD|T_FLAG_ASYNC_UPLOAD|\
+	T_FLAG_ZERO_COPY)
+
 static int generate_widget(glesh_context* context, s_test_data* data,
 	s_desktop* desktop, float posx, float posy, float timestamp)
 {
@@ -204,10 +250,24 @@ static int generate_widget(glesh_context* context, s_test_data* data,
 	char filename[PATH_MAX];
 	int img_id = (desktop->num_widgets + 1) % MAX_WIDGET_IMAGES + 1;
 
-	glesh_init_object(&object);
+	glesh_init_object(context, &object);
 	glesh_generate_rectangle_strip(0.3f, 0.3f, &object);
 
-	if(!(data->flags & T_FLAG_VIDEO_WIDGETS))
+	if(data->flags & T_FLAG_BATCH_WIDGETS)
+	{
+		/* Texture coordinates get remapped to the image in the atlas */
+		sprintf(filename, "%s/images/widgets/image%d.bmp", data_path, img_id);
+		tex = glesh_atlas_add_bmp_file(&data->widget_atlas, filename,
+			filename);
+		if(!tex)
+		{
+			BLTS_ERROR("Failed to add texture to atlas\n");
+			return 0;
+		}
+
+		glesh_attach_texture(&object, tex);
+	}
+	else if(!(data->flags & T_FLAG_VIDEO_WIDGETS))
 	{
 		sprintf(filename, "%s/images/widgets/image%d.bmp", data_path, img_id);
 		tex = glesh_texture_from_bmp_file(context, GL_RGBA, filename, filename,
@@ -220,6 +280,17 @@ static int generate_widget(glesh_context* context, s_test_data* data,
 
 		glesh_attach_texture(&object, tex);
 	}
+	else if(data->flags & VIDEO_UPLOADER_FLAGS)
+	{
+		/* Textures come from the uploader, started once all widgets are
+		 * known */
+		desktop->widgets[desktop->num_widgets].video_offset = rand();
+		desktop->widgets[desktop->num_widgets].video_time = timestamp;
+		desktop->widgets[desktop->num_widgets].video_stream =
+			data->num_video_widgets;
+		data->video_widgets[data->num_video_widgets++] =
+			&desktop->widgets[desktop->num_widgets];
+	}
 	else
 	{
 		desktop->widgets[desktop->num_widgets].video_texture.tex_id =
@@ -233,6 +304,11 @@ static int generate_widget(glesh_context* context, s_test_data* data,
 
 	desktop->widgets[desktop->num_widgets].obj =
 		glesh_add_object(context, &object);
+	if(data->flags & T_FLAG_VBO)
+	{
+		glesh_create_object_buffers(desktop->widgets[desktop->num_widgets].obj,
+			GL_STATIC_DRAW);
+	}
 	desktop->widgets[desktop->num_widgets].rel_pos_x = posx;
 	desktop->widgets[desktop->num_widgets].rel_pos_y = posy;
 
@@ -240,7 +316,7 @@ static int generate_widget(glesh_context* context, s_test_data* data,
 	{
 		GLfloat* vec;
 		s_widget* widget = &desktop->widgets[desktop->num_widgets];
-		glesh_init_object(&object);
+		glesh_init_object(context, &object);
 		widget->particle_obj = glesh_add_object(context, &object);
 		vec = glesh_add_vertices(widget->particle_obj,
 			data->test_config->particle_count);
@@ -263,7 +339,8 @@ static int generate_desktop(glesh_context* context, s_test_data* data,
 {
 	glesh_object object;
 	glesh_texture* tex;
-	int t, x, y;
+	int grid = WIDGET_GRID_SIZE;
+	int t;
 	char filename[PATH_MAX];
 
 	sprintf(filename, "%s/images/image%d.bmp", data_path,
@@ -284,23 +361,54 @@ static int generate_desktop(glesh_context* context, s_test_data* data,
 		return 0;
 	}
 
-	glesh_init_object(&object);
+	glesh_init_object(context, &object);
 	glesh_generate_rectangle_strip(2.0f, 2.0f, &object);
 	glesh_attach_texture(&object, tex);
 	scene->desktops[scene->num_desktops++].obj =
 		glesh_add_object(context, &object);
+	if(data->flags & T_FLAG_VBO)
+	{
+		glesh_create_object_buffers(scene->desktops[scene->num_desktops - 1].obj,
+			GL_STATIC_DRAW);
+	}
+
+	if(num_widgets)
+	{
+		scene->desktops[scene->num_desktops - 1].widgets =
+			calloc(num_widgets, sizeof(s_widget));
+		if(!scene->desktops[scene->num_desktops - 1].widgets)
+		{
+			BLTS_LOGGED_PERROR("calloc");
+			return 0;
+		}
+	}
+
+	if((data->flags & T_FLAG_BATCH_WIDGETS) && num_widgets)
+	{
+		glGenBuffers(1, &scene->desktops[scene->num_desktops - 1].widget_buffer);
+		if(data->flags & T_FLAG_WIDGET_SHADOWS)
+		{
+			glGenBuffers(1,
+				&scene->desktops[scene->num_desktops - 1].shadow_buffer);
+		}
+	}
 
-	t = 0;
-	for(y = 0; y < 4; y++)
+	while(grid * grid < num_widgets)
 	{
-		for(x = 0; x < 4; x++)
+		grid++;
+	}
+
+	/* Row by row over the same area whatever the grid size */
+	for(t = 0; t < num_widgets; t++)
+	{
+		if(!generate_widget(context, data,
+			&scene->desktops[scene->num_desktops - 1],
+			1.5f * (t % grid) / (grid - 1) - 0.8f,
+			-1.5f * (t / grid) / (grid - 1) + 0.7f,
+			(float)data->test_config->video_widget_generation_freq /
+			(float)num_widgets * (t + 1) / 1000.0f))
 		{
-			if(t++ >= num_widgets) break;
-			generate_widget(context, data,
-				&scene->desktops[scene->num_desktops - 1],
-				(float)x / 2.0f - 0.8f, (float)-y / 2.0f + 0.7f,
-				(float)data->test_config->video_widget_generation_freq /
-				(float)num_widgets * t / 1000.0f);
+			return 0;
 		}
 	}
 
@@ -379,7 +487,9 @@ static int get_shader_locs(s_test_data* data, s_shader_program* prog)
 	return 1;
 }
 
-static int build_convolution_filter(float* mat, int size, float divisor)
+/* Fragment shader of a size element square kernel, free() the result */
+char* test_blitter_convolution_shader(const float* mat, int size,
+	float divisor)
 {
 	int x, y, size_x, size_y;
 	int i = 0;
@@ -388,20 +498,20 @@ static int build_convolution_filter(float* mat, int size, float divisor)
 	char x_str[64];
 	char y_str[64];
 	float sum_weight = 0.0f;
+	char* shader;
 	char* tex2d_sums = malloc(size * max_line_len);
 	if(!tex2d_sums)
 	{
 		BLTS_LOGGED_PERROR("malloc");
-		return 0;
+		return NULL;
 	}
 
-	frag_shader_convolution = malloc(sizeof(convolution_template) +
-		size * max_line_len);
-	if(!frag_shader_convolution)
+	shader = malloc(sizeof(convolution_template) + size * max_line_len);
+	if(!shader)
 	{
 		BLTS_LOGGED_PERROR("malloc");
 		free(tex2d_sums);
-		return 0;
+		return NULL;
 	}
 
 	size_x = size_y = (int)sqrt(size);
@@ -480,21 +590,132 @@ static int build_convolution_filter(float* mat, int size, float divisor)
 
 	if(divisor != 0.0f)
 	{
-		sprintf(frag_shader_convolution, convolution_template, tex2d_sums,
-			divisor);
+		sprintf(shader, convolution_template, tex2d_sums, divisor);
 	}
 	else
 	{
-		sprintf(frag_shader_convolution, convolution_template, tex2d_sums,
-			sum_weight);
+		sprintf(shader, convolution_template, tex2d_sums, sum_weight);
+	}
+
+	free(tex2d_sums);
+	return shader;
+}
+
+/* A kernel_size x kernel_size filter with a mix of weights, so that all
+ * code paths of the generator are used */
+char* test_blitter_kernel_shader(int kernel_size)
+{
+	float mat[TEST_MAX_KERNEL_SIZE * TEST_MAX_KERNEL_SIZE];
+	int t;
+
+	if(kernel_size > TEST_MAX_KERNEL_SIZE)
+	{
+		BLTS_ERROR("Kernel size %d too large\n", kernel_size);
+		return NULL;
+	}
+
+	for(t = 0; t < kernel_size * kernel_size; t++)
+	{
+		mat[t] = (float)(t % 3) - 1.0f;
+		if(mat[t] == 0.0f)
+		{
+			mat[t] = 2.0f;
+		}
+	}
+
+	return test_blitter_convolution_shader(mat, kernel_size * kernel_size,
+		0.0f);
+}
+
+static int build_convolution_filter(float* mat, int size, float divisor)
+{
+	frag_shader_convolution = test_blitter_convolution_shader(mat, size,
+		divisor);
+	if(!frag_shader_convolution)
+	{
+		return 0;
 	}
 
 	BLTS_DEBUG("Used shader:\n%s\n", frag_shader_convolution);
 
-	free(tex2d_sums);
 	return 1;
 }
 
+/* Stands in for a video decoder, runs on the producer thread with
+ * T_FLAG_ASYNC_UPLOAD */
+static void produce_video_frame(void* user_ptr, int stream,
+	unsigned int frame, void* dst, int stride)
+{
+	s_test_data* data = user_ptr;
+	const s_widget* widget = data->video_widgets[stream];
+	const unsigned char* src = data->video_images[(widget->video_offset +
+		frame) % NUM_VIDEO_IMAGES];
+	int row_size = data->test_config->video_widget_tex_width * 4;
+	int y;
+
+	if(stride == row_size)
+	{
+		memcpy(dst, src, row_size * data->test_config->video_widget_tex_height);
+		return;
+	}
+
+	/* dma-bufs may have padded rows */
+	for(y = 0; y < data->test_config->video_widget_tex_height; y++)
+	{
+		memcpy((unsigned char*)dst + y * stride, src + y * row_size, row_size);
+	}
+}
+
+static int init_video_widgets(glesh_context* context, s_test_data* data)
+{
+	enum glesh_upload_mode mode = GLESH_UPLOAD_SYNC;
+	int buffers = VIDEO_SYNC_BUFFERS;
+
+	if(!data->num_video_widgets)
+	{
+		return 1;
+	}
+
+	if(data->flags & T_FLAG_ZERO_COPY)
+	{
+		if(glesh_upload_mode_supported(context, GLESH_UPLOAD_DMABUF))
+		{
+			mode = GLESH_UPLOAD_DMABUF;
+			buffers = VIDEO_ZERO_COPY_BUFFERS;
+		}
+		else
+		{
+			BLTS_DEBUG("dma-buf import not usable, copying with "
+				"glTexSubImage2D\n");
+			data->flags &= ~T_FLAG_ZERO_COPY;
+		}
+	}
+	else if(data->flags & T_FLAG_ASYNC_UPLOAD)
+	{
+		if(glesh_upload_mode_supported(context, GLESH_UPLOAD_THREADED))
+		{
+			mode = GLESH_UPLOAD_THREADED;
+			buffers = VIDEO_ASYNC_BUFFERS;
+		}
+		else
+		{
+			BLTS_DEBUG("Shared contexts or EGL_KHR_fence_sync not usable, "
+				"uploading on the render thread\n");
+			data->flags &= ~T_FLAG_ASYNC_UPLOAD;
+		}
+	}
+	if(mode == GLESH_UPLOAD_SYNC)
+	{
+		data->flags |= T_FLAG_SUBIMAGE_UPLOAD;
+	}
+
+	return glesh_uploader_start(&data->uploader, context, mode,
+		data->num_video_widgets, buffers,
+		data->test_config->video_widget_tex_width,
+		data->test_config->video_widget_tex_height, GL_RGBA, GL_UNSIGNED_BYTE,
+		produce_video_frame, data);
+}
+
 static int init(glesh_context* context, s_test_data* data)
 {
 	int t, i;
@@ -526,7 +747,30 @@ static int init(glesh_context* context, s_test_data* data)
 
 	if(data->flags & T_FLAG_WIDGETS)
 	{
-		widgetcount = data->test_config->widget_count;
+		widgetcount = GLESH_MAX(data->test_config->widget_count, 0);
+	}
+
+	if(widgetcount && (data->flags & T_FLAG_BATCH_WIDGETS))
+	{
+		data->batch_vertices = malloc(sizeof(GLfloat) * widgetcount *
+			BATCH_VERTICES_PER_WIDGET * BATCH_VERTEX_SIZE);
+		if(!data->batch_vertices)
+		{
+			BLTS_LOGGED_PERROR("malloc");
+			return 0;
+		}
+	}
+
+	/* Video widgets are on the topmost desktops only */
+	if(widgetcount && (data->flags & T_FLAG_VIDEO_WIDGETS))
+	{
+		data->video_widgets = malloc(sizeof(s_widget*) * widgetcount *
+			data->test_config->desktop_count);
+		if(!data->video_widgets)
+		{
+			BLTS_LOGGED_PERROR("malloc");
+			return 0;
+		}
 	}
 
 	if(data->flags & T_FLAG_BLEND)
@@ -534,6 +778,13 @@ static int init(glesh_context* context, s_test_data* data)
 		scenecount = data->test_config->layer_count;
 	}
 
+	if((data->flags & T_FLAG_BATCH_WIDGETS) &&
+		!glesh_atlas_init(context, &data->widget_atlas, GL_RGBA,
+		WIDGET_ATLAS_PAGE_SIZE))
+	{
+		return 0;
+	}
+
 	if(data->flags & T_FLAG_VIDEO_WIDGETS)
 	{
 		for(t = 0; t < NUM_VIDEO_IMAGES; t++)
@@ -551,20 +802,21 @@ static int init(glesh_context* context, s_test_data* data)
 		for(t = 0; t < data->test_config->desktop_count; t++)
 		{
 			/* Widgets only on topmost desktop */
-			if(i == 0)
+			if(!generate_desktop(context, data,
+				&data->scenes[data->num_scenes], i == 0 ? widgetcount : 0))
 			{
-				generate_desktop(context, data,
-					&data->scenes[data->num_scenes], widgetcount);
-			}
-			else
-			{
-				generate_desktop(context, data,
-					&data->scenes[data->num_scenes], 0);
+				return 0;
 			}
 		}
 		data->num_scenes++;
 	}
 
+	if(!init_video_widgets(context, data))
+	{
+		BLTS_ERROR("Failed to start video uploads\n");
+		return 0;
+	}
+
 	glUseProgram(data->base_shader.prog);
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glViewport(0, 0, context->width, context->height);
@@ -587,6 +839,20 @@ static int init(glesh_context* context, s_test_data* data)
 	data->rot_angle = 0.0f;
 	data->zoom_angle = 0.0f;
 
+	if(data->flags & T_FLAG_PARTIAL_UPDATE)
+	{
+		/* Nothing is known about the buffers before the first frame */
+		for(t = 0; t < DAMAGE_HISTORY; t++)
+		{
+			data->damage_history[t].full = 1;
+		}
+
+		data->swap_with_damage = glesh_swap_with_damage_init(context);
+		BLTS_DEBUG("EGL_EXT_buffer_age: %s, swap with damage: %s\n",
+			glesh_egl_extension_supported(context, "EGL_EXT_buffer_age") ?
+			"yes" : "no (full redraw)", data->swap_with_damage ? "yes" : "no");
+	}
+
 	return 1;
 }
 
@@ -627,6 +893,18 @@ static int get_new_video_texture(s_test_data* data, int tex_id,
 	return 1;
 }
 
+/* The texture is re-specified on the render thread, which stalls if the
+ * GPU still draws from it */
+static void respecify_video_texture(s_test_data* data, s_widget* widget)
+{
+	double start = glesh_time();
+
+	get_new_video_texture(data, widget->video_texture.tex_id,
+		++widget->video_offset, GL_RGBA);
+	data->video_upload_time += glesh_time() - start;
+	data->video_frames++;
+}
+
 static int draw_object(glesh_context* context, s_test_data* data,
 	glesh_object* object, s_shader_program* prog)
 {
@@ -647,14 +925,15 @@ static int draw_object(glesh_context* context, s_test_data* data,
 
 	glUniformMatrix4fv(prog->mvmatrix_loc, 1, GL_FALSE,
 		(GLfloat*)&object->modelview);
-	glVertexAttribPointer(prog->position_loc, 3, GL_FLOAT, GL_FALSE, 0,
-		object->vertices);
-	glVertexAttribPointer(prog->texcrd_loc, 2, GL_FLOAT, GL_FALSE, 0,
-		object->texcoords);
+	glesh_object_attrib_pointer(object, prog->position_loc,
+		GLESH_ATTRIB_POSITION);
+	glesh_object_attrib_pointer(object, prog->texcrd_loc,
+		GLESH_ATTRIB_TEXCOORD);
 	glEnableVertexAttribArray(prog->position_loc);
 	glEnableVertexAttribArray(prog->texcrd_loc);
 	glUniform1i(prog->sampler_loc, object->tex->tex_id);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	data->draw_calls++;
 	glesh_set_to_identity(&object->modelview);
 
 	return 1;
@@ -711,11 +990,56 @@ static int update_particle(glesh_context* context, s_particle* particle)
 	return 1;
 }
 
-static int draw_widget(glesh_context* context, s_test_data* data,
+static int draw_particles(glesh_context* context, s_test_data* data,
 	s_widget* widget, float pos)
 {
 	int t;
 
+	glUseProgram(data->particle_shader.prog);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	if(data->flags & T_FLAG_ZOOM)
+	{
+		glesh_translate(&widget->particle_obj->modelview, 0, 0,
+			data->zoom_angle);
+	}
+
+	if(data->flags & T_FLAG_ROTATE)
+	{
+		glesh_rotate(&widget->particle_obj->modelview, data->rot_angle,
+			0, 0, 1.0f);
+	}
+
+	glesh_translate(&widget->particle_obj->modelview,
+		pos + widget->rel_pos_x + 0.1f, widget->rel_pos_y - 0.1f, 0);
+
+	for(t = 0; t < widget->num_particles; t++)
+	{
+		update_particle(context, &widget->particles[t]);
+	}
+
+	glUniformMatrix4fv(data->particle_shader.pmatrix_loc, 1, GL_FALSE,
+		(GLfloat*)&context->perspective_mat);
+	glUniformMatrix4fv(data->particle_shader.mvmatrix_loc, 1, GL_FALSE,
+		(GLfloat*)&widget->particle_obj->modelview);
+
+	glUniform4f(data->particle_shader.wsize_loc, context->width,
+		context->height, 0.0f, 0.0f);
+	glesh_object_attrib_pointer(widget->particle_obj,
+		data->particle_shader.position_loc, GLESH_ATTRIB_POSITION);
+	glEnableVertexAttribArray(data->particle_shader.position_loc);
+	glDrawArrays(GL_POINTS, 0, widget->particle_obj->num_vertices);
+	data->draw_calls++;
+	glesh_set_to_identity(&widget->particle_obj->modelview);
+
+	glUseProgram(data->base_shader.prog);
+
+	return 1;
+}
+
+static int draw_widget(glesh_context* context, s_test_data* data,
+	s_widget* widget, float pos)
+{
 	if(data->flags & T_FLAG_BLEND)
 	{
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -738,70 +1062,170 @@ static int draw_widget(glesh_context* context, s_test_data* data,
 
 	if(data->flags & T_FLAG_PARTICLES)
 	{
-		glUseProgram(data->particle_shader.prog);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		draw_particles(context, data, widget, pos);
+	}
 
-		if(data->flags & T_FLAG_ZOOM)
+	return 1;
+}
+
+/* Transforms the quads of widgets on the given atlas page on the CPU with
+ * the same modelview draw_widget() would use */
+static int build_widget_batch(s_test_data* data, s_desktop* desktop,
+	GLuint page, float pos, float offset_x, float offset_y)
+{
+	/* Triangle strip v0 v1 v2 v3 as two triangles */
+	static const int quad_order[BATCH_VERTICES_PER_WIDGET] =
+		{ 0, 1, 2, 2, 1, 3 };
+	GLfloat* out = data->batch_vertices;
+	glesh_matrix mv;
+	int num_vertices = 0;
+	int t, i, c;
+
+	for(t = 0; t < desktop->num_widgets; t++)
+	{
+		s_widget* widget = &desktop->widgets[t];
+
+		if(widget->obj->tex->tex_id != page)
 		{
-			glesh_translate(&widget->particle_obj->modelview, 0, 0,
-				data->zoom_angle);
+			continue;
 		}
 
+		glesh_set_to_identity(&mv);
+		if(data->flags & T_FLAG_ZOOM)
+		{
+			glesh_translate(&mv, 0, 0, data->zoom_angle);
+		}
 		if(data->flags & T_FLAG_ROTATE)
 		{
-			glesh_rotate(&widget->particle_obj->modelview, data->rot_angle,
-				0, 0, 1.0f);
+			glesh_rotate(&mv, data->rot_angle, 0, 0, 1.0f);
 		}
+		glesh_translate(&mv, pos + widget->rel_pos_x + offset_x,
+			widget->rel_pos_y + offset_y, 0);
 
-		glesh_translate(&widget->particle_obj->modelview,
-			pos + widget->rel_pos_x + 0.1f, widget->rel_pos_y - 0.1f, 0);
-
-		for(t = 0; t < widget->num_particles; t++)
+		for(i = 0; i < BATCH_VERTICES_PER_WIDGET; i++)
 		{
-			update_particle(context, &widget->particles[t]);
+			const GLfloat* v = &widget->obj->vertices[quad_order[i] * 3];
+			const GLfloat* tc = &widget->obj->texcoords[quad_order[i] * 2];
+
+			/* Column-major, as uploaded with glUniformMatrix4fv */
+			for(c = 0; c < 3; c++)
+			{
+				*out++ = mv.m[0][c] * v[0] + mv.m[1][c] * v[1] +
+					mv.m[2][c] * v[2] + mv.m[3][c];
+			}
+			*out++ = tc[0];
+			*out++ = tc[1];
 		}
+		num_vertices += BATCH_VERTICES_PER_WIDGET;
+	}
 
-		glUniformMatrix4fv(data->particle_shader.pmatrix_loc, 1, GL_FALSE,
-			(GLfloat*)&context->perspective_mat);
-		glUniformMatrix4fv(data->particle_shader.mvmatrix_loc, 1, GL_FALSE,
-			(GLfloat*)&widget->particle_obj->modelview);
+	return num_vertices;
+}
 
-		glUniform4f(data->particle_shader.wsize_loc, context->width,
-			context->height, 0.0f, 0.0f);
-		glVertexAttribPointer(data->particle_shader.position_loc, 3, GL_FLOAT,
-			GL_FALSE, 0, widget->particle_obj->vertices);
-		glEnableVertexAttribArray(data->particle_shader.position_loc);
-		glDrawArrays(GL_POINTS, 0, widget->particle_obj->num_vertices);
-		glesh_set_to_identity(&widget->particle_obj->modelview);
+static int draw_widget_batch(glesh_context* context, s_test_data* data,
+	GLuint page, GLuint buffer, int num_vertices)
+{
+	s_shader_program* prog = &data->base_shader;
+	glesh_matrix identity;
+	const GLsizei stride = sizeof(GLfloat) * BATCH_VERTEX_SIZE;
 
-		glUseProgram(data->base_shader.prog);
+	glesh_set_to_identity(&identity);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, page);
+	glUniform1i(prog->sampler_loc, 0);
+	if(data->flags & T_FLAG_BLUR)
+	{
+		glUniform1f(prog->texsize_loc,
+			(float)data->widget_atlas.page_size / 2.0f);
 	}
 
+	glUniformMatrix4fv(prog->pmatrix_loc, 1, GL_FALSE,
+		(GLfloat*)&context->perspective_mat);
+	glUniformMatrix4fv(prog->mvmatrix_loc, 1, GL_FALSE, (GLfloat*)&identity);
+
+	/* Respecified every frame, lets the driver orphan the old storage */
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * BATCH_VERTEX_SIZE *
+		num_vertices, data->batch_vertices, GL_STREAM_DRAW);
+	glVertexAttribPointer(prog->position_loc, 3, GL_FLOAT, GL_FALSE, stride,
+		NULL);
+	glVertexAttribPointer(prog->texcrd_loc, 2, GL_FLOAT, GL_FALSE, stride,
+		(const GLvoid*)(sizeof(GLfloat) * 3));
+	glEnableVertexAttribArray(prog->position_loc);
+	glEnableVertexAttribArray(prog->texcrd_loc);
+	glDrawArrays(GL_TRIANGLES, 0, num_vertices);
+	data->draw_calls++;
+
 	return 1;
 }
 
-static int draw_widgets(glesh_context* context, s_test_data* data,
+static int draw_widgets_batched(glesh_context* context, s_test_data* data,
 	s_desktop* desktop, float pos)
 {
-	int t;
+	glesh_atlas* atlas = &data->widget_atlas;
+	int t, num_vertices;
 
-	for(t = 0; t < desktop->num_widgets; t++)
+	/* One draw per layer and atlas page, normally a single page */
+	if(data->flags & T_FLAG_WIDGET_SHADOWS)
 	{
-		if(data->flags & T_FLAG_VIDEO_WIDGETS)
+		if(data->flags & T_FLAG_BLEND)
+		{
+			glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+			glUniform1f(data->base_shader.opacity_loc, (GLfloat)0.5f);
+		}
+		for(t = 0; t < atlas->num_pages; t++)
 		{
-			desktop->widgets[t].video_time += glesh_time_step();
-			if(desktop->widgets[t].video_time >=
-				(float)data->test_config->video_widget_generation_freq / 1000.0f)
+			num_vertices = build_widget_batch(data, desktop,
+				atlas->pages[t].tex_id, pos, 0.1f, -0.1f);
+			if(num_vertices)
 			{
-				desktop->widgets[t].video_time = 0;
-				get_new_video_texture(data,
-					desktop->widgets[t].video_texture.tex_id,
-					++desktop->widgets[t].video_offset, GL_RGBA);
+				draw_widget_batch(context, data, atlas->pages[t].tex_id,
+					desktop->shadow_buffer, num_vertices);
 			}
-			glesh_attach_texture(desktop->widgets[t].obj,
-				&desktop->widgets[t].video_texture);
 		}
+	}
+
+	if(data->flags & T_FLAG_BLEND)
+	{
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glUniform1f(data->base_shader.opacity_loc, 1.0f);
+	}
+	for(t = 0; t < atlas->num_pages; t++)
+	{
+		num_vertices = build_widget_batch(data, desktop,
+			atlas->pages[t].tex_id, pos, 0.0f, 0.0f);
+		if(num_vertices)
+		{
+			draw_widget_batch(context, data, atlas->pages[t].tex_id,
+				desktop->widget_buffer, num_vertices);
+		}
+	}
+
+	if(data->flags & T_FLAG_PARTICLES)
+	{
+		for(t = 0; t < desktop->num_widgets; t++)
+		{
+			draw_particles(context, data, &desktop->widgets[t], pos);
+		}
+	}
+
+	return 1;
+}
+
+static int draw_widgets(glesh_context* context, s_test_data* data,
+	s_desktop* desktop, float pos)
+{
+	int t;
+
+	if(data->flags & T_FLAG_BATCH_WIDGETS)
+	{
+		return desktop->num_widgets ?
+			draw_widgets_batched(context, data, desktop, pos) : 1;
+	}
 
+	for(t = 0; t < desktop->num_widgets; t++)
+	{
 		if(data->flags & T_FLAG_WIDGET_SHADOWS)
 		{
 			draw_widget_shadow(context, data, &desktop->widgets[t], pos);
@@ -839,16 +1263,300 @@ static int draw_desktop(glesh_context* context, s_test_data* data,
 	return 1;
 }
 
-static int draw(glesh_context* context, void* user_ptr)
+static float desktop_pos(s_test_data* data, float pos, int scene,
+	int desktop)
+{
+	return (pos / (scene + 1)) +
+		(desktop - data->test_config->desktop_count / 2.0f) * 2.0f;
+}
+
+static void damage_full(s_damage* damage)
 {
+	damage->full = 1;
+	damage->num_rects = 0;
+}
+
+static void damage_add_rect(glesh_context* context, s_damage* damage,
+	int x0, int y0, int x1, int y1)
+{
+	EGLint* r;
+	int t;
+
+	if(damage->full)
+	{
+		return;
+	}
+
+	x0 = GLESH_MAX(x0, 0);
+	y0 = GLESH_MAX(y0, 0);
+	x1 = GLESH_MIN(x1, context->width);
+	y1 = GLESH_MIN(y1, context->height);
+	if(x1 <= x0 || y1 <= y0)
+	{
+		return;
+	}
+
+	if(x0 == 0 && y0 == 0 && x1 == context->width && y1 == context->height)
+	{
+		damage_full(damage);
+		return;
+	}
+
+	/* Too many to scissor one by one, redraw the bounding box */
+	if(damage->num_rects == MAX_DAMAGE_RECTS)
+	{
+		for(t = 0; t < damage->num_rects; t++)
+		{
+			r = &damage->rects[t * 4];
+			x0 = GLESH_MIN(x0, r[0]);
+			y0 = GLESH_MIN(y0, r[1]);
+			x1 = GLESH_MAX(x1, r[0] + r[2]);
+			y1 = GLESH_MAX(y1, r[1] + r[3]);
+		}
+		damage->num_rects = 0;
+	}
+
+	r = &damage->rects[damage->num_rects++ * 4];
+	r[0] = x0;
+	r[1] = y0;
+	r[2] = x1 - x0;
+	r[3] = y1 - y0;
+}
+
+/* Bounding box of the widget and its shadow as drawn without rotation or
+ * zoom, which damage the whole window anyway */
+static void damage_widget(glesh_context* context, s_test_data* data,
+	s_widget* widget, float pos)
+{
+	const GLfloat* v = widget->obj->vertices;
+	float x0, y0, x1, y1;
+	int t;
+
+	if(!v)
+	{
+		damage_full(&data->damage);
+		return;
+	}
+
+	x0 = x1 = v[0];
+	y0 = y1 = v[1];
+	for(t = 1; t < widget->obj->num_vertices; t++)
+	{
+		x0 = GLESH_MIN(x0, v[t * 3]);
+		x1 = GLESH_MAX(x1, v[t * 3]);
+		y0 = GLESH_MIN(y0, v[t * 3 + 1]);
+		y1 = GLESH_MAX(y1, v[t * 3 + 1]);
+	}
+
+	x0 += pos + widget->rel_pos_x;
+	x1 += pos + widget->rel_pos_x;
+	y0 += widget->rel_pos_y;
+	y1 += widget->rel_pos_y;
+
+	if(data->flags & T_FLAG_WIDGET_SHADOWS)
+	{
+		x1 += 0.1f;
+		y0 -= 0.1f;
+	}
+
+	/* To pixels, one extra for filtering at the edges */
+	damage_add_rect(context, &data->damage,
+		(int)floorf((x0 + 1.0f) * 0.5f * context->width) - 1,
+		(int)floorf((y0 + 1.0f) * 0.5f * context->height) - 1,
+		(int)ceilf((x1 + 1.0f) * 0.5f * context->width) + 1,
+		(int)ceilf((y1 + 1.0f) * 0.5f * context->height) + 1);
+}
+
+/* Once per frame, however many times the scene is drawn */
+static void update_video_widgets(glesh_context* context, s_test_data* data,
+	float pos)
+{
+	s_desktop* desktop;
+	s_widget* widget;
+	int t, i, w;
+
+	for(t = 0; t < data->num_scenes; t++)
+	{
+		for(i = 0; i < data->scenes[t].num_desktops; i++)
+		{
+			desktop = &data->scenes[t].desktops[i];
+			for(w = 0; w < desktop->num_widgets; w++)
+			{
+				widget = &desktop->widgets[w];
+				widget->video_time += glesh_time_step();
+				if(!(data->flags & VIDEO_UPLOADER_FLAGS))
+				{
+					if(widget->video_time >=
+						(float)data->test_config->video_widget_generation_freq /
+						1000.0f)
+					{
+						widget->video_time = 0;
+						respecify_video_texture(data, widget);
+						damage_widget(context, data, widget,
+							desktop_pos(data, pos, t, i));
+					}
+					glesh_attach_texture(widget->obj, &widget->video_texture);
+					continue;
+				}
+				if(widget->video_time >=
+					(float)data->test_config->video_widget_generation_freq /
+					1000.0f)
+				{
+					widget->video_time = 0;
+					glesh_upload_request(&data->uploader, widget->video_stream);
+				}
+				/* With T_FLAG_ASYNC_UPLOAD once the upload has finished */
+				if(glesh_upload_acquire(&data->uploader, widget->video_stream))
+				{
+					damage_widget(context, data, widget,
+						desktop_pos(data, pos, t, i));
+				}
+				glesh_attach_texture(widget->obj, glesh_upload_texture(
+					&data->uploader, widget->video_stream));
+			}
+		}
+	}
+}
+
+/* The back buffer misses the damage of the frames drawn since it was last
+ * used, buffer age - 1 of them, on top of the damage of this frame */
+static void get_redraw_region(glesh_context* context, s_test_data* data,
+	s_damage* redraw)
+{
+	const s_damage* old;
+	const EGLint* r;
+	int age = glesh_buffer_age(context);
 	int t, i;
+
+	*redraw = data->damage;
+
+	if(!age || age > DAMAGE_HISTORY + 1)
+	{
+		damage_full(redraw);
+		return;
+	}
+
+	for(t = 0; t < age - 1; t++)
+	{
+		old = &data->damage_history[t];
+		if(old->full)
+		{
+			damage_full(redraw);
+			return;
+		}
+
+		for(i = 0; i < old->num_rects; i++)
+		{
+			r = &old->rects[i * 4];
+			damage_add_rect(context, redraw, r[0], r[1], r[0] + r[2],
+				r[1] + r[3]);
+		}
+	}
+}
+
+static void draw_scene(glesh_context* context, s_test_data* data, float pos)
+{
+	int t, i;
+
+	for(t = data->num_scenes - 1; t >= 0; t--)
+	{
+		if(data->flags & T_FLAG_BLEND)
+		{
+			glUniform1f(data->base_shader.opacity_loc, 1.0f / (float)(t + 1) / 2.0f);
+		}
+
+		for(i = 0; i < data->scenes[t].num_desktops; i++)
+		{
+			draw_desktop(context, data, &data->scenes[t].desktops[i],
+				desktop_pos(data, pos, t, i));
+		}
+	}
+}
+
+/* Redraws only what changed since the back buffer was last drawn to, one
+ * scissored pass over the scene per rectangle */
+static int draw_partial(glesh_context* context, s_test_data* data, float pos,
+	GLbitfield clear_mask)
+{
+	s_damage redraw;
+	const EGLint* r;
+	int t;
+
+	/* Anything that moves the whole scene damages all of it */
+	if(pos != data->last_pos ||
+		(data->flags & (T_FLAG_ROTATE|T_FLAG_ZOOM|T_FLAG_PARTICLES)))
+	{
+		damage_full(&data->damage);
+	}
+	data->last_pos = pos;
+
+	get_redraw_region(context, data, &redraw);
+
+	if(redraw.full)
+	{
+		glClear(clear_mask);
+		draw_scene(context, data, pos);
+		data->redrawn_area += 1.0;
+	}
+	else
+	{
+		glEnable(GL_SCISSOR_TEST);
+		for(t = 0; t < redraw.num_rects; t++)
+		{
+			r = &redraw.rects[t * 4];
+			glScissor(r[0], r[1], r[2], r[3]);
+			glClear(clear_mask);
+			draw_scene(context, data, pos);
+			data->redrawn_area += (double)r[2] * r[3] /
+				((double)context->width * context->height);
+		}
+		glDisable(GL_SCISSOR_TEST);
+		data->partial_frames++;
+	}
+	data->frames++;
+
+	/* No rectangles would mean the whole surface, so an undamaged frame
+	 * is swapped as a full one */
+	if(data->swap_with_damage && !data->damage.full && data->damage.num_rects)
+	{
+		glesh_swap_buffers_with_damage(context, data->damage.rects,
+			data->damage.num_rects);
+	}
+	else
+	{
+		glesh_swap_buffers(context);
+	}
+
+	memmove(&data->damage_history[1], &data->damage_history[0],
+		sizeof(s_damage) * (DAMAGE_HISTORY - 1));
+	data->damage_history[0] = data->damage;
+
+	return 1;
+}
+
+static int draw(glesh_context* context, void* user_ptr)
+{
 	s_test_data* data = (s_test_data*)user_ptr;
+	GLbitfield clear_mask = GL_COLOR_BUFFER_BIT;
 	float pos;
 
-	glClear(GL_COLOR_BUFFER_BIT);
+	data->draw_calls = 0;
+	data->damage.full = 0;
+	data->damage.num_rects = 0;
 
-	data->scroll_angle += glesh_time_step() * GLESH_COS_SIN_TABLE_SIZE /
-		(float)data->test_config->scroll_speed;
+	/* Partial update scrolls in steps and holds still in between, like a
+	 * compositor switching between desktops */
+	if(data->flags & T_FLAG_PARTIAL_UPDATE)
+	{
+		data->scroll_time = fmodf(data->scroll_time + glesh_time_step(),
+			SCROLL_STEP_TIME + SCROLL_HOLD_TIME);
+	}
+	if(!(data->flags & T_FLAG_PARTIAL_UPDATE) ||
+		data->scroll_time < SCROLL_STEP_TIME)
+	{
+		data->scroll_angle += glesh_time_step() * GLESH_COS_SIN_TABLE_SIZE /
+			(float)data->test_config->scroll_speed;
+	}
 	pos = context->cos_table[((int)data->scroll_angle)&GLESH_COS_SIN_TABLE_MASK] *
 		(data->test_config->desktop_count - 1.0f) + 1.0f;
 
@@ -859,35 +1567,88 @@ static int draw(glesh_context* context, void* user_ptr)
 
 	if(data->flags & T_FLAG_ZOOM)
 	{
-		glClear(GL_DEPTH_BUFFER_BIT);
+		clear_mask |= GL_DEPTH_BUFFER_BIT;
 		data->zoom_angle = context->sin_table[
 			((int)data->scroll_angle)&GLESH_COS_SIN_TABLE_MASK] - 2.0f;
 	}
 
-	for(t = data->num_scenes - 1; t >= 0; t--)
+	if(data->flags & T_FLAG_VIDEO_WIDGETS)
 	{
-		if(data->flags & T_FLAG_BLEND)
-		{
-			glUniform1f(data->base_shader.opacity_loc, 1.0f / (float)(t + 1) / 2.0f);
-		}
+		update_video_widgets(context, data, pos);
+	}
 
-		for(i = 0; i < data->scenes[t].num_desktops; i++)
-		{
-			draw_desktop(context, data, &data->scenes[t].desktops[i],
-				(pos / (t + 1)) + (i - data->test_config->desktop_count / 2.0f) * 2.0f);
-		}
+	if(data->flags & T_FLAG_PARTIAL_UPDATE)
+	{
+		return draw_partial(context, data, pos, clear_mask);
 	}
 
-	eglSwapBuffers(context->egl_display, context->egl_surface);
+	glClear(clear_mask);
+	draw_scene(context, data, pos);
+
+	glesh_swap_buffers(context);
 	return 1;
 }
 
+/* requested_flags are those of the case, before any fallback */
+static void report_video_uploads(s_test_data* data, int requested_flags)
+{
+	const glesh_uploader* uploader = &data->uploader;
+
+	if(!(data->flags & VIDEO_UPLOADER_FLAGS))
+	{
+		BLTS_DEBUG("Video frames: %u re-specified\n", data->video_frames);
+		glesh_report_directed_result("video_frames_shown", data->video_frames,
+			"frames", GLESH_HIGHER_IS_BETTER);
+		glesh_report_result("video_render_thread_time",
+			data->video_upload_time * 1000.0 / data->video_frames, "ms");
+		return;
+	}
+
+	/* 0 when the case fell back to glTexSubImage2D on the render thread,
+	 * so that its results are not taken for those of the mode it names */
+	if(requested_flags & T_FLAG_ASYNC_UPLOAD)
+	{
+		glesh_report_directed_result("async_upload_active",
+			!!(data->flags & T_FLAG_ASYNC_UPLOAD), "", GLESH_HIGHER_IS_BETTER);
+	}
+	if(requested_flags & T_FLAG_ZERO_COPY)
+	{
+		glesh_report_directed_result("zero_copy_active",
+			!!(data->flags & T_FLAG_ZERO_COPY), "", GLESH_HIGHER_IS_BETTER);
+	}
+
+	BLTS_DEBUG("Video frames: %u uploaded, %u shown, %u dropped\n",
+		uploader->frames_uploaded, uploader->frames_shown,
+		uploader->frames_dropped);
+	glesh_report_directed_result("video_frames_shown", uploader->frames_shown,
+		"frames", GLESH_HIGHER_IS_BETTER);
+	glesh_report_result("video_frames_dropped", uploader->frames_dropped,
+		"frames");
+	if(uploader->frames_uploaded)
+	{
+		/* Copy, or with T_FLAG_ZERO_COPY the write into the dma-buf */
+		glesh_report_result("video_upload_time", uploader->upload_time *
+			1000.0 / uploader->frames_uploaded, "ms");
+	}
+	if(uploader->imports)
+	{
+		BLTS_DEBUG("dma-bufs from %s, %u imported\n",
+			glesh_dmabuf_type_name(uploader->allocator.type),
+			uploader->imports);
+		glesh_report_result("video_import_time", uploader->import_time *
+			1000.0 / uploader->imports, "ms");
+	}
+	/* What each frame of video costs the compositor */
+	glesh_report_result("video_render_thread_time",
+		uploader->render_thread_time * 1000.0 / uploader->frames_shown, "ms");
+}
 
 int test_blitter(test_execution_params* params)
 {
 	glesh_context* context = NULL;
 	s_test_data* data = NULL;
 	int ret = -1;
+	int t;
 
 	data = malloc(sizeof(s_test_data));
 	if(!data)
@@ -954,6 +1715,42 @@ int test_blitter(test_execution_params* params)
 		BLTS_DEBUG("- Video thumbnails (texture size: %d x %d)\n",
 			data->test_config->video_widget_tex_width,
 			data->test_config->video_widget_tex_height);
+		if(data->flags & T_FLAG_ASYNC_UPLOAD)
+		{
+			BLTS_DEBUG("- Video frames uploaded on a separate thread\n");
+		}
+		if(data->flags & T_FLAG_ZERO_COPY)
+		{
+			BLTS_DEBUG("- Video frames written to imported dma-bufs\n");
+		}
+		if(data->flags & T_FLAG_SUBIMAGE_UPLOAD)
+		{
+			BLTS_DEBUG("- Video frames double buffered with "
+				"glTexSubImage2D\n");
+		}
+	}
+
+	if(data->flags & T_FLAG_VBO)
+	{
+		BLTS_DEBUG("- Vertex buffer objects\n");
+	}
+
+	if(data->flags & T_FLAG_BATCH_WIDGETS)
+	{
+		if(data->flags & T_FLAG_VIDEO_WIDGETS)
+		{
+			BLTS_DEBUG("Video widgets can not be batched, drawing one by one\n");
+			data->flags &= ~T_FLAG_BATCH_WIDGETS;
+		}
+		else
+		{
+			BLTS_DEBUG("- Batched widgets (one draw per layer)\n");
+		}
+	}
+
+	if(data->flags & T_FLAG_PARTIAL_UPDATE)
+	{
+		BLTS_DEBUG("- Partial update (scrolling in steps)\n");
 	}
 
 	if(data->flags & T_FLAG_CONVOLUTION)
@@ -981,12 +1778,47 @@ int test_blitter(test_execution_params* params)
 		goto cleanup;
 	}
 
+	BLTS_DEBUG("Draw calls per frame: %u\n", data->draw_calls);
+	glesh_report_result("draw_calls_per_frame", data->draw_calls, "calls");
+
+	if((data->flags & T_FLAG_PARTIAL_UPDATE) && data->frames)
+	{
+		BLTS_DEBUG("Partially redrawn frames: %u of %u, %lf %% of the window "
+			"redrawn per frame\n", data->partial_frames, data->frames,
+			data->redrawn_area * 100.0 / data->frames);
+		/* Fewer means more full redraws */
+		glesh_report_directed_result("partial_frames", data->partial_frames,
+			"frames", GLESH_HIGHER_IS_BETTER);
+		glesh_report_result("redrawn_area",
+			data->redrawn_area * 100.0 / data->frames, "%");
+	}
+
+	if(data->uploader.frames_shown || data->video_frames)
+	{
+		report_video_uploads(data, params->flag);
+	}
+
 	ret = 0;
 
 cleanup:
 
 	if(data)
 	{
+		/* Stops the threads reading video_images */
+		glesh_uploader_destroy(&data->uploader);
+		for(t = 0; t < NUM_VIDEO_IMAGES; t++)
+		{
+			free(data->video_images[t]);
+		}
+		/* Also those of a scene that failed half way */
+		for(t = 0; t < MAX_SCENES * MAX_DESKTOPS; t++)
+		{
+			free(data->scenes[t / MAX_DESKTOPS].desktops[t % MAX_DESKTOPS].
+				widgets);
+		}
+		free(data->video_widgets);
+		free(data->batch_vertices);
+		glesh_atlas_destroy(&data->widget_atlas);
 		free(data);
 	}
 
@@ -21,12 +21,32 @@
 
 /* Max/min and other parameters */
 #define NUM_VIDEO_IMAGES 8
+/* Textures per video widget with the uploader, the next frame is uploaded
+ * to one that is not drawn from. Without T_FLAG_SUBIMAGE_UPLOAD,
+ * T_FLAG_ASYNC_UPLOAD or T_FLAG_ZERO_COPY each widget has one texture that
+ * is re-specified with glTexImage2D for every frame. */
+#define VIDEO_SYNC_BUFFERS 2
+#define VIDEO_ASYNC_BUFFERS 3
+#define VIDEO_ZERO_COPY_BUFFERS 3
 #define MAX_DESKTOPS 16
 #define MAX_SCENES 16
-#define MAX_WIDGETS 16
+/* Widgets are laid out on a grid of at least this many columns and rows;
+ * more than fit get a denser grid over the same area */
+#define WIDGET_GRID_SIZE 4
 #define MAX_WIDGET_IMAGES 4
+/* Batched widgets: two triangles of position + texcoord per widget */
+#define BATCH_VERTEX_SIZE 5
+#define BATCH_VERTICES_PER_WIDGET 6
+#define WIDGET_ATLAS_PAGE_SIZE 512
 #define MAX_PARTICLES 40
 #define PARTICLE_LIFETIME 1.0f
+/* Partial update: damage rectangles per frame before they are merged and
+ * frames of damage kept for EGL_EXT_buffer_age */
+#define MAX_DAMAGE_RECTS 8
+#define DAMAGE_HISTORY 4
+/* Partial update: scroll for this long, then hold still (seconds) */
+#define SCROLL_STEP_TIME 0.5f
+#define SCROLL_HOLD_TIME 2.0f
 
 /* Possible flags for test_blitter */
 #define T_FLAG_BLEND 1
@@ -38,6 +58,11 @@
 #define T_FLAG_PARTICLES 64
 #define T_FLAG_VIDEO_WIDGETS 128
 #define T_FLAG_CONVOLUTION 256
+#define T_FLAG_BATCH_WIDGETS 512
+#define T_FLAG_PARTIAL_UPDATE 1024
+#define T_FLAG_ASYNC_UPLOAD 2048 /* video widgets uploaded on threads */
+#define T_FLAG_ZERO_COPY 4096 /* video widgets imported from dma-bufs */
+#define T_FLAG_SUBIMAGE_UPLOAD 8192 /* video widgets double buffered */
 
 #endif // TEST_BLITTER
 
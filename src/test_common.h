@@ -25,6 +25,13 @@
 
 #define MAX_CONV_MAT_SIZE 128
 
+/* Flags common to all tests. Test specific flags use the low bits, see
+ * test_blitter.h */
+#define T_FLAG_VBO (1<<16)
+#define T_FLAG_INTERLEAVED (1<<17)
+#define T_FLAG_COMPACT_VERTICES (1<<18) /* implies T_FLAG_INTERLEAVED */
+#define T_FLAG_OPTIMIZE_VERTEX_CACHE (1<<19)
+
 typedef struct
 {
 	int scale_images_to_window;
@@ -50,6 +57,19 @@ typedef struct
 	int d;
 	int flag;
 	enum glesh_ws_context_type ws;
+	double frame_budgets[GLESH_MAX_FRAME_BUDGETS];
+	int num_frame_budgets;
+	int warmup_frames;
+	double warmup_time;
+	int steady_state;
+	int gpu_timing;
+	int swap_interval; /* -1 for the EGL default */
+	int wayland_feedback; /* enum glesh_wayland_feedback flags */
+	const char* program_cache; /* directory, NULL to always compile */
+	int runs; /* of each case */
+	int cooldown; /* seconds between runs */
+	int compare_baseline;
+	double tolerance; /* percent, overrides the per-case tolerance if >= 0 */
 	test_configuration_file_params config;
 } test_execution_params;
 
@@ -63,6 +83,29 @@ int test_enum_glextensions(test_execution_params* params);
 int test_enum_eglextensions(test_execution_params* params);
 int test_enum_eglconfigs(test_execution_params* params);
 int test_blitter(test_execution_params* params);
+int test_shader_compile(test_execution_params* params);
+int test_parallel_compile(test_execution_params* params);
+int test_texture_upload(test_execution_params* params);
+int test_texture_reuse(test_execution_params* params);
+
+/* Shaders of the cases, for test_shader_compile() */
+typedef struct
+{
+	const char* name;
+	const char* vertex;
+	const char* fragment;
+} test_shader_program;
+
+/* Convolution kernels of the shader benchmarks, odd sizes */
+#define TEST_MIN_KERNEL_SIZE 3
+#define TEST_MAX_KERNEL_SIZE 15
+
+int test_blitter_programs(const test_shader_program** programs);
+char* test_blitter_convolution_shader(const float* mat, int size,
+	float divisor);
+char* test_blitter_kernel_shader(int kernel_size);
+int test_vert_shader_programs(const test_shader_program** programs);
+int test_frag_shader_programs(const test_shader_program** programs);
 
 #endif // TEST_COMMON_H
 
@@ -45,6 +45,7 @@ typedef struct
 static int init(glesh_context* context, s_test_data* data)
 {
 	glesh_object object;
+	glesh_object* obj;
 
 	data->shader_program = glesh_load_program(vertex_shader, frag_shader);
 	if(!data->shader_program)
@@ -57,16 +58,20 @@ static int init(glesh_context* context, s_test_data* data)
 		"a_position");
 	data->color_loc = glGetUniformLocation(data->shader_program, "u_color");
 
-	glesh_init_object(&object);
+	glesh_init_object(context, &object);
 	glesh_generate_rectangle_strip(2.0f, 2.0f, &object);
-	glesh_add_object(context, &object);
+	obj = glesh_add_object(context, &object);
+	if(!obj)
+	{
+		return 0;
+	}
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
 	glUseProgram(data->shader_program);
 
 	glVertexAttribPointer(data->position_loc, 3, GL_FLOAT, GL_FALSE, 0,
-		context->objects[0].vertices);
+		obj->vertices);
 	glEnableVertexAttribArray(data->position_loc);
 
 	glViewport(0, 0, context->width, context->height);
@@ -83,7 +88,7 @@ static int draw(glesh_context* context, void* user_ptr)
 	if(data->color >= 1.0f) data->color = 0.0f;
 	glUniform1f(data->color_loc, data->color);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	eglSwapBuffers(context->egl_display, context->egl_surface);
+	glesh_swap_buffers(context);
 	return 1;
 }
 
@@ -92,6 +97,7 @@ int test_fillrate(test_execution_params* params)
 {
 	glesh_context context;
 	s_test_data data;
+	double pixels_per_second;
 
 	if(!glesh_create_context(&context, NULL, params->w, params->h, params->d))
 	{
@@ -110,9 +116,11 @@ int test_fillrate(test_execution_params* params)
 		BLTS_ERROR("glesh_execute_main_loop failed!\n");
 	}
 
-	BLTS_DEBUG("Pixels per second: %lf\n", context.width * context.height *
+	pixels_per_second = (double)context.width * context.height *
 		context.perf_data.frames_rendered /
-		context.perf_data.total_time_elapsed);
+		context.perf_data.total_time_elapsed;
+	BLTS_DEBUG("Pixels per second: %lf\n", pixels_per_second);
+	glesh_report_result("pixels_per_second", pixels_per_second, "1/s");
 
 	glesh_destroy_context(&context);
 
@@ -68,6 +68,17 @@ static const char frag_shader[] =
 	"	gl_FragColor = color;\n"
 	"}\n";
 
+static const test_shader_program programs[] =
+{
+	{ "frag_shader", vertex_shader, frag_shader },
+};
+
+int test_frag_shader_programs(const test_shader_program** out)
+{
+	*out = programs;
+	return ARRAY_SIZE(programs);
+}
+
 typedef struct
 {
 	int position_loc;
@@ -81,6 +92,7 @@ typedef struct
 static int init(glesh_context* context, s_test_data* data)
 {
 	glesh_object object;
+	glesh_object* obj;
 
 	data->shader_program = glesh_load_program(vertex_shader, frag_shader);
 	if(!data->shader_program)
@@ -95,16 +107,20 @@ static int init(glesh_context* context, s_test_data* data)
 	data->scale_y_loc = glGetUniformLocation(data->shader_program, "scale_y");
 	data->ripple_loc = glGetUniformLocation(data->shader_program, "ripple");
 
-	glesh_init_object(&object);
+	glesh_init_object(context, &object);
 	glesh_generate_rectangle_strip(2.0f, 2.0f, &object);
-	glesh_add_object(context, &object);
+	obj = glesh_add_object(context, &object);
+	if(!obj)
+	{
+		return 0;
+	}
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
 	glUseProgram(data->shader_program);
 
 	glVertexAttribPointer(data->position_loc, 3, GL_FLOAT, GL_FALSE, 0,
-		context->objects[0].vertices);
+		obj->vertices);
 	glEnableVertexAttribArray(data->position_loc);
 
 	data->ripple = 0.0f;
@@ -122,7 +138,7 @@ static int draw(glesh_context* context, void* user_ptr)
 	data->ripple += 0.1f;
 	glUniform1f(data->ripple_loc, data->ripple);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	eglSwapBuffers(context->egl_display, context->egl_surface);
+	glesh_swap_buffers(context);
 	return 1;
 }
 
@@ -0,0 +1,304 @@
+/* test_parallel_compile.c -- Serial and parallel shader compilation
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ogles2_helper.h"
+#include "test_common.h"
+
+#define MAX_PROGRAMS 16
+/* serial, threads 1, 2, 4, ..., the CPU count and KHR_parallel_shader_compile */
+#define MAX_CONFIGS 8
+
+typedef struct
+{
+	char name[32];
+	enum glesh_compile_mode mode;
+	int num_threads;
+	/* Sums over all rounds, in seconds */
+	double total_time;
+	double blocking_time; /* spent in the glesh_compiler_* calls */
+} s_config;
+
+typedef struct
+{
+	glesh_context* context;
+	const char* vertex[MAX_PROGRAMS];
+	char* fragment[MAX_PROGRAMS];
+	int num_programs;
+	s_config configs[MAX_CONFIGS];
+	int num_configs;
+	int rounds;
+	int generation; /* makes the sources of each build unique */
+} s_test_data;
+
+/* The programs test_blitter builds at start-up */
+static int init_programs(s_test_data* data)
+{
+	const test_shader_program* programs;
+	int count = test_blitter_programs(&programs);
+	int size, t;
+
+	for(t = 0; t < count; t++)
+	{
+		data->vertex[data->num_programs] = programs[t].vertex;
+		data->fragment[data->num_programs] = strdup(programs[t].fragment);
+		if(!data->fragment[data->num_programs++])
+		{
+			BLTS_LOGGED_PERROR("strdup");
+			return 0;
+		}
+	}
+
+	for(size = TEST_MIN_KERNEL_SIZE; size <= TEST_MAX_KERNEL_SIZE; size += 2)
+	{
+		data->vertex[data->num_programs] = programs[0].vertex;
+		data->fragment[data->num_programs] = test_blitter_kernel_shader(size);
+		if(!data->fragment[data->num_programs++])
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void add_config(s_test_data* data, const char* name,
+	enum glesh_compile_mode mode, int num_threads)
+{
+	s_config* config = &data->configs[data->num_configs++];
+
+	memset(config, 0, sizeof(s_config));
+	snprintf(config->name, sizeof(config->name), "%s", name);
+	config->mode = mode;
+	config->num_threads = num_threads;
+}
+
+static void init_configs(s_test_data* data)
+{
+	glesh_context* context = data->context;
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int max_threads = GLESH_MIN(GLESH_MAX(cpus, 2),
+		GLESH_MIN(data->num_programs, GLESH_MAX_COMPILER_THREADS));
+	char name[32];
+	int threads;
+
+	add_config(data, "serial", GLESH_COMPILE_SERIAL, 0);
+
+	if(glesh_compile_mode_supported(context, GLESH_COMPILE_THREADS))
+	{
+		for(threads = 1; data->num_configs < MAX_CONFIGS - 1; threads *= 2)
+		{
+			threads = GLESH_MIN(threads, max_threads);
+			sprintf(name, "threads_%d", threads);
+			add_config(data, name, GLESH_COMPILE_THREADS, threads);
+			if(threads == max_threads)
+			{
+				break;
+			}
+		}
+	}
+	else
+	{
+		BLTS_DEBUG("Shared contexts not usable, no worker threads\n");
+	}
+
+	if(glesh_compile_mode_supported(context, GLESH_COMPILE_KHR_PARALLEL))
+	{
+		add_config(data, "khr_parallel", GLESH_COMPILE_KHR_PARALLEL, 0);
+	}
+	else
+	{
+		BLTS_DEBUG("GL_KHR_parallel_shader_compile not supported\n");
+	}
+
+	BLTS_DEBUG("CPUs: %d\n", cpus);
+}
+
+/* Builds all programs and polls them from this thread like a render loop
+ * would, sleeping briefly while nothing is ready */
+static int run_config(s_test_data* data, s_config* config)
+{
+	glesh_program_future futures[MAX_PROGRAMS];
+	char* fragment[MAX_PROGRAMS];
+	glesh_compiler compiler;
+	double start, call;
+	GLint linked;
+	int pending = data->num_programs;
+	int ret = 0;
+	int t;
+
+	/* A new comment makes every build new to the driver's shader cache */
+	memset(fragment, 0, sizeof(fragment));
+	for(t = 0; t < data->num_programs; t++)
+	{
+		fragment[t] = malloc(strlen(data->fragment[t]) + 32);
+		if(!fragment[t])
+		{
+			BLTS_LOGGED_PERROR("malloc");
+			goto cleanup;
+		}
+		sprintf(fragment[t], "// build %d\n%s", data->generation++,
+			data->fragment[t]);
+		futures[t].vertex_src = data->vertex[t];
+		futures[t].fragment_src = fragment[t];
+	}
+
+	start = glesh_time();
+	if(!glesh_compiler_start(&compiler, data->context, config->mode,
+		config->num_threads, futures, data->num_programs))
+	{
+		goto cleanup;
+	}
+	config->blocking_time += glesh_time() - start;
+
+	while(pending)
+	{
+		call = glesh_time();
+		for(t = 0, pending = 0; t < data->num_programs; t++)
+		{
+			pending += !glesh_program_ready(&compiler, &futures[t]);
+		}
+		config->blocking_time += glesh_time() - call;
+		if(pending)
+		{
+			usleep(100);
+		}
+	}
+
+	call = glesh_time();
+	ret = glesh_compiler_finish(&compiler);
+	config->blocking_time += glesh_time() - call;
+	config->total_time += glesh_time() - start;
+
+	/* Programs of the worker contexts must be usable here, linked as
+	 * seen by this context and not just a valid name */
+	for(t = 0; t < data->num_programs; t++)
+	{
+		if(futures[t].state != GLESH_FUTURE_DONE)
+		{
+			continue;
+		}
+		linked = 0;
+		glGetProgramiv(futures[t].program, GL_LINK_STATUS, &linked);
+		glUseProgram(futures[t].program);
+		if(glGetError() != GL_NO_ERROR || !linked)
+		{
+			BLTS_ERROR("Program %d of %s not usable\n", t, config->name);
+			ret = 0;
+		}
+		glUseProgram(0);
+		glDeleteProgram(futures[t].program);
+	}
+
+cleanup:
+	for(t = 0; t < data->num_programs; t++)
+	{
+		free(fragment[t]);
+	}
+
+	return ret;
+}
+
+static void report(s_test_data* data)
+{
+	double serial_time = data->configs[0].total_time;
+	double n = data->rounds;
+	s_config* config;
+	char tag[64];
+	int t;
+
+	BLTS_DEBUG("Programs: %d, rounds: %d\n", data->num_programs, data->rounds);
+	BLTS_DEBUG("%-16s %10s %10s %8s\n", "mode", "total", "blocking",
+		"speedup");
+
+	for(t = 0; t < data->num_configs; t++)
+	{
+		config = &data->configs[t];
+		BLTS_DEBUG("%-16s %10.3f %10.3f %8.2f\n", config->name,
+			config->total_time * 1000.0 / n,
+			config->blocking_time * 1000.0 / n,
+			serial_time / config->total_time);
+
+		sprintf(tag, "%s_time", config->name);
+		glesh_report_result(tag, config->total_time * 1000.0 / n, "ms");
+		if(config->mode != GLESH_COMPILE_SERIAL)
+		{
+			/* What the render thread can not spend on frames */
+			sprintf(tag, "%s_blocking_time", config->name);
+			glesh_report_result(tag, config->blocking_time * 1000.0 / n,
+				"ms");
+		}
+	}
+}
+
+int test_parallel_compile(test_execution_params* params)
+{
+	glesh_context context;
+	s_test_data data;
+	double start;
+	int ret = -1;
+	int t;
+
+	memset(&data, 0, sizeof(s_test_data));
+
+	if(!glesh_create_context(&context, NULL, params->w, params->h, params->d))
+	{
+		BLTS_ERROR("glesh_create_context failed!\n");
+		return -1;
+	}
+	data.context = &context;
+
+	if(!init_programs(&data))
+	{
+		BLTS_ERROR("Failed to generate shaders\n");
+		goto cleanup;
+	}
+	init_configs(&data);
+
+	/* Configurations alternate, so that slow drifts of e.g. the CPU clock
+	 * affect all of them alike */
+	start = glesh_time();
+	do
+	{
+		for(t = 0; t < data.num_configs; t++)
+		{
+			if(!run_config(&data, &data.configs[t]))
+			{
+				BLTS_ERROR("Compiling with %s failed\n",
+					data.configs[t].name);
+				goto cleanup;
+			}
+		}
+		data.rounds++;
+	} while(glesh_time() - start < params->execution_time);
+
+	report(&data);
+	ret = 0;
+
+cleanup:
+	for(t = 0; t < data.num_programs; t++)
+	{
+		free(data.fragment[t]);
+	}
+	glesh_destroy_context(&context);
+
+	return ret;
+}
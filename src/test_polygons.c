@@ -20,6 +20,11 @@
 #include "ogles2_helper.h"
 #include "test_common.h"
 
+#define SPHERE_SLICES 1000
+/* (360 / 2 + 1) * (360 + 1) = 65341 vertices, few enough for 16-bit
+ * indices */
+#define SPHERE_SLICES_16BIT 360
+
 static const char vertex_shader[] =
 	"attribute vec4 a_position;\n"
 	"void main()\n"
@@ -37,7 +42,12 @@ static const char frag_shader[] =
 typedef struct
 {
 	int position_loc;
+	int flags;
+	const GLvoid* indices;
+	double acmr;
+	GLenum index_type;
 	GLuint shader_program;
+	glesh_object* obj;
 } s_test_data;
 
 static int init(glesh_context* context, s_test_data* data)
@@ -53,28 +63,89 @@ static int init(glesh_context* context, s_test_data* data)
 	data->position_loc = glGetAttribLocation(data->shader_program,
 		"a_position");
 
-	glesh_init_object(&object);
-	glesh_generate_sphere(1000, 1.0f, &object);
-	glesh_add_object(context, &object);
+	glesh_init_object(context, &object);
+	if(data->flags & T_FLAG_OPTIMIZE_VERTEX_CACHE)
+	{
+		object.flags |= GLESH_OBJECT_OPTIMIZE_VERTEX_CACHE;
+	}
+	glesh_generate_sphere(data->flags & (T_FLAG_INTERLEAVED |
+		T_FLAG_COMPACT_VERTICES) ? SPHERE_SLICES_16BIT : SPHERE_SLICES,
+		1.0f, &object);
+	data->obj = glesh_add_object(context, &object);
+	if(!data->obj)
+	{
+		return 0;
+	}
+
+	data->acmr = glesh_object_acmr(data->obj);
+	BLTS_DEBUG("ACMR: %lf (%d vertex cache entries)\n", data->acmr,
+		GLESH_ACMR_CACHE_SIZE);
+
+	if(data->flags & (T_FLAG_INTERLEAVED | T_FLAG_COMPACT_VERTICES))
+	{
+		glesh_vertex_format format = { GLESH_FORMAT_FLOAT,
+			GLESH_FORMAT_FLOAT, GLESH_FORMAT_FLOAT };
+
+		if(data->flags & T_FLAG_COMPACT_VERTICES)
+		{
+			/* Sphere positions are within -1...1 so normalized shorts
+			 * will do if half floats are not supported */
+			if(glesh_gl_extension_supported("GL_OES_vertex_half_float"))
+			{
+				format.position = GLESH_FORMAT_HALF_FLOAT;
+			}
+			else
+			{
+				format.position = GLESH_FORMAT_SHORT;
+			}
+			format.normal = GLESH_FORMAT_BYTE;
+			format.texcoord = GLESH_FORMAT_SHORT;
+		}
+
+		if(!glesh_interleave_object(data->obj, &format))
+		{
+			BLTS_ERROR("Failed to interleave vertex data\n");
+			return 0;
+		}
+		if(!data->obj->indices16)
+		{
+			BLTS_ERROR("No 16-bit indices for %d vertices\n",
+				data->obj->num_vertices);
+			return 0;
+		}
+		BLTS_DEBUG("Vertex data: %d bytes per vertex, 2 byte indices\n",
+			data->obj->stride);
+	}
+
+	if(data->flags & T_FLAG_VBO)
+	{
+		if(!glesh_create_object_buffers(data->obj, GL_STATIC_DRAW))
+		{
+			BLTS_ERROR("Failed to create buffer objects\n");
+			return 0;
+		}
+	}
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glUseProgram(data->shader_program);
 	glViewport(0, 0, context->width, context->height);
 
-	glVertexAttribPointer(data->position_loc, 3, GL_FLOAT, GL_FALSE, 0,
-		context->objects[0].vertices);
+	glesh_object_attrib_pointer(data->obj, data->position_loc,
+		GLESH_ATTRIB_POSITION);
 	glEnableVertexAttribArray(data->position_loc);
+	data->indices = glesh_object_bind_indices(data->obj);
+	data->index_type = glesh_object_index_type(data->obj);
 
 	return 1;
 }
 
 static int draw(glesh_context* context, void* user_ptr)
 {
-	UNUSED_PARAM(user_ptr)
+	s_test_data* data = (s_test_data*)user_ptr;
 	glClear(GL_COLOR_BUFFER_BIT);
-	glDrawElements(GL_TRIANGLES, context->objects[0].num_indices,
-		GL_UNSIGNED_INT, context->objects[0].indices);
-	eglSwapBuffers(context->egl_display, context->egl_surface);
+	glDrawElements(GL_TRIANGLES, data->obj->num_indices,
+		data->index_type, data->indices);
+	glesh_swap_buffers(context);
 	return 1;
 }
 
@@ -82,6 +153,17 @@ int test_polygons(test_execution_params* params)
 {
 	glesh_context context;
 	s_test_data data;
+	double polygons_per_second;
+
+	data.flags = params->flag;
+	if(data.flags & T_FLAG_VBO)
+	{
+		BLTS_DEBUG("Using vertex and index buffer objects\n");
+	}
+	if(data.flags & T_FLAG_OPTIMIZE_VERTEX_CACHE)
+	{
+		BLTS_DEBUG("Using vertex cache optimized mesh\n");
+	}
 
 	if(!glesh_create_context(&context, NULL, params->w, params->h, params->d))
 	{
@@ -100,9 +182,12 @@ int test_polygons(test_execution_params* params)
 		BLTS_ERROR("glesh_execute_main_loop failed!\n");
 	}
 
-	BLTS_DEBUG("Polygons per second: %lf\n", glesh_context_triangle_count(&context) *
+	polygons_per_second = (double)glesh_context_triangle_count(&context) *
 		context.perf_data.frames_rendered /
-		context.perf_data.total_time_elapsed);
+		context.perf_data.total_time_elapsed;
+	BLTS_DEBUG("Polygons per second: %lf\n", polygons_per_second);
+	glesh_report_result("polygons_per_second", polygons_per_second, "1/s");
+	glesh_report_result("acmr", data.acmr, "vertices/triangle");
 
 	glesh_destroy_context(&context);
 
@@ -0,0 +1,475 @@
+/* test_shader_compile.c -- Shader compile and link times
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ogles2_helper.h"
+#include "test_common.h"
+
+#define MAX_PROGRAMS 32
+
+/* Statements in the synthetic shaders */
+static const int long_shader_lengths[] = { 64, 256, 1024 };
+
+static const char long_vertex_begin[] =
+	"attribute vec4 a_position;\n"
+	"uniform highp mat4 u_matrix;\n"
+	"varying highp vec4 v_value;\n"
+	"void main()\n"
+	"{\n"
+	"	highp vec4 p = u_matrix * a_position;\n";
+static const char long_vertex_step[] =
+	"	p = p * vec4(%d.25) + p.yzwx * dot(p, p);\n";
+static const char long_vertex_end[] =
+	"	v_value = p;\n"
+	"	gl_Position = u_matrix * a_position;\n"
+	"}\n";
+
+static const char long_fragment_begin[] =
+	"varying highp vec4 v_value;\n"
+	"void main()\n"
+	"{\n"
+	"	highp vec4 c = v_value;\n";
+static const char long_fragment_step[] =
+	"	c = clamp(c * vec4(%d.5) - c.wzyx, -1.0, 1.0);\n";
+static const char long_fragment_end[] =
+	"	gl_FragColor = c;\n"
+	"}\n";
+
+typedef struct
+{
+	char name[32];
+	char* vertex;
+	char* fragment;
+	int source_size;
+	/* Sums over all iterations, in seconds */
+	double compile_time;
+	double link_time;
+	double first_draw_time;
+	double warm_time; /* compile and link */
+	double cached_time;
+	int cached; /* times loaded from the program binary cache */
+} s_program;
+
+typedef struct
+{
+	s_program programs[MAX_PROGRAMS];
+	int num_programs;
+	int iterations;
+	int salt;
+} s_test_data;
+
+static int add_program(s_test_data* data, const char* name,
+	const char* vertex, const char* fragment)
+{
+	s_program* prog;
+
+	if(data->num_programs == MAX_PROGRAMS)
+	{
+		BLTS_ERROR("Too many programs\n");
+		return 0;
+	}
+
+	prog = &data->programs[data->num_programs];
+	memset(prog, 0, sizeof(s_program));
+	snprintf(prog->name, sizeof(prog->name), "%s", name);
+	prog->vertex = strdup(vertex);
+	prog->fragment = strdup(fragment);
+	if(!prog->vertex || !prog->fragment)
+	{
+		BLTS_LOGGED_PERROR("strdup");
+		free(prog->vertex);
+		free(prog->fragment);
+		return 0;
+	}
+	prog->source_size = strlen(vertex) + strlen(fragment);
+	data->num_programs++;
+
+	return 1;
+}
+
+static int add_programs(s_test_data* data,
+	int (*get_programs)(const test_shader_program**))
+{
+	const test_shader_program* programs;
+	int count = get_programs(&programs);
+	int t;
+
+	for(t = 0; t < count; t++)
+	{
+		if(!add_program(data, programs[t].name, programs[t].vertex,
+			programs[t].fragment))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int add_convolution_programs(s_test_data* data)
+{
+	const test_shader_program* blitter;
+	char name[32];
+	char* shader;
+	int size, ret;
+
+	test_blitter_programs(&blitter);
+
+	for(size = TEST_MIN_KERNEL_SIZE; size <= TEST_MAX_KERNEL_SIZE; size += 2)
+	{
+		shader = test_blitter_kernel_shader(size);
+		if(!shader)
+		{
+			return 0;
+		}
+		sprintf(name, "convolution_%dx%d", size, size);
+		ret = add_program(data, name, blitter[0].vertex, shader);
+		free(shader);
+		if(!ret)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static char* long_shader(const char* begin, const char* step,
+	const char* end, int statements)
+{
+	size_t size = strlen(begin) + strlen(end) +
+		statements * (strlen(step) + 16) + 1;
+	char* shader = malloc(size);
+	char* p;
+	int t;
+
+	if(!shader)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+		return NULL;
+	}
+
+	p = shader + sprintf(shader, "%s", begin);
+	for(t = 0; t < statements; t++)
+	{
+		p += sprintf(p, step, t % 7 + 1);
+	}
+	strcpy(p, end);
+
+	return shader;
+}
+
+static int add_long_programs(s_test_data* data)
+{
+	char* vertex;
+	char* fragment;
+	char name[32];
+	unsigned int t;
+	int ret;
+
+	for(t = 0; t < ARRAY_SIZE(long_shader_lengths); t++)
+	{
+		vertex = long_shader(long_vertex_begin, long_vertex_step,
+			long_vertex_end, long_shader_lengths[t]);
+		fragment = long_shader(long_fragment_begin, long_fragment_step,
+			long_fragment_end, long_shader_lengths[t]);
+		if(!vertex || !fragment)
+		{
+			free(vertex);
+			free(fragment);
+			return 0;
+		}
+
+		sprintf(name, "long_%d", long_shader_lengths[t]);
+		ret = add_program(data, name, vertex, fragment);
+		free(vertex);
+		free(fragment);
+		if(!ret)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* A unique comment makes the source new to the driver and any shader
+ * cache it keeps, in memory or on disk */
+static char* salted(s_test_data* data, const char* source)
+{
+	char* shader = malloc(strlen(source) + 64);
+
+	if(!shader)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+		return NULL;
+	}
+	sprintf(shader, "// %d %d %ld\n%s", (int)getpid(), data->salt++,
+		(long)time(NULL), source);
+
+	return shader;
+}
+
+/* Compiles and links, then draws a point with the program, as many
+ * drivers finish the work only on first use. Times are added to the
+ * given sums. */
+static int build_program(const char* vertex, const char* fragment,
+	double* compile_time, double* link_time, double* first_draw_time)
+{
+	GLuint vertex_shader = 0;
+	GLuint fragment_shader = 0;
+	GLuint program = 0;
+	GLint linked = 0;
+	double start, compiled, linked_time;
+
+	start = glesh_time();
+	vertex_shader = glesh_load_shader(GL_VERTEX_SHADER, vertex);
+	if(vertex_shader)
+	{
+		fragment_shader = glesh_load_shader(GL_FRAGMENT_SHADER, fragment);
+	}
+	compiled = glesh_time();
+
+	if(vertex_shader && fragment_shader)
+	{
+		program = glCreateProgram();
+	}
+	if(program)
+	{
+		glAttachShader(program, vertex_shader);
+		glAttachShader(program, fragment_shader);
+		glLinkProgram(program);
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	}
+	linked_time = glesh_time();
+
+	if(linked)
+	{
+		glUseProgram(program);
+		glDrawArrays(GL_POINTS, 0, 1);
+		glFinish();
+		glUseProgram(0);
+		*first_draw_time += glesh_time() - linked_time;
+	}
+	*compile_time += compiled - start;
+	*link_time += linked_time - compiled;
+
+	if(program)
+	{
+		glDeleteProgram(program);
+	}
+	if(fragment_shader)
+	{
+		glDeleteShader(fragment_shader);
+	}
+	if(vertex_shader)
+	{
+		glDeleteShader(vertex_shader);
+	}
+
+	if(!linked)
+	{
+		BLTS_ERROR("Failed to build program\n");
+	}
+
+	return linked;
+}
+
+static int measure_program(s_test_data* data, s_program* prog)
+{
+	const glesh_program_timing* timing = glesh_get_program_timing();
+	char* vertex = salted(data, prog->vertex);
+	char* fragment = salted(data, prog->fragment);
+	double unused = 0.0;
+	double start;
+	GLuint program;
+	int cached;
+	int ret = 0;
+
+	if(!vertex || !fragment)
+	{
+		goto cleanup;
+	}
+
+	/* Cold: never seen by the driver */
+	if(!build_program(vertex, fragment, &prog->compile_time,
+		&prog->link_time, &prog->first_draw_time))
+	{
+		goto cleanup;
+	}
+
+	/* Warm: the same source again, as e.g. on the next start of an
+	 * application on a driver with a shader cache */
+	if(!build_program(prog->vertex, prog->fragment, &unused, &unused,
+		&unused))
+	{
+		goto cleanup;
+	}
+	if(!build_program(prog->vertex, prog->fragment, &prog->warm_time,
+		&prog->warm_time, &unused))
+	{
+		goto cleanup;
+	}
+
+	/* Program binary cache of -pc. The first load stores the binary if
+	 * it is not cached yet. */
+	program = glesh_load_program(prog->vertex, prog->fragment);
+	glDeleteProgram(program);
+	cached = timing->cached;
+	start = glesh_time();
+	program = glesh_load_program(prog->vertex, prog->fragment);
+	if(timing->cached > cached)
+	{
+		prog->cached_time += glesh_time() - start;
+		prog->cached++;
+	}
+	glDeleteProgram(program);
+
+	ret = 1;
+
+cleanup:
+	free(vertex);
+	free(fragment);
+
+	return ret;
+}
+
+static void report(s_test_data* data)
+{
+	double compile_time = 0.0;
+	double link_time = 0.0;
+	double first_draw_time = 0.0;
+	double warm_time = 0.0;
+	double cached_time = 0.0;
+	double source_size = 0.0;
+	double n = data->iterations;
+	char tag[64];
+	s_program* prog;
+	int cached = 1;
+	int t;
+
+	BLTS_DEBUG("Iterations: %d\n", data->iterations);
+	BLTS_DEBUG("%-20s %8s %10s %10s %10s %10s %10s\n", "program", "bytes",
+		"compile", "link", "first_draw", "warm", "cached");
+
+	for(t = 0; t < data->num_programs; t++)
+	{
+		prog = &data->programs[t];
+		BLTS_DEBUG("%-20s %8d %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+			prog->name, prog->source_size,
+			prog->compile_time * 1000.0 / n, prog->link_time * 1000.0 / n,
+			prog->first_draw_time * 1000.0 / n, prog->warm_time * 1000.0 / n,
+			prog->cached ? prog->cached_time * 1000.0 / prog->cached : 0.0);
+
+		sprintf(tag, "%s_compile", prog->name);
+		glesh_report_result(tag, prog->compile_time * 1000.0 / n, "ms");
+		sprintf(tag, "%s_link", prog->name);
+		glesh_report_result(tag, prog->link_time * 1000.0 / n, "ms");
+		sprintf(tag, "%s_warm", prog->name);
+		glesh_report_result(tag, prog->warm_time * 1000.0 / n, "ms");
+
+		compile_time += prog->compile_time;
+		link_time += prog->link_time;
+		first_draw_time += prog->first_draw_time;
+		warm_time += prog->warm_time;
+		cached_time += prog->cached_time;
+		source_size += prog->source_size;
+		cached = cached && prog->cached == data->iterations;
+	}
+
+	/* Per start-up of all programs */
+	glesh_report_result("cold_compile_time", compile_time * 1000.0 / n, "ms");
+	glesh_report_result("cold_link_time", link_time * 1000.0 / n, "ms");
+	glesh_report_result("first_draw_time", first_draw_time * 1000.0 / n,
+		"ms");
+	glesh_report_result("warm_time", warm_time * 1000.0 / n, "ms");
+	if(cached)
+	{
+		glesh_report_result("binary_cache_time", cached_time * 1000.0 / n,
+			"ms");
+	}
+
+	/* Rates, a slower compiler must show up as a regression */
+	glesh_report_directed_result("cold_programs_per_second",
+		data->num_programs * n / (compile_time + link_time), "1/s",
+		GLESH_HIGHER_IS_BETTER);
+	glesh_report_directed_result("cold_source_throughput",
+		source_size * n / 1024.0 / (compile_time + link_time), "KiB/s",
+		GLESH_HIGHER_IS_BETTER);
+	glesh_report_directed_result("warm_programs_per_second",
+		data->num_programs * n / warm_time, "1/s", GLESH_HIGHER_IS_BETTER);
+}
+
+int test_shader_compile(test_execution_params* params)
+{
+	glesh_context context;
+	s_test_data data;
+	double start;
+	int ret = -1;
+	int t;
+
+	memset(&data, 0, sizeof(s_test_data));
+
+	if(!glesh_create_context(&context, NULL, params->w, params->h, params->d))
+	{
+		BLTS_ERROR("glesh_create_context failed!\n");
+		return -1;
+	}
+
+	if(!add_programs(&data, test_blitter_programs) ||
+		!add_programs(&data, test_vert_shader_programs) ||
+		!add_programs(&data, test_frag_shader_programs) ||
+		!add_convolution_programs(&data) ||
+		!add_long_programs(&data))
+	{
+		BLTS_ERROR("Failed to generate shaders\n");
+		goto cleanup;
+	}
+
+	/* Whole passes over the corpus until the time is up */
+	start = glesh_time();
+	do
+	{
+		for(t = 0; t < data.num_programs; t++)
+		{
+			if(!measure_program(&data, &data.programs[t]))
+			{
+				BLTS_ERROR("Program %s failed\n", data.programs[t].name);
+				goto cleanup;
+			}
+		}
+		data.iterations++;
+	} while(glesh_time() - start < params->execution_time);
+
+	report(&data);
+	ret = 0;
+
+cleanup:
+	for(t = 0; t < data.num_programs; t++)
+	{
+		free(data.programs[t].vertex);
+		free(data.programs[t].fragment);
+	}
+	glesh_destroy_context(&context);
+
+	return ret;
+}
@@ -44,6 +44,7 @@ typedef struct
 	int color_loc;
 	GLfloat color;
 	GLuint shader_program;
+	glesh_object* obj;
 } s_test_data;
 
 static int init(glesh_context* context, s_test_data* data)
@@ -66,10 +67,14 @@ static int init(glesh_context* context, s_test_data* data)
 	data->pmatrix_loc = glGetUniformLocation(data->shader_program,
 		"u_pmatrix");
 
-	glesh_init_object(&object);
+	glesh_init_object(context, &object);
 	glesh_generate_triangle_strip(4.0f, &object);
 	glesh_translate(&object.modelview, 0.0f, 0.0f, -5.0f);
-	glesh_add_object(context, &object);
+	data->obj = glesh_add_object(context, &object);
+	if(!data->obj)
+	{
+		return 0;
+	}
 
 	glesh_set_to_identity(&context->perspective_mat);
 	glesh_perspective(&context->perspective_mat, 60.0f,
@@ -80,7 +85,7 @@ static int init(glesh_context* context, s_test_data* data)
 	glUseProgram(data->shader_program);
 
 	glVertexAttribPointer(data->position_loc, 3, GL_FLOAT, GL_FALSE, 0,
-		context->objects[0].vertices);
+		data->obj->vertices);
 	glEnableVertexAttribArray(data->position_loc);
 
 	glViewport(0, 0, context->width, context->height);
@@ -97,17 +102,17 @@ static int draw(glesh_context* context, void* user_ptr)
 	data->color += 0.001f;
 	if(data->color >= 1.0f) data->color = 0.0f;
 
-	glesh_rotate(&context->objects[0].modelview, 30.0f * glesh_time_step(),
+	glesh_rotate(&data->obj->modelview, 30.0f * glesh_time_step(),
 		0.0f, 1.0f, 0.0f);
 
 	glUniformMatrix4fv(data->mvmatrix_loc, 1, GL_FALSE,
-		(GLfloat*)&context->objects[0].modelview);
+		(GLfloat*)&data->obj->modelview);
 	glUniformMatrix4fv(data->pmatrix_loc, 1, GL_FALSE,
 		(GLfloat*)&context->perspective_mat);
 	glUniform1f(data->color_loc, data->color);
 
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 3);
-	eglSwapBuffers(context->egl_display, context->egl_surface);
+	glesh_swap_buffers(context);
 	return 1;
 }
 
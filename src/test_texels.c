@@ -44,6 +44,7 @@ typedef struct
 	int sampler_loc;
 	int texcrd_loc;
 	GLuint shader_program;
+	glesh_object* obj;
 } s_test_data;
 
 static int init(glesh_context* context, s_test_data* data)
@@ -72,26 +73,30 @@ static int init(glesh_context* context, s_test_data* data)
 		return 0;
 	}
 
-	glesh_init_object(&object);
+	glesh_init_object(context, &object);
 	glesh_generate_rectangle_strip(2.0f, 2.0f, &object);
 	glesh_attach_texture(&object, tex);
-	glesh_add_object(context, &object);
+	data->obj = glesh_add_object(context, &object);
+	if(!data->obj)
+	{
+		return 0;
+	}
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
 	glUseProgram(data->shader_program);
 
-	glActiveTexture(GL_TEXTURE0 + context->objects[0].tex->tex_id);
-	glBindTexture(GL_TEXTURE_2D, context->objects[0].tex->tex_id);
+	glActiveTexture(GL_TEXTURE0 + data->obj->tex->tex_id);
+	glBindTexture(GL_TEXTURE_2D, data->obj->tex->tex_id);
 
 	glVertexAttribPointer(data->position_loc, 3, GL_FLOAT, GL_FALSE, 0,
-		context->objects[0].vertices);
+		data->obj->vertices);
 	glVertexAttribPointer(data->texcrd_loc, 2, GL_FLOAT, GL_FALSE, 0,
-		context->objects[0].texcoords);
+		data->obj->texcoords);
 	glEnableVertexAttribArray(data->position_loc);
 	glEnableVertexAttribArray(data->texcrd_loc);
 
-	glUniform1i(data->sampler_loc, context->objects[0].tex->tex_id);
+	glUniform1i(data->sampler_loc, data->obj->tex->tex_id);
 
 	glViewport(0, 0, context->width, context->height);
 
@@ -101,16 +106,16 @@ static int init(glesh_context* context, s_test_data* data)
 static int draw(glesh_context* context, void* user_ptr)
 {
 	int t;
-	UNUSED_PARAM(user_ptr)
+	s_test_data* data = (s_test_data*)user_ptr;
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	for(t = 0; t < 8; t++)
 	{
-		context->objects[0].texcoords[t] += 0.001f;
+		data->obj->texcoords[t] += 0.001f;
 	}
 
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	eglSwapBuffers(context->egl_display, context->egl_surface);
+	glesh_swap_buffers(context);
 	return 1;
 }
 
@@ -119,6 +124,7 @@ int test_texels(test_execution_params* params)
 {
 	glesh_context context;
 	s_test_data data;
+	double texels_per_second;
 
 	if(!glesh_create_context(&context, NULL, params->w, params->h, params->d))
 	{
@@ -137,9 +143,11 @@ int test_texels(test_execution_params* params)
 		BLTS_ERROR("glesh_execute_main_loop failed!\n");
 	}
 
-	BLTS_DEBUG("Texels per second: %lf\n", context.width * context.height *
+	texels_per_second = (double)context.width * context.height *
 		context.perf_data.frames_rendered /
-		context.perf_data.total_time_elapsed);
+		context.perf_data.total_time_elapsed;
+	BLTS_DEBUG("Texels per second: %lf\n", texels_per_second);
+	glesh_report_result("texels_per_second", texels_per_second, "1/s");
 
 	glesh_destroy_context(&context);
 
@@ -0,0 +1,163 @@
+/* test_texture_reuse.c -- Loading and releasing textures while running
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "ogles2_helper.h"
+#include "test_common.h"
+
+/* Textures loaded at any time, like the images of a scrolling view */
+#define NUM_TEXTURES 64
+#define TEXTURE_SIZE 256
+
+typedef struct
+{
+	glesh_texture* textures[NUM_TEXTURES];
+	unsigned int next_name; /* every load gets a name not used before */
+	unsigned int cycles;
+	double cycle_time;
+} s_test_data;
+
+static glesh_texture* load_texture(glesh_context* context, s_test_data* data)
+{
+	char name[GLESH_TEXTURE_NAME_MAX];
+
+	sprintf(name, "reuse_%u", data->next_name++);
+	return glesh_generate_texture(context, GL_RGBA, TEXTURE_SIZE,
+		TEXTURE_SIZE, name);
+}
+
+/* A second user of the texture shares it by name, then the texture is
+ * released by both and replaced. The replacement must get the released
+ * texture and its GL name. */
+static int cycle_texture(glesh_context* context, s_test_data* data, int slot)
+{
+	glesh_texture* tex = data->textures[slot];
+	char name[GLESH_TEXTURE_NAME_MAX];
+	GLuint tex_id = tex->tex_id;
+
+	strcpy(name, tex->name);
+	if(glesh_generate_texture(context, GL_RGBA, TEXTURE_SIZE, TEXTURE_SIZE,
+		name) != tex)
+	{
+		BLTS_ERROR("Texture %s not shared\n", name);
+		return 0;
+	}
+
+	if(!glesh_release_texture(context, tex) ||
+		!glesh_release_texture(context, tex))
+	{
+		return 0;
+	}
+	if(glesh_texture_by_name(context, name))
+	{
+		BLTS_ERROR("Released texture %s still found by name\n", name);
+		return 0;
+	}
+
+	data->textures[slot] = load_texture(context, data);
+	if(!data->textures[slot])
+	{
+		BLTS_ERROR("Failed to load texture\n");
+		return 0;
+	}
+	if(data->textures[slot]->tex_id != tex_id)
+	{
+		BLTS_ERROR("Texture name %u not reused\n", tex_id);
+		return 0;
+	}
+
+	return 1;
+}
+
+int test_texture_reuse(test_execution_params* params)
+{
+	glesh_context context;
+	s_test_data data;
+	double start, end;
+	int pool_size;
+	int ret = -1;
+	int t;
+
+	memset(&data, 0, sizeof(s_test_data));
+
+	if(!glesh_create_context(&context, NULL, params->w, params->h, params->d))
+	{
+		BLTS_ERROR("glesh_create_context failed!\n");
+		return -1;
+	}
+
+	for(t = 0; t < NUM_TEXTURES; t++)
+	{
+		data.textures[t] = load_texture(&context, &data);
+		if(!data.textures[t])
+		{
+			BLTS_ERROR("Failed to load texture\n");
+			goto cleanup;
+		}
+	}
+	glFinish();
+	pool_size = context.texture_pool_size;
+
+	/* Each cycle is timed until the GPU has the new texels */
+	start = glesh_time();
+	do
+	{
+		if(!cycle_texture(&context, &data, data.cycles % NUM_TEXTURES))
+		{
+			goto cleanup;
+		}
+		glFinish();
+		end = glesh_time();
+		data.cycle_time += end - start;
+		data.cycles++;
+		start = end;
+	} while(data.cycle_time < params->execution_time);
+
+	if(glGetError() != GL_NO_ERROR)
+	{
+		BLTS_ERROR("Loading or releasing textures failed\n");
+		goto cleanup;
+	}
+	if(context.texture_pool_size != pool_size)
+	{
+		BLTS_ERROR("Texture name pool grew from %d to %d\n", pool_size,
+			context.texture_pool_size);
+		goto cleanup;
+	}
+
+	BLTS_DEBUG("Textures: %d x %d, %d loaded at a time, %u replaced\n",
+		TEXTURE_SIZE, TEXTURE_SIZE, NUM_TEXTURES, data.cycles);
+	glesh_report_result("texture_cycle_time",
+		data.cycle_time * 1000.0 / data.cycles, "ms");
+	glesh_report_result("textures_per_second",
+		data.cycles / data.cycle_time, "1/s");
+	ret = 0;
+
+cleanup:
+	for(t = 0; t < NUM_TEXTURES; t++)
+	{
+		if(data.textures[t])
+		{
+			glesh_release_texture(&context, data.textures[t]);
+		}
+	}
+	glesh_destroy_context(&context);
+
+	return ret;
+}
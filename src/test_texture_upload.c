@@ -0,0 +1,325 @@
+/* test_texture_upload.c -- Texture upload throughput and latency
+
+   Copyright (C) 2026 BLTS contributors.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ogles2_helper.h"
+#include "ogles2_stats.h"
+#include "test_common.h"
+#include <GLES2/gl2ext.h>
+
+#define MIN_UPLOAD_SIZE 64
+#define MAX_UPLOAD_SIZE 4096
+#define NUM_UPLOAD_SIZES 7 /* powers of two in between */
+/* Uploads timed per configuration */
+#define MIN_UPLOADS 3
+#define MAX_UPLOADS 256
+
+enum upload_method {
+	METHOD_IMAGE, /* glTexImage2D, the texture is re-specified */
+	METHOD_SUB_IMAGE, /* glTexSubImage2D into a texture of the same size */
+};
+
+typedef struct
+{
+	const char* name;
+	GLenum format;
+	GLenum type; /* 0 for compressed formats */
+	int texel_size; /* bytes, 0 for compressed formats */
+	const char* extension; /* required, NULL if core */
+} s_format;
+
+static const s_format formats[] =
+{
+	{ "rgba8888", GL_RGBA, GL_UNSIGNED_BYTE, 4, NULL },
+	{ "rgb565", GL_RGB, GL_UNSIGNED_SHORT_5_6_5, 2, NULL },
+	{ "luminance", GL_LUMINANCE, GL_UNSIGNED_BYTE, 1, NULL },
+	{ "alpha", GL_ALPHA, GL_UNSIGNED_BYTE, 1, NULL },
+#ifdef GL_OES_compressed_ETC1_RGB8_texture
+	{ "etc1", GL_ETC1_RGB8_OES, 0, 0, "GL_OES_compressed_ETC1_RGB8_texture" },
+#endif
+};
+
+typedef struct
+{
+	const s_format* format;
+	int size;
+	enum upload_method method;
+	/* Odd row length, GL_UNPACK_ALIGNMENT 1 and a source address off by
+	 * one byte, the slow path of most drivers */
+	int unaligned;
+	size_t bytes; /* per upload */
+	int uploads;
+	double samples[MAX_UPLOADS]; /* seconds, until the upload has finished */
+	double total_time;
+} s_config;
+
+typedef struct
+{
+	s_config* configs;
+	int num_configs;
+	unsigned char* texels;
+	GLuint tex_id;
+} s_test_data;
+
+static size_t upload_size(const s_format* format, int width, int height)
+{
+	if(!format->type)
+	{
+		/* ETC1, 64 bits per block of 4 x 4 texels */
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+	}
+
+	return (size_t)width * height * format->texel_size;
+}
+
+static void add_config(s_test_data* data, const s_format* format, int size,
+	enum upload_method method, int unaligned)
+{
+	s_config* config = &data->configs[data->num_configs++];
+
+	memset(config, 0, sizeof(s_config));
+	config->format = format;
+	config->size = size;
+	config->method = method;
+	config->unaligned = unaligned;
+	config->bytes = upload_size(format, unaligned ? size - 1 : size, size);
+}
+
+static int init_configs(s_test_data* data)
+{
+	GLint max_size = 0;
+	unsigned int f;
+	int size;
+
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+	/* Four combinations of method and alignment per size */
+	data->configs = malloc(sizeof(s_config) * ARRAY_SIZE(formats) * 4 *
+		NUM_UPLOAD_SIZES);
+	if(!data->configs)
+	{
+		BLTS_LOGGED_PERROR("malloc");
+		return 0;
+	}
+
+	for(f = 0; f < ARRAY_SIZE(formats); f++)
+	{
+		if(formats[f].extension &&
+			!glesh_gl_extension_supported(formats[f].extension))
+		{
+			BLTS_DEBUG("%s not supported, skipping %s\n",
+				formats[f].extension, formats[f].name);
+			continue;
+		}
+
+		for(size = MIN_UPLOAD_SIZE; size <= GLESH_MIN(MAX_UPLOAD_SIZE,
+			max_size); size *= 2)
+		{
+			add_config(data, &formats[f], size, METHOD_IMAGE, 0);
+			/* Compressed ETC1 textures can only be specified whole */
+			if(!formats[f].type)
+			{
+				continue;
+			}
+			add_config(data, &formats[f], size, METHOD_SUB_IMAGE, 0);
+			add_config(data, &formats[f], size, METHOD_IMAGE, 1);
+			add_config(data, &formats[f], size, METHOD_SUB_IMAGE, 1);
+		}
+	}
+
+	return 1;
+}
+
+static void config_name(const s_config* config, char* name)
+{
+	sprintf(name, "%s_%d_%s%s", config->format->name, config->size,
+		config->method == METHOD_IMAGE ? "image" : "subimage",
+		config->unaligned ? "_unaligned" : "");
+}
+
+static void upload(const s_config* config, const unsigned char* texels)
+{
+	const s_format* format = config->format;
+	int width = config->unaligned ? config->size - 1 : config->size;
+
+	if(!format->type)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, 0, format->format, width,
+			config->size, 0, config->bytes, texels);
+	}
+	else if(config->method == METHOD_IMAGE)
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, format->format, width, config->size,
+			0, format->format, format->type, texels);
+	}
+	else
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, config->size,
+			format->format, format->type, texels);
+	}
+}
+
+/* Each upload is timed until glFinish() returns, as drivers may defer
+ * the copy until the texture is used */
+static int run_config(s_test_data* data, s_config* config, double budget)
+{
+	const unsigned char* texels = data->texels + config->unaligned;
+	double start, end;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, config->unaligned ? 1 : 4);
+	glBindTexture(GL_TEXTURE_2D, data->tex_id);
+
+	/* Storage for glTexSubImage2D, and a first use of the format either
+	 * way so that one-time driver work is not timed */
+	if(config->format->type)
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, config->format->format, config->size,
+			config->size, 0, config->format->format, config->format->type,
+			NULL);
+	}
+	upload(config, texels);
+	glFinish();
+	if(glGetError() != GL_NO_ERROR)
+	{
+		BLTS_ERROR("Uploading %d x %d %s failed\n", config->size,
+			config->size, config->format->name);
+		return 0;
+	}
+
+	start = glesh_time();
+	while(config->uploads < MAX_UPLOADS && (config->uploads < MIN_UPLOADS ||
+		config->total_time < budget))
+	{
+		upload(config, texels);
+		glFinish();
+		end = glesh_time();
+		config->samples[config->uploads++] = end - start;
+		config->total_time += end - start;
+		start = end;
+	}
+
+	stats_sort(config->samples, config->uploads);
+
+	return 1;
+}
+
+static void report(s_test_data* data)
+{
+	const s_config* config;
+	char name[64];
+	char tag[96];
+	double rate, p50, p90, p99;
+	int t;
+
+	BLTS_DEBUG("%-32s %10s %10s %10s %10s %8s\n", "upload", "MiB/s",
+		"p50 ms", "p90 ms", "p99 ms", "uploads");
+
+	for(t = 0; t < data->num_configs; t++)
+	{
+		config = &data->configs[t];
+		config_name(config, name);
+		rate = config->bytes * config->uploads / config->total_time /
+			(1024.0 * 1024.0);
+		p50 = stats_percentile(config->samples, config->uploads, 50.0) *
+			1000.0;
+		p90 = stats_percentile(config->samples, config->uploads, 90.0) *
+			1000.0;
+		p99 = stats_percentile(config->samples, config->uploads, 99.0) *
+			1000.0;
+
+		BLTS_DEBUG("%-32s %10.1f %10.3f %10.3f %10.3f %8d\n", name, rate,
+			p50, p90, p99, config->uploads);
+
+		sprintf(tag, "%s_rate", name);
+		glesh_report_result(tag, rate, "MiB/s");
+		sprintf(tag, "%s_p50", name);
+		glesh_report_result(tag, p50, "ms");
+		sprintf(tag, "%s_p90", name);
+		glesh_report_result(tag, p90, "ms");
+		sprintf(tag, "%s_p99", name);
+		glesh_report_result(tag, p99, "ms");
+	}
+}
+
+int test_texture_upload(test_execution_params* params)
+{
+	glesh_context context;
+	s_test_data data;
+	size_t max_bytes = 0;
+	double budget;
+	int ret = -1;
+	int t;
+
+	memset(&data, 0, sizeof(s_test_data));
+
+	if(!glesh_create_context(&context, NULL, params->w, params->h, params->d))
+	{
+		BLTS_ERROR("glesh_create_context failed!\n");
+		return -1;
+	}
+
+	if(!init_configs(&data) || !data.num_configs)
+	{
+		goto cleanup;
+	}
+
+	for(t = 0; t < data.num_configs; t++)
+	{
+		max_bytes = GLESH_MAX(max_bytes, data.configs[t].bytes);
+	}
+
+	/* One source for all uploads, with room for the unaligned offset.
+	 * The contents do not matter, but the pages must be there. */
+	data.texels = glesh_staging_buffer(&context.staging, max_bytes + 1);
+	if(!data.texels)
+	{
+		goto cleanup;
+	}
+	memset(data.texels, 0x5a, max_bytes + 1);
+
+	glGenTextures(1, &data.tex_id);
+	glBindTexture(GL_TEXTURE_2D, data.tex_id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	/* The time is shared evenly, large uploads stop at MIN_UPLOADS */
+	budget = (double)params->execution_time / data.num_configs;
+	for(t = 0; t < data.num_configs; t++)
+	{
+		if(!run_config(&data, &data.configs[t], budget))
+		{
+			goto cleanup;
+		}
+	}
+
+	report(&data);
+	ret = 0;
+
+cleanup:
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if(data.tex_id)
+	{
+		glDeleteTextures(1, &data.tex_id);
+	}
+	free(data.configs);
+	glesh_destroy_context(&context);
+
+	return ret;
+}
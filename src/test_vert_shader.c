@@ -89,6 +89,17 @@ static const char frag_shader[] =
 	"	gl_FragColor = vec4(diffuseIntensity + specularIntensity, 1.0);\n"
 	"}\n";
 
+static const test_shader_program programs[] =
+{
+	{ "vert_shader", vertex_shader, frag_shader },
+};
+
+int test_vert_shader_programs(const test_shader_program** out)
+{
+	*out = programs;
+	return ARRAY_SIZE(programs);
+}
+
 typedef struct
 {
 	int position_loc;
@@ -100,7 +111,11 @@ typedef struct
 	int	eye_dir_loc;
 
 	float bend;
+	int flags;
+	const GLvoid* indices;
+	double acmr;
 	GLuint shader_program;
+	glesh_object* obj;
 } s_test_data;
 
 static int init(glesh_context* context, s_test_data* data)
@@ -127,10 +142,31 @@ static int init(glesh_context* context, s_test_data* data)
 	data->eye_dir_loc = glGetUniformLocation(data->shader_program,
 		"eyeDir");
 
-	glesh_init_object(&object);
+	glesh_init_object(context, &object);
+	if(data->flags & T_FLAG_OPTIMIZE_VERTEX_CACHE)
+	{
+		object.flags |= GLESH_OBJECT_OPTIMIZE_VERTEX_CACHE;
+	}
 	glesh_generate_plane(5.0f, 60, &object);
 	glesh_translate(&object.modelview, 0.0f, 0.0f, -3.50f);
-	glesh_add_object(context, &object);
+	data->obj = glesh_add_object(context, &object);
+	if(!data->obj)
+	{
+		return 0;
+	}
+
+	data->acmr = glesh_object_acmr(data->obj);
+	BLTS_DEBUG("ACMR: %lf (%d vertex cache entries)\n", data->acmr,
+		GLESH_ACMR_CACHE_SIZE);
+
+	if(data->flags & T_FLAG_VBO)
+	{
+		if(!glesh_create_object_buffers(data->obj, GL_STATIC_DRAW))
+		{
+			BLTS_ERROR("Failed to create buffer objects\n");
+			return 0;
+		}
+	}
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
@@ -139,7 +175,7 @@ static int init(glesh_context* context, s_test_data* data)
 		(GLfloat)context->width / (GLfloat)context->height, 1.0f, 20.0f);
 
 	glesh_set_to_identity(&context->mvp_mat);
-	glesh_multiply(&context->mvp_mat, &context->objects[0].modelview,
+	glesh_multiply(&context->mvp_mat, &data->obj->modelview,
 		&context->perspective_mat);
 
 	glUseProgram(data->shader_program);
@@ -169,10 +205,11 @@ static int init(glesh_context* context, s_test_data* data)
 	glUniformMatrix4fv(data->p_matrix_loc, 1, GL_FALSE,
 		(GLfloat*)&context->perspective_mat);
 	glUniformMatrix4fv(data->mv_matrix_loc, 1, GL_FALSE,
-		(GLfloat*)&context->objects[0].modelview);
-	glVertexAttribPointer(data->position_loc, 3, GL_FLOAT, GL_FALSE, 0,
-		context->objects[0].vertices);
+		(GLfloat*)&data->obj->modelview);
+	glesh_object_attrib_pointer(data->obj, data->position_loc,
+		GLESH_ATTRIB_POSITION);
 	glEnableVertexAttribArray(data->position_loc);
+	data->indices = glesh_object_bind_indices(data->obj);
 
 	return 1;
 }
@@ -186,9 +223,9 @@ static int draw(glesh_context* context, void* user_ptr)
 	data->bend += 0.1f;
 	glUniform1f(data->bend_loc, data->bend);
 
-	glDrawElements(GL_TRIANGLES, context->objects[0].num_indices,
-		GL_UNSIGNED_INT, context->objects[0].indices);
-	eglSwapBuffers(context->egl_display, context->egl_surface);
+	glDrawElements(GL_TRIANGLES, data->obj->num_indices,
+		GL_UNSIGNED_INT, data->indices);
+	glesh_swap_buffers(context);
 
 	return 1;
 }
@@ -197,6 +234,17 @@ int test_vert_shader(test_execution_params* params)
 {
 	glesh_context context;
 	s_test_data data;
+	double polygons_per_second;
+
+	data.flags = params->flag;
+	if(data.flags & T_FLAG_VBO)
+	{
+		BLTS_DEBUG("Using vertex and index buffer objects\n");
+	}
+	if(data.flags & T_FLAG_OPTIMIZE_VERTEX_CACHE)
+	{
+		BLTS_DEBUG("Using vertex cache optimized mesh\n");
+	}
 
 	if(!glesh_create_context(&context, NULL, params->w, params->h, params->d))
 	{
@@ -215,6 +263,13 @@ int test_vert_shader(test_execution_params* params)
 		BLTS_ERROR("glesh_execute_main_loop failed!\n");
 	}
 
+	polygons_per_second = (double)glesh_context_triangle_count(&context) *
+		context.perf_data.frames_rendered /
+		context.perf_data.total_time_elapsed;
+	BLTS_DEBUG("Polygons per second: %lf\n", polygons_per_second);
+	glesh_report_result("polygons_per_second", polygons_per_second, "1/s");
+	glesh_report_result("acmr", data.acmr, "vertices/triangle");
+
 	glesh_destroy_context(&context);
 
 	return 0;